@@ -0,0 +1,105 @@
+#pragma once
+
+#include "defs.hpp"
+#include "intrinsics.hpp"
+
+#if _WIN32
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+enum isa_level_t {
+    e_isa_scalar,
+    e_isa_avx2,   // + fma
+    e_isa_avx512, // f + dq + vl
+
+    e_isa_count
+};
+
+inline constexpr char const *c_isa_names[e_isa_count] =
+{
+    "scalar",
+    "avx2",
+    "avx512",
+};
+
+struct cpu_features_t {
+    bool avx2 = false;
+    bool fma = false;
+    bool avx512f = false;
+    bool avx512dq = false;
+    bool avx512vl = false;
+    bool os_ymm = false;
+    bool os_zmm = false;
+    char brand[49] = {};
+};
+
+inline void cpuid(u32 leaf, u32 subleaf, u32 (&regs)[4])
+{
+#if _WIN32
+    int r[4];
+    __cpuidex(r, int(leaf), int(subleaf));
+    for (u32 i = 0; i < 4; ++i)
+        regs[i] = u32(r[i]);
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+inline u64 read_xcr0()
+{
+#if _WIN32
+    return _xgetbv(0);
+#else
+    u32 lo, hi;
+    asm volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return (u64(hi) << 32) | lo;
+#endif
+}
+
+inline cpu_features_t detect_cpu_features()
+{
+    cpu_features_t f = {};
+    u32 regs[4];
+
+    cpuid(0, 0, regs);
+    u32 const max_leaf = regs[0];
+
+    cpuid(1, 0, regs);
+    bool const osxsave = regs[2] & (1u << 27);
+    f.fma = regs[2] & (1u << 12);
+
+    if (osxsave) {
+        u64 const xcr0 = read_xcr0();
+        f.os_ymm = (xcr0 & 0b110) == 0b110;
+        f.os_zmm = f.os_ymm && (xcr0 & 0b11100000) == 0b11100000;
+    }
+
+    if (max_leaf >= 7) {
+        cpuid(7, 0, regs);
+        f.avx2 = regs[1] & (1u << 5);
+        f.avx512f = regs[1] & (1u << 16);
+        f.avx512dq = regs[1] & (1u << 17);
+        f.avx512vl = regs[1] & (1u << 31);
+    }
+
+    cpuid(0x80000000, 0, regs);
+    if (regs[0] >= 0x80000004) {
+        for (u32 i = 0; i < 3; ++i) {
+            cpuid(0x80000002 + i, 0, regs);
+            memcpy(f.brand + 16 * i, regs, sizeof(regs));
+        }
+    }
+
+    return f;
+}
+
+inline isa_level_t best_isa_level(cpu_features_t const &f)
+{
+    if (f.os_zmm && f.avx512f && f.avx512dq && f.avx512vl && f.avx2 && f.fma)
+        return e_isa_avx512;
+    if (f.os_ymm && f.avx2 && f.fma)
+        return e_isa_avx2;
+    return e_isa_scalar;
+}
@@ -6,7 +6,8 @@
 
 enum os_file_mapping_flags_bits_t {
     e_osfmf_largepage = 1,
-    e_osfmf_no_init_map = 2
+    e_osfmf_no_init_map = 2,
+    e_osfmf_random_access = 4 // Sparse reads, no readahead (linux only)
 };
 
 using os_file_mapping_flags_t = u32;
@@ -58,6 +59,50 @@ inline usize os_file_read(os_file_t const &f, void *buf, usize bytes)
     return res ? usize(real_bytes) : 0;
 }
 
+inline bool os_file_seek(os_file_t const &f, usize off)
+{
+    assert(is_valid(f));
+    LARGE_INTEGER loff;
+    loff.QuadPart = LONGLONG(off);
+    return SetFilePointerEx(f.hnd, loff, nullptr, FILE_BEGIN);
+}
+
+// Creates or truncates
+inline os_file_t os_write_open_file(const char *fn)
+{
+    os_file_t f = {};
+
+    f.hnd = CreateFileA(
+        fn, GENERIC_WRITE, 0, nullptr,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (!is_valid(f))
+        return {};
+
+    return f;
+}
+
+// Positional, doesn't move the file pointer. Safe to call concurrently for
+// different ranges. Returns false unless all bytes were written.
+inline bool os_file_write_at(
+    os_file_t const &f, void const *buf, usize bytes, usize off)
+{
+    assert(is_valid(f));
+    char const *p = (char const *)buf;
+    while (bytes > 0) {
+        DWORD const chunk = DWORD(min(bytes, usize(1) << 30));
+        OVERLAPPED ov = {};
+        ov.Offset = DWORD(off & 0xFFFFFFFF);
+        ov.OffsetHigh = DWORD(off >> 32);
+        DWORD written = 0;
+        if (!WriteFile(f.hnd, p, chunk, &written, &ov) || written == 0)
+            return false;
+        p += written;
+        off += written;
+        bytes -= written;
+    }
+    return true;
+}
+
 struct os_mapped_file_t {
     char *data;
     usize len;
@@ -189,6 +234,45 @@ inline usize os_file_read(os_file_t const &f, void *buf, usize bytes)
     return read(f.fd, buf, bytes);
 }
 
+inline bool os_file_seek(os_file_t const &f, usize off)
+{
+    assert(is_valid(f));
+    return lseek(f.fd, off_t(off), SEEK_SET) == off_t(off);
+}
+
+// Creates or truncates
+inline os_file_t os_write_open_file(const char *fn)
+{
+    os_file_t f = {};
+
+    f.fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (!is_valid(f))
+        return {};
+
+    return f;
+}
+
+// Positional, doesn't move the file pointer. Safe to call concurrently for
+// different ranges. Returns false unless all bytes were written.
+inline bool os_file_write_at(
+    os_file_t const &f, void const *buf, usize bytes, usize off)
+{
+    assert(is_valid(f));
+    char const *p = (char const *)buf;
+    while (bytes > 0) {
+        ssize_t const written = pwrite(f.fd, p, bytes, off_t(off));
+        if (written <= 0) {
+            if (written < 0 && errno == EINTR)
+                continue;
+            return false;
+        }
+        p += written;
+        off += usize(written);
+        bytes -= usize(written);
+    }
+    return true;
+}
+
 struct os_mapped_file_t {
     char *data;
     usize len;
@@ -250,6 +334,9 @@ inline os_mapped_file_t os_read_map_file(
         return {};
     }
 
+    if (flags & e_osfmf_random_access)
+        madvise(file.data, file.mapped_len, MADV_RANDOM);
+
     return file;
 }
 
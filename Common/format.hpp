@@ -0,0 +1,156 @@
+#pragma once
+
+#include "defs.hpp"
+#include "intrinsics.hpp"
+
+// printf-free number formatting for bulk text output: no locale, no
+// varargs, no format string parsing. Writers take the output position and
+// return the position after what they wrote, the caller guarantees space.
+
+inline constexpr u32 c_format_max_fixed_prec = 18;
+// Sign, 16 integer digits, point, fraction
+inline constexpr u32 c_format_max_f64_fixed_len = 1 + 16 + 1 + c_format_max_fixed_prec;
+
+inline constexpr char c_format_digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+inline constexpr u64 c_format_pow10[c_format_max_fixed_prec + 1] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull,
+    10000000ull, 100000000ull, 1000000000ull, 10000000000ull,
+    100000000000ull, 1000000000000ull, 10000000000000ull,
+    100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+    100000000000000000ull, 1000000000000000000ull};
+
+// Exactly digits chars, zero padded, val < 10^digits
+FINLINE char *format_u64_padded(char *out, u64 val, u32 digits)
+{
+    char *p = out + digits;
+    while (p - out >= 2) {
+        p -= 2;
+        memcpy(p, c_format_digit_pairs + 2 * (val % 100), 2);
+        val /= 100;
+    }
+    if (p > out)
+        *--p = char('0' + val % 10);
+    return out + digits;
+}
+
+FINLINE char *format_u64(char *out, u64 val)
+{
+    char tmp[20];
+    char *p = tmp + sizeof(tmp);
+    do {
+        *--p = char('0' + val % 10);
+        val /= 10;
+    } while (val);
+    usize const len = usize(tmp + sizeof(tmp) - p);
+    memcpy(out, p, len);
+    return out + len;
+}
+
+FINLINE char *format_str(char *out, char const *s, usize len)
+{
+    memcpy(out, s, len);
+    return out + len;
+}
+
+template <usize t_n>
+FINLINE char *format_str(char *out, char const (&s)[t_n])
+{
+    return format_str(out, s, t_n - 1);
+}
+
+// round(m * 10^prec / 2^shift), ties to even, m < 2^53
+FINLINE u64 scale_dyadic_to_decimal(u64 m, u32 shift, u32 prec)
+{
+    if (shift >= 128)
+        return 0; // < 2^113 / 2^128
+    u64 hi;
+    u64 const lo = i_mul_wide(m, c_format_pow10[prec], hi);
+    if (shift == 0)
+        return lo;
+
+    u64 q, rem_hi, rem_lo, half_hi, half_lo;
+    if (shift < 64) {
+        q = (hi << (64 - shift)) | (lo >> shift);
+        rem_hi = 0;
+        rem_lo = lo & ((u64(1) << shift) - 1);
+        half_hi = 0;
+        half_lo = u64(1) << (shift - 1);
+    } else {
+        u32 const s = shift - 64;
+        q = s ? hi >> s : hi;
+        rem_hi = s ? hi & ((u64(1) << s) - 1) : 0;
+        rem_lo = lo;
+        half_hi = s ? u64(1) << (s - 1) : 0;
+        half_lo = s ? 0 : u64(1) << 63;
+    }
+
+    bool const above = rem_hi > half_hi || (rem_hi == half_hi && rem_lo > half_lo);
+    bool const tie = rem_hi == half_hi && rem_lo == half_lo;
+    return q + ((above || (tie && (q & 1))) ? 1 : 0);
+}
+
+// Same text as printf("%.<prec>f"), for finite |v| < 2^53 and prec <= 18.
+// Anything else goes through snprintf, cut to c_format_max_f64_fixed_len.
+// Never writes past c_format_max_f64_fixed_len bytes, returns the end of
+// what was written.
+inline char *format_f64_fixed(char *out, f64 v, u32 prec)
+{
+    assert(prec <= c_format_max_fixed_prec);
+
+    u64 bits;
+    memcpy(&bits, &v, sizeof(bits));
+    bool const neg = bits >> 63;
+    f64 const a = abs(v);
+    if (!(a < 0x1.0p53)) {
+        // Aside, snprintf also writes a terminator
+        char buf[c_format_max_f64_fixed_len + 1];
+        int const n = snprintf(buf, sizeof(buf), "%.*f", int(prec), v);
+        u32 const len = min(u32(max(n, 0)), c_format_max_f64_fixed_len);
+        return format_str(out, buf, len);
+    }
+
+    if (neg)
+        *out++ = '-';
+
+    // The integer and fractional parts are both exact
+    u64 ip = u64(a);
+    f64 const frac = a - f64(ip);
+
+    u64 fp = 0;
+    if (prec == 0) {
+        // Ties go to the even integer
+        if (frac > 0.5 || (frac == 0.5 && (ip & 1)))
+            ++ip;
+    } else if (frac != 0.0) {
+        u64 fbits;
+        memcpy(&fbits, &frac, sizeof(fbits));
+        u32 const bexp = u32(fbits >> 52);
+        u64 const mant = fbits & ((u64(1) << 52) - 1);
+        // frac = m * 2^-shift
+        u64 const m = bexp ? mant | (u64(1) << 52) : mant;
+        u32 const shift = bexp ? 1075 - bexp : 1074;
+        fp = scale_dyadic_to_decimal(m, shift, prec);
+        if (fp == c_format_pow10[prec]) {
+            fp = 0;
+            ++ip;
+        }
+    }
+
+    out = format_u64(out, ip);
+    if (prec > 0) {
+        *out++ = '.';
+        out = format_u64_padded(out, fp, prec);
+    }
+    return out;
+}
@@ -16,6 +16,25 @@ FINLINE void i_full_compiler_barrier()
     _ReadWriteBarrier(); 
 }
 
+// Full 128 bit product, returns the low half
+FINLINE u64 i_mul_wide(u64 a, u64 b, u64 &hi)
+{
+    return _umul128(a, b, &hi);
+}
+
+// Returns the incremented value
+FINLINE u32 i_atomic_inc_u32(u32 volatile &x)
+{
+    return u32(_InterlockedIncrement((long volatile *)&x));
+}
+
+// Returns the value before, the swap happened if it equals expected
+FINLINE u32 i_atomic_cas_u32(u32 volatile &x, u32 expected, u32 desired)
+{
+    return u32(_InterlockedCompareExchange(
+        (long volatile *)&x, long(desired), long(expected)));
+}
+
 #else
 
 #include <x86intrin.h>
@@ -35,5 +54,48 @@ FINLINE void i_full_compiler_barrier()
     asm volatile("" ::: "memory");
 }
 
+// Full 128 bit product, returns the low half
+FINLINE u64 i_mul_wide(u64 a, u64 b, u64 &hi)
+{
+    unsigned __int128 const p = (unsigned __int128)a * b;
+    hi = u64(p >> 64);
+    return u64(p);
+}
+
+// Returns the incremented value
+FINLINE u32 i_atomic_inc_u32(u32 volatile &x)
+{
+    return __atomic_add_fetch(&x, 1, __ATOMIC_SEQ_CST);
+}
+
+// Returns the value before, the swap happened if it equals expected
+FINLINE u32 i_atomic_cas_u32(u32 volatile &x, u32 expected, u32 desired)
+{
+    __atomic_compare_exchange_n(
+        &x, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return expected;
+}
+
 #endif
 
+// Per-function instruction set targeting, so that one binary can carry
+// kernels for several isas and pick at runtime (see cpuid.hpp). Code in a
+// region must only be called after checking the matching cpu features.
+#if __clang__
+#define ISA_REGION_BEGIN_AVX2 \
+    _Pragma("clang attribute push(__attribute__((target(\"avx2,fma\"))), apply_to = function)")
+#define ISA_REGION_BEGIN_AVX512 \
+    _Pragma("clang attribute push(__attribute__((target(\"avx512f,avx512dq,avx512vl,avx2,fma\"))), apply_to = function)")
+#define ISA_REGION_END _Pragma("clang attribute pop")
+#elif __GNUC__
+#define ISA_REGION_BEGIN_AVX2 \
+    _Pragma("GCC push_options") _Pragma("GCC target(\"avx2,fma\")")
+#define ISA_REGION_BEGIN_AVX512 \
+    _Pragma("GCC push_options") \
+    _Pragma("GCC target(\"avx512f,avx512dq,avx512vl,avx2,fma\")")
+#define ISA_REGION_END _Pragma("GCC pop_options")
+#else
+#define ISA_REGION_BEGIN_AVX2
+#define ISA_REGION_BEGIN_AVX512
+#define ISA_REGION_END
+#endif
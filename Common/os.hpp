@@ -53,17 +53,12 @@ inline i64 get_last_os_error()
 struct os_process_state_t {
     pid_t pid;
     usize regular_page_size;
-    char stat_file_name_buf[128];
 };
 
 inline void init_os_process_state(os_process_state_t &st)
 {
     st.pid = getpid();
     st.regular_page_size = usize(getpagesize());
-    snprintf(
-        st.stat_file_name_buf, sizeof(st.stat_file_name_buf),
-        "/proc/%d/stat", st.pid);
-    // @TODO: verify no truncation?
 }
 
 inline bool try_enable_large_pages(os_process_state_t &st)
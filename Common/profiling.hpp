@@ -2,6 +2,7 @@
 
 #include "defs.hpp"
 #include "os.hpp"
+#include "intrinsics.hpp"
 #include "algo.hpp"
 
 #if _WIN32
@@ -42,9 +43,16 @@ inline u64 read_process_page_faults()
     return u64(memory_counters.PageFaultCount);
 }
 
+// No per thread fault count on windows
+inline u64 read_thread_page_faults()
+{
+    return read_process_page_faults();
+}
+
 #else
 
 #include <x86intrin.h>
+#include <sys/resource.h>
 
 inline u64 get_os_timer_freq()
 {
@@ -60,28 +68,25 @@ inline u64 read_os_timer()
     return ts.tv_sec * 1'000'000'000 + ts.tv_nsec;
 }
 
+// Minor faults, as counted for getrusage. Same counter /proc/<pid>/stat
+// shows, but one syscall instead of opening and parsing the file, ~20x
+// cheaper.
 inline u64 read_process_page_faults()
 {
-    FILE *procdata_f = fopen(g_os_proc_state.stat_file_name_buf, "r");
-    if (!procdata_f)
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
         return u64(-1);
-    ulong minor_fault_count;
-
-    {
-        char csink;
-        int isink;
-        uint usink;
-        char ssink[32]; // enough by man
-        int items = fscanf(
-            procdata_f, "%d %s %c %d %d %d %d %d %u %lu", &isink,
-            ssink, &csink, &isink, &isink, &isink, &isink, &isink,
-            &usink, &minor_fault_count);
-        if (items != 10)
-            minor_fault_count = ulong(-1);
-    }
-    fclose(procdata_f);
+    return u64(usage.ru_minflt);
+}
 
-    return minor_fault_count == ulong(-1) ? u64(-1) : u64(minor_fault_count);
+// Faults of the calling thread only, so blocks running on several threads
+// do not count each other's
+inline u64 read_thread_page_faults()
+{
+    rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) != 0)
+        return u64(-1);
+    return u64(usage.ru_minflt);
 }
 
 #endif
@@ -95,9 +100,25 @@ inline u64 read_cpu_timer()
 #define READ_TIMER read_cpu_timer
 #endif
 #ifndef READ_PAGE_FAULT_COUNTER
-#define READ_PAGE_FAULT_COUNTER read_process_page_faults
+#define READ_PAGE_FAULT_COUNTER read_thread_page_faults
 #endif
 
+// Cost of one READ_PAGE_FAULT_COUNTER, which every PF block and timed block
+// of a repetition test pays twice. Best of batches, in cpu timer ticks.
+inline f64 measure_page_fault_counter_overhead()
+{
+    constexpr u32 c_batches = 16;
+    constexpr u32 c_reads_per_batch = 64;
+    u64 best = u64(-1);
+    for (u32 b = 0; b < c_batches; ++b) {
+        u64 const start = READ_TIMER();
+        for (u32 i = 0; i < c_reads_per_batch; ++i)
+            READ_PAGE_FAULT_COUNTER();
+        best = min(best, READ_TIMER() - start);
+    }
+    return f64(best) / f64(c_reads_per_batch);
+}
+
 inline u64 measure_cpu_timer_freq(f64 measure_time_sec)
 {
     u64 os_freq = get_os_timer_freq();
@@ -119,6 +140,178 @@ inline f64 ticks_to_sec(u64 ticks, u64 freq)
     return large_divide(ticks, freq);
 }
 
+#if PROFILER_HWCOUNTERS
+
+// Hardware counters of the calling thread. Every thread opens one
+// perf_event_open group, so all counters cover the same intervals. When the
+// kernel allows it (cap_user_rdpmc on the mapped event page), the counters
+// are read in user mode with rdpmc. Otherwise one read() gets the whole
+// group. Counters the cpu or the kernel refuse read as 0, and are left out
+// of the dump. Only user mode is counted, which perf_event_paranoid 2 (the
+// default) allows.
+
+enum profiler_hw_counter_t : u32 {
+    e_phc_cycles,
+    e_phc_instructions,
+    e_phc_llc_misses,
+    e_phc_branch_misses,
+    e_phc_dtlb_misses,
+
+    e_phc_count
+};
+
+#if _WIN32
+
+struct profiler_hw_group_t {
+    u32 mask; // Counters that opened
+};
+
+inline void open_profiler_hw_group(profiler_hw_group_t &g)
+{
+    g = {};
+}
+
+inline void close_profiler_hw_group(profiler_hw_group_t &g)
+{
+    g = {};
+}
+
+FINLINE void read_profiler_hw_counters(
+    profiler_hw_group_t const &, u64 (&out)[e_phc_count])
+{
+    memset(out, 0, sizeof(out));
+}
+
+#else
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+
+struct profiler_hw_event_t {
+    u32 type;
+    u64 config;
+};
+
+inline constexpr profiler_hw_event_t c_profiler_hw_events[e_phc_count] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    // Last level on the cpus perf knows
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_DTLB |
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+};
+
+struct profiler_hw_group_t {
+    perf_event_mmap_page *pages[e_phc_count];
+    int fds[e_phc_count];
+    u32 group_pos[e_phc_count]; // Index in the group read
+    int leader_fd;
+    u32 mask; // Counters that opened
+    bool rdpmc;
+};
+
+// Counter of the calling thread, any cpu, -1 on failure
+inline int open_perf_event(
+    u32 type, u64 config, int group_fd, u64 read_format = 0)
+{
+    perf_event_attr attr = {};
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.read_format = read_format;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return int(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+
+inline void close_profiler_hw_group(profiler_hw_group_t &g)
+{
+    for (u32 i = 0; i < e_phc_count; ++i) {
+        if (!(g.mask & (1u << i)))
+            continue;
+        if (g.pages[i])
+            munmap(g.pages[i], usize(getpagesize()));
+        close(g.fds[i]);
+    }
+    g = {};
+}
+
+inline void open_profiler_hw_group(profiler_hw_group_t &g)
+{
+    g = {};
+    g.leader_fd = -1;
+    g.rdpmc = true;
+    u32 group_size = 0;
+    for (u32 i = 0; i < e_phc_count; ++i) {
+        int const fd = open_perf_event(
+            c_profiler_hw_events[i].type, c_profiler_hw_events[i].config,
+            g.leader_fd, PERF_FORMAT_GROUP);
+        if (fd < 0)
+            continue;
+
+        if (g.leader_fd < 0)
+            g.leader_fd = fd;
+        g.fds[i] = fd;
+        g.group_pos[i] = group_size++;
+        g.mask |= 1u << i;
+
+        void *page = mmap(
+            nullptr, usize(getpagesize()), PROT_READ, MAP_SHARED, fd, 0);
+        if (page != MAP_FAILED)
+            g.pages[i] = (perf_event_mmap_page *)page;
+        g.rdpmc &= g.pages[i] && g.pages[i]->cap_user_rdpmc;
+    }
+    g.rdpmc &= g.mask != 0;
+}
+
+// The page says which hardware counter holds the event while the thread
+// runs, and the count accumulated before. Retried if the kernel updated it
+// meanwhile.
+FINLINE u64 read_perf_event_rdpmc(perf_event_mmap_page const volatile *pc)
+{
+    u32 seq;
+    u64 cnt;
+    do {
+        seq = pc->lock;
+        i_full_compiler_barrier();
+        u32 const idx = pc->index;
+        cnt = pc->offset;
+        if (idx) {
+            u32 const shift = 64 - pc->pmc_width;
+            cnt += u64((i64(__rdpmc(int(idx - 1))) << shift) >> shift);
+        }
+        i_full_compiler_barrier();
+    } while (pc->lock != seq);
+    return cnt;
+}
+
+FINLINE void read_profiler_hw_counters(
+    profiler_hw_group_t const &g, u64 (&out)[e_phc_count])
+{
+    if (g.rdpmc) {
+        for (u32 i = 0; i < e_phc_count; ++i)
+            out[i] = g.pages[i] ? read_perf_event_rdpmc(g.pages[i]) : 0;
+        return;
+    }
+
+    // Group format: count, then the values in the order the events opened
+    u64 buf[1 + e_phc_count] = {};
+    if (g.mask && read(g.leader_fd, buf, sizeof(buf)) <= 0)
+        buf[0] = 0;
+    for (u32 i = 0; i < e_phc_count; ++i) {
+        out[i] = (g.mask & (1u << i)) && g.group_pos[i] < buf[0] ?
+            buf[1 + g.group_pos[i]] : 0;
+    }
+}
+
+#endif
+
+#endif
+
 struct profiler_slot_t {
     u64 inclusive_ticks = 0;
     u64 exclusive_ticks = 0;
@@ -127,109 +320,716 @@ struct profiler_slot_t {
     u64 exclusive_pagefaults = 0;
 #endif
     u64 bytes_processed = 0;
+#if PROFILER_HWCOUNTERS
+    u64 inclusive_hw[e_phc_count] = {};
+#endif
     char const *name = nullptr;
     u32 hit_count = 0;
+    // Edge of the last entry and the edge it was under, a block is mostly
+    // entered from the same place as last time, which skips the lookup
+    struct profiler_edge_t *last_edge = nullptr;
+    struct profiler_edge_t *last_parent_edge = nullptr;
+};
+
+inline constexpr usize c_profiler_slots_count = 4096;
+inline constexpr u32 c_profiler_edges_bits = 13;
+inline constexpr u32 c_profiler_edges_count = 1u << c_profiler_edges_bits;
+inline constexpr u32 c_profiler_max_threads = 256;
+inline constexpr u32 c_profiler_thread_name_len = 32;
+
+// Every thread profiles into its own tables, so blocks need no
+// synchronization. Tables are registered on the first profiled block of a
+// thread (or explicitly, to give it a name), one per thread for the whole
+// run, and merged when the stats are dumped, which must happen after the
+// other threads are done. Threads past c_profiler_max_threads are not
+// profiled, only counted. Blocks only account into call tree edges, per
+// slot stats are summed from them at dump time. Every top level block
+// subtracts itself from the exclusive time of the root edge, so minus that
+// is the profiled time of the thread.
+// Blocks count the page faults of their own thread (per process on
+// windows), the total they are a percentage of is the process's.
+//
+// Call tree edge, a block (child slot) entered directly inside another,
+// which is itself identified by the edge it was entered through (parent,
+// table index + 1, 0 for top level). Keying by the parent edge instead of
+// the parent slot makes every edge one call path, so the tree never mixes
+// the children of one block called from two places. Slots say where the
+// time goes, edges say from where. Kept in an open addressing table, the key
+// is usually found on the first probe.
+struct profiler_edge_t {
+    u64 inclusive_ticks;
+    u64 exclusive_ticks;
+#if PROFILER_PAGEFAULTS
+    u64 inclusive_pagefaults;
+    u64 exclusive_pagefaults;
+#endif
+    u64 bytes_processed;
+#if PROFILER_HWCOUNTERS
+    u64 inclusive_hw[e_phc_count];
+#endif
+    char const *name; // Of the child
+    u32 parent;
+    u32 child; // 0 for a free entry
+    u32 hit_count;
+};
+
+#if PROFILER_TRACE
+
+// Timeline of blocks for trace viewers. A block is one complete event
+// written on exit from the two timer reads it takes anyway, into a ring per
+// thread allocated with the thread tables, so the hot path only adds the
+// stores. When a ring wraps the oldest blocks are lost.
+#ifndef PROFILER_TRACE_EVENTS
+#define PROFILER_TRACE_EVENTS (1u << 17)
+#endif
+
+inline constexpr u64 c_profiler_trace_events = PROFILER_TRACE_EVENTS;
+static_assert(
+    (c_profiler_trace_events & (c_profiler_trace_events - 1)) == 0,
+    "Trace ring size must be a power of 2");
+
+struct profiler_trace_event_t {
+    u64 start_ticks;
+    u64 duration_ticks;
+    u64 bytes_processed;
+    char const *name;
+};
+
+#endif
+
+struct profiler_thread_t {
+    profiler_slot_t slots[c_profiler_slots_count];
+    profiler_edge_t edges[c_profiler_edges_count];
+    // Parent of top level edges, and the sink for edges past the table
+    profiler_edge_t root_edge;
+    profiler_edge_t *current_edge;
+    char name[c_profiler_thread_name_len];
+#if PROFILER_HWCOUNTERS
+    profiler_hw_group_t hw_group;
+#endif
+#if PROFILER_TRACE
+    u64 trace_event_cnt; // Total written, the ring keeps the last ones
+    profiler_trace_event_t trace[c_profiler_trace_events];
+#endif
+};
+
+// Aggregate over threads, with the spread of inclusive time between the
+// threads that hit the slot
+struct profiler_merged_slot_t {
+    profiler_slot_t total;
+    u64 max_thread_inclusive_ticks;
+    u32 thread_cnt;
 };
 
 inline struct profiler_t {
-    profiler_slot_t slots[4096] = {};
+    profiler_thread_t *threads[c_profiler_max_threads] = {};
+    u32 volatile thread_cnt = 0; // Registrations, can run past the limit
+    u32 volatile unprofiled_thread_cnt = 0; // Over the limit or out of memory
+    u32 volatile slot_cnt = 0; // Handed out to block sites, 0 is the root
+    profiler_merged_slot_t merged[c_profiler_slots_count] = {};
+    profiler_edge_t merged_edges[c_profiler_edges_count] = {};
+    u32 merge_map[c_profiler_edges_count + 1] = {};
     u64 start_ticks = 0;
     u64 end_ticks = 0;
 #if PROFILER_PAGEFAULTS
     u64 start_pagefaults = 0;
     u64 end_pagefaults = 0;
 #endif
-    profiler_slot_t *current_slot = &slots[0];
+#if PROFILER_HWCOUNTERS
+    u32 hw_counter_mask = 0; // Counters that opened on any thread
+#endif
+    char const *trace_fn = nullptr; // Written at dump if set
 } g_profiler{};
 
-inline constexpr usize c_profiler_slots_count =
-    sizeof(g_profiler.slots) / sizeof(g_profiler.slots[0]);
+inline thread_local profiler_thread_t *t_profiler_thread = nullptr;
+inline thread_local bool t_profiler_thread_unprofiled = false;
+
+#if PROFILER_HWCOUNTERS
+
+// Threads come and go with every parallel run, so their counters are
+// closed as they exit. The counts are in their tables by then.
+struct profiler_thread_exit_t {
+    ~profiler_thread_exit_t() {
+        if (profiler_thread_t *pt = t_profiler_thread)
+            close_profiler_hw_group(pt->hw_group);
+    }
+};
+
+inline thread_local profiler_thread_exit_t t_profiler_thread_exit;
+
+#endif
+
+// Null for threads over c_profiler_max_threads (or if the table fails to
+// allocate), their blocks are not profiled
+inline profiler_thread_t *register_profiler_thread(char const *name = nullptr)
+{
+    profiler_thread_t *pt = t_profiler_thread;
+    if (!pt) {
+        if (t_profiler_thread_unprofiled)
+            return nullptr;
+
+        u32 const id = i_atomic_inc_u32(g_profiler.thread_cnt) - 1;
+        if (id < c_profiler_max_threads) {
+            // Zeroed is the empty state of slots. Never freed, the tables
+            // are read at exit after their threads are gone.
+            pt = (profiler_thread_t *)calloc(1, sizeof(profiler_thread_t));
+        }
+        if (!pt) {
+            t_profiler_thread_unprofiled = true;
+            i_atomic_inc_u32(g_profiler.unprofiled_thread_cnt);
+            return nullptr;
+        }
+
+        pt->current_edge = &pt->root_edge;
+        snprintf(pt->name, c_profiler_thread_name_len, "thread %u", id);
+#if PROFILER_HWCOUNTERS
+        open_profiler_hw_group(pt->hw_group);
+        (void)&t_profiler_thread_exit; // Constructs it for this thread
+#endif
+        g_profiler.threads[id] = pt;
+        t_profiler_thread = pt;
+    }
+
+    if (name)
+        snprintf(pt->name, c_profiler_thread_name_len, "%s", name);
+    return pt;
+}
+
+FINLINE profiler_thread_t *get_profiler_thread()
+{
+    profiler_thread_t *pt = t_profiler_thread;
+    return pt ? pt : register_profiler_thread();
+}
+
+// Slot indices are handed out program wide on the first hit of each block
+// site and cached in a static at the site, so every translation unit gets
+// its own slots and a hit after the first costs a load and a branch. Sites
+// past the table all share the last slot.
+inline u32 register_profiler_slot(u32 volatile &site_slot)
+{
+    u32 const id = min(
+        i_atomic_inc_u32(g_profiler.slot_cnt), u32(c_profiler_slots_count - 1));
+    // Another thread may have registered the site meanwhile, keep its id.
+    // The index taken here is then never used.
+    u32 const prev = i_atomic_cas_u32(site_slot, 0, id);
+    return prev ? prev : id;
+}
+
+FINLINE u32 get_profiler_slot(u32 volatile &site_slot)
+{
+    u32 const id = site_slot;
+    return id ? id : register_profiler_slot(site_slot);
+}
+
+// Entry for the pair, claims a free one if new. Null if the table is full.
+FINLINE profiler_edge_t *find_profiler_edge(
+    profiler_edge_t *edges, u32 parent, u32 child)
+{
+    u32 const key = (parent << 16) ^ child;
+    u32 const h = (key * 0x9E3779B1u) >> (32 - c_profiler_edges_bits);
+    for (u32 probe = 0; probe < c_profiler_edges_count; ++probe) {
+        profiler_edge_t &e = edges[(h + probe) & (c_profiler_edges_count - 1)];
+        if (e.child == child && e.parent == parent)
+            return &e;
+        if (e.child == 0) {
+            e.parent = parent;
+            e.child = child;
+            return &e;
+        }
+    }
+    return nullptr;
+}
 
 inline void init_profiler()
 {
+    profiler_thread_t *pt = register_profiler_thread("main");
+    assert(pt);
+#if PROFILER_HWCOUNTERS
+    if (pt->hw_group.mask != (1u << e_phc_count) - 1) {
+        fprintf(stderr,
+            "Some hardware counters are not available (mask 0x%x), "
+            "check perf_event_paranoid and the cpu's pmu\n",
+            pt->hw_group.mask);
+    }
+#else
+    (void)pt;
+#endif
 #if PROFILER_PAGEFAULTS
-    g_profiler.start_pagefaults = READ_PAGE_FAULT_COUNTER();
+    g_profiler.start_pagefaults = read_process_page_faults();
 #endif
     g_profiler.start_ticks = READ_TIMER();
 }
 
+// False if built without PROFILER_TRACE, there is nothing to write then
+inline bool enable_profiler_trace(char const *fn)
+{
+#if PROFILER && PROFILER_TRACE
+    g_profiler.trace_fn = fn;
+    return true;
+#else
+    (void)fn;
+    return false;
+#endif
+}
+
+#if PROFILER_TRACE
+
+inline void write_profiler_trace_string(FILE *f, char const *str)
+{
+    fputc('"', f);
+    for (char const *c = str; *c; ++c) {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', f);
+        if (u8(*c) >= 0x20)
+            fputc(*c, f);
+    }
+    fputc('"', f);
+}
+
+// Chrome trace event json, which chrome://tracing and ui.perfetto.dev both
+// open. Timestamps are microseconds from init_profiler.
+inline bool write_profiler_trace(char const *fn, u64 cpu_timer_freq)
+{
+    FILE *f = fopen(fn, "w");
+    if (!f) {
+        fprintf(stderr, "Failed to open trace file '%s'\n", fn);
+        return false;
+    }
+
+    f64 const us_per_tick = 1e6 / f64(cpu_timer_freq);
+    u32 const thread_cnt = min(g_profiler.thread_cnt, c_profiler_max_threads);
+    u64 dropped = 0;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+        "\"tid\":0,\"args\":{\"name\":\"profile\"}}");
+    for (u32 t = 0; t < thread_cnt; ++t) {
+        profiler_thread_t const *pt = g_profiler.threads[t];
+        if (!pt)
+            continue;
+
+        fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"tid\":%u,\"args\":{\"name\":", t);
+        write_profiler_trace_string(f, pt->name);
+        fprintf(f, "}}");
+
+        u64 const cnt = min(pt->trace_event_cnt, c_profiler_trace_events);
+        dropped += pt->trace_event_cnt - cnt;
+        for (u64 i = pt->trace_event_cnt - cnt; i < pt->trace_event_cnt; ++i) {
+            profiler_trace_event_t const &e =
+                pt->trace[i & (c_profiler_trace_events - 1)];
+            fprintf(f, ",\n{\"name\":");
+            write_profiler_trace_string(f, e.name);
+            fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                "\"ts\":%.3lf,\"dur\":%.3lf", t,
+                f64(i64(e.start_ticks - g_profiler.start_ticks)) * us_per_tick,
+                f64(e.duration_ticks) * us_per_tick);
+            if (e.bytes_processed > 0) {
+                fprintf(f, ",\"args\":{\"bytes\":%llu}",
+                    (unsigned long long)e.bytes_processed);
+            }
+            fprintf(f, "}");
+        }
+    }
+    fprintf(f, "\n]}\n");
+
+    if (fclose(f) != 0) {
+        fprintf(stderr, "Failed to write trace file '%s'\n", fn);
+        return false;
+    }
+    if (dropped > 0) {
+        fprintf(stderr, "Trace: %llu oldest blocks did not fit the rings\n",
+            (unsigned long long)dropped);
+    }
+    return true;
+}
+
+#endif
+
+// Flat per slot stats of a thread from its edges. Inclusive time only
+// counts the outermost entries of a slot, recursive ones are in them.
+inline void derive_profiler_thread_slots(profiler_thread_t &pt)
+{
+    for (profiler_slot_t &slot : pt.slots)
+        slot = {};
+
+    for (profiler_edge_t const &e : pt.edges) {
+        if (e.child == 0)
+            continue;
+        profiler_slot_t &slot = pt.slots[e.child];
+        slot.name = e.name;
+        slot.hit_count += e.hit_count;
+        slot.bytes_processed += e.bytes_processed;
+        slot.exclusive_ticks += e.exclusive_ticks;
+#if PROFILER_PAGEFAULTS
+        slot.exclusive_pagefaults += e.exclusive_pagefaults;
+#endif
+
+        bool outermost = true;
+        for (u32 p = e.parent; p && outermost; p = pt.edges[p - 1].parent)
+            outermost = pt.edges[p - 1].child != e.child;
+        if (outermost) {
+            slot.inclusive_ticks += e.inclusive_ticks;
+#if PROFILER_PAGEFAULTS
+            slot.inclusive_pagefaults += e.inclusive_pagefaults;
+#endif
+#if PROFILER_HWCOUNTERS
+            for (u32 c = 0; c < e_phc_count; ++c)
+                slot.inclusive_hw[c] += e.inclusive_hw[c];
+#endif
+        }
+    }
+}
+
+inline void merge_profiler_threads()
+{
+    u32 const thread_cnt = min(g_profiler.thread_cnt, c_profiler_max_threads);
+    for (u32 t = 0; t < thread_cnt; ++t) {
+        if (!g_profiler.threads[t])
+            continue;
+        derive_profiler_thread_slots(*g_profiler.threads[t]);
+#if PROFILER_HWCOUNTERS
+        g_profiler.hw_counter_mask |= g_profiler.threads[t]->hw_group.mask;
+#endif
+    }
+
+    for (usize i = 0; i < c_profiler_slots_count; ++i) {
+        profiler_merged_slot_t &m = g_profiler.merged[i];
+        m = {};
+        for (u32 t = 0; t < thread_cnt; ++t) {
+            profiler_thread_t const *pt = g_profiler.threads[t];
+            if (!pt || !pt->slots[i].name)
+                continue;
+            profiler_slot_t const &slot = pt->slots[i];
+            m.total.name = slot.name;
+            m.total.inclusive_ticks += slot.inclusive_ticks;
+            m.total.exclusive_ticks += slot.exclusive_ticks;
+#if PROFILER_PAGEFAULTS
+            m.total.inclusive_pagefaults += slot.inclusive_pagefaults;
+            m.total.exclusive_pagefaults += slot.exclusive_pagefaults;
+#endif
+            m.total.bytes_processed += slot.bytes_processed;
+#if PROFILER_HWCOUNTERS
+            for (u32 c = 0; c < e_phc_count; ++c)
+                m.total.inclusive_hw[c] += slot.inclusive_hw[c];
+#endif
+            m.total.hit_count += slot.hit_count;
+            m.max_thread_inclusive_ticks =
+                max(m.max_thread_inclusive_ticks, slot.inclusive_ticks);
+            ++m.thread_cnt;
+        }
+    }
+
+    // Parents are thread table indices, so edges are mapped parents first:
+    // each pass maps the edges whose parent got mapped, as many passes as
+    // the tree is deep
+    memset(g_profiler.merged_edges, 0, sizeof(g_profiler.merged_edges));
+    for (u32 t = 0; t < thread_cnt; ++t) {
+        profiler_thread_t const *pt = g_profiler.threads[t];
+        if (!pt)
+            continue;
+
+        u32 *merged_ids = g_profiler.merge_map; // Thread edge id -> merged
+        memset(merged_ids, 0, sizeof(g_profiler.merge_map));
+        for (bool progress = true; progress;) {
+            progress = false;
+            for (u32 i = 0; i < c_profiler_edges_count; ++i) {
+                profiler_edge_t const &e = pt->edges[i];
+                if (e.child == 0 || merged_ids[i + 1] ||
+                    (e.parent && !merged_ids[e.parent]))
+                {
+                    continue;
+                }
+                if (e.parent && merged_ids[e.parent] == u32(-1)) {
+                    merged_ids[i + 1] = u32(-1);
+                    continue;
+                }
+                u32 const parent = e.parent ? merged_ids[e.parent] : 0;
+                profiler_edge_t *m = find_profiler_edge(
+                    g_profiler.merged_edges, parent, e.child);
+                // Merged table full, drop the subtree
+                merged_ids[i + 1] = m ?
+                    u32(m - g_profiler.merged_edges) + 1 : u32(-1);
+                progress = true;
+                if (!m)
+                    continue;
+                m->name = e.name;
+                m->inclusive_ticks += e.inclusive_ticks;
+                m->exclusive_ticks += e.exclusive_ticks;
+#if PROFILER_PAGEFAULTS
+                m->inclusive_pagefaults += e.inclusive_pagefaults;
+                m->exclusive_pagefaults += e.exclusive_pagefaults;
+#endif
+                m->bytes_processed += e.bytes_processed;
+#if PROFILER_HWCOUNTERS
+                for (u32 c = 0; c < e_phc_count; ++c)
+                    m->inclusive_hw[c] += e.inclusive_hw[c];
+#endif
+                m->hit_count += e.hit_count;
+            }
+        }
+    }
+}
+
+inline constexpr u32 c_profiler_max_tree_depth = 64;
+
+// Children of the parent edge, most inclusive first, with their share of it
+template <class TPrinter>
+inline void print_profiler_call_tree(
+    TPrinter &printer, u32 parent, u64 parent_ticks, u32 depth,
+    u64 cpu_timer_freq, f64 total_sec)
+{
+    profiler_edge_t const *edges = g_profiler.merged_edges;
+
+    // Selection by "next below the last printed", child counts are small
+    u64 last_ticks = u64(-1);
+    u32 last_idx = u32(-1);
+    for (;;) {
+        u32 next = u32(-1);
+        for (u32 i = 0; i < c_profiler_edges_count; ++i) {
+            profiler_edge_t const &e = edges[i];
+            if (e.child == 0 || e.parent != parent)
+                continue;
+            bool const below_last = e.inclusive_ticks < last_ticks ||
+                (e.inclusive_ticks == last_ticks && i > last_idx);
+            if (below_last &&
+                (next == u32(-1) ||
+                 e.inclusive_ticks > edges[next].inclusive_ticks))
+            {
+                next = i;
+            }
+        }
+        if (next == u32(-1))
+            return;
+        last_ticks = edges[next].inclusive_ticks;
+        last_idx = next;
+
+        profiler_edge_t const &e = edges[next];
+        f64 const inclusive_sec =
+            ticks_to_sec(e.inclusive_ticks, cpu_timer_freq);
+        f64 const exclusive_sec =
+            ticks_to_sec(e.exclusive_ticks, cpu_timer_freq);
+        printer("%*s%s[%u]: %lfs (%.1lf%% of parent, %.1lf%%) inc, "
+            "%lfs exc",
+            int(2 * depth + 2), "", e.name, e.hit_count, inclusive_sec,
+            100.0 * f64(e.inclusive_ticks) / f64(parent_ticks),
+            100.0 * inclusive_sec / total_sec, exclusive_sec);
+        if (e.bytes_processed > 0) {
+            printer(", %.3lfmb",
+                large_divide(e.bytes_processed, u64(1) << 20));
+        }
+#if PROFILER_PAGEFAULTS
+        if (e.inclusive_pagefaults > 0)
+            printer(", %llu pfaults", e.inclusive_pagefaults);
+#endif
+        printer("\n");
+
+        if (depth + 1 < c_profiler_max_tree_depth) {
+            print_profiler_call_tree(printer, next + 1,
+                max(e.inclusive_ticks, u64(1)), depth + 1,
+                cpu_timer_freq, total_sec);
+        }
+    }
+}
+
+#if PROFILER_HWCOUNTERS
+
+// Misses are per kb of the block's bytes, or per thousand instructions for
+// blocks that process none. The branch miss rate is always per thousand
+// instructions, branches themselves are not counted to keep the group
+// small enough to be scheduled whole.
+template <class TPrinter>
+inline void print_profiler_hw_counters(
+    TPrinter &printer, profiler_slot_t const &slot)
+{
+    u32 const mask = g_profiler.hw_counter_mask;
+    u64 const *hw = slot.inclusive_hw;
+    auto has = [mask](profiler_hw_counter_t c) {
+        return (mask & (1u << c)) != 0;
+    };
+
+    if (has(e_phc_cycles) && has(e_phc_instructions) && hw[e_phc_cycles]) {
+        printer(", ipc %.2lf",
+            f64(hw[e_phc_instructions]) / f64(hw[e_phc_cycles]));
+    }
+
+    f64 const kinstr = f64(hw[e_phc_instructions]) / 1000.0;
+    f64 const kb = f64(slot.bytes_processed) / 1024.0;
+    bool const per_kb = slot.bytes_processed > 0;
+    if (!per_kb && (!has(e_phc_instructions) || kinstr == 0.0))
+        return;
+
+    f64 const unit = per_kb ? kb : kinstr;
+    char const *unit_name = per_kb ? "kb" : "ki";
+    if (has(e_phc_llc_misses)) {
+        printer(", llc miss %.3lf/%s",
+            f64(hw[e_phc_llc_misses]) / unit, unit_name);
+    }
+    if (has(e_phc_dtlb_misses)) {
+        printer(", dtlb miss %.3lf/%s",
+            f64(hw[e_phc_dtlb_misses]) / unit, unit_name);
+    }
+    if (has(e_phc_branch_misses) && has(e_phc_instructions) && kinstr > 0.0) {
+        printer(", br miss %.3lf/ki",
+            f64(hw[e_phc_branch_misses]) / kinstr);
+    }
+}
+
+#endif
+
+template <class TPrinter>
+inline void print_profiler_slot(
+    TPrinter &printer, profiler_slot_t const &slot,
+    u64 cpu_timer_freq, f64 total_sec)
+{
+    f64 const inclusive_sec =
+        ticks_to_sec(slot.inclusive_ticks, cpu_timer_freq);
+    f64 const exclusive_sec =
+        ticks_to_sec(slot.exclusive_ticks, cpu_timer_freq);
+
+    if (abs(inclusive_sec - exclusive_sec) < DBL_EPSILON) {
+        printer("%s[%u]: %lfs (%.1lf%%)",
+            slot.name, slot.hit_count,
+            inclusive_sec, 100.0 * inclusive_sec / total_sec);
+    } else {
+        printer("%s[%u]: %lfs (%.1lf%%) inc, %lfs (%.1lf%%) exc",
+            slot.name, slot.hit_count,
+            inclusive_sec, 100.0 * inclusive_sec / total_sec,
+            exclusive_sec, 100.0 * exclusive_sec / total_sec);
+    }
+
+    if (slot.bytes_processed > 0) {
+        constexpr u64 c_bytes_in_mb = 1u << 20;
+        constexpr u64 c_bytes_in_gb = 1u << 30;
+        f64 const mb = large_divide(slot.bytes_processed, c_bytes_in_mb); 
+        f64 const gb = large_divide(slot.bytes_processed, c_bytes_in_gb); 
+        f64 const gb_per_sec = gb / inclusive_sec;
+
+        printer(", %.3lfmb (%.2lfgb/s)", mb, gb_per_sec);
+    }
+
+#if PROFILER_HWCOUNTERS
+    print_profiler_hw_counters(printer, slot);
+#endif
+
+#if PROFILER_PAGEFAULTS
+    u64 const total_pagefaults =
+        g_profiler.end_pagefaults - g_profiler.start_pagefaults;
+    if (slot.inclusive_pagefaults == 0) {
+    } else if (slot.inclusive_pagefaults == slot.exclusive_pagefaults) {
+        printer(", %llu pfaults (%.1lf%%)",
+            slot.inclusive_pagefaults,
+            100.0 * slot.inclusive_pagefaults / total_pagefaults);
+    } else {
+        printer(", %llu pfaults inc (%.1lf%%), %llu pfaults exc (%.1lf%%)",
+            slot.inclusive_pagefaults,
+            100.0 * slot.inclusive_pagefaults / total_pagefaults,
+            slot.exclusive_pagefaults,
+            100.0 * slot.exclusive_pagefaults / total_pagefaults);
+    }
+#endif
+}
+
+// Slots are summed over threads, so with several threads percentages are
+// of thread time over wall time and can go past 100. Imbalance is the
+// slowest thread over the mean of the threads that hit the slot.
 template <class TPrinter>
 inline void finish_profiling_and_dump_stats(TPrinter &&printer)
 {
     g_profiler.end_ticks = READ_TIMER();
 #if PROFILER_PAGEFAULTS
-    g_profiler.end_pagefaults = READ_PAGE_FAULT_COUNTER();
+    g_profiler.end_pagefaults = read_process_page_faults();
 #endif
 
     u64 const cpu_timer_freq = measure_cpu_timer_freq(0.1l);
     f64 const total_sec = ticks_to_sec(
         g_profiler.end_ticks - g_profiler.start_ticks, cpu_timer_freq);
 
+    merge_profiler_threads();
+    u32 const thread_cnt = min(g_profiler.thread_cnt, c_profiler_max_threads);
+
+#if PROFILER_TRACE
+    if (g_profiler.trace_fn)
+        write_profiler_trace(g_profiler.trace_fn, cpu_timer_freq);
+#endif
+
     insertion_sort(
-        &g_profiler.slots[0],
-        &g_profiler.slots[c_profiler_slots_count],
-        [](profiler_slot_t const &s1, profiler_slot_t const &s2) {
+        &g_profiler.merged[0],
+        &g_profiler.merged[c_profiler_slots_count],
+        [](profiler_merged_slot_t const &s1, profiler_merged_slot_t const &s2) {
             // Decreasing order with empty slots pushed to end
             return
-                s1.name &&
-                (!s2.name || s1.inclusive_ticks > s2.inclusive_ticks);
+                s1.total.name &&
+                (!s2.total.name ||
+                 s1.total.inclusive_ticks > s2.total.inclusive_ticks);
         });
 
     printer("Profile:\n");
     for (usize i = 0; i < c_profiler_slots_count; ++i) {
-        auto const &slot = g_profiler.slots[i];
+        auto const &m = g_profiler.merged[i];
 
-        if (!slot.name)
+        if (!m.total.name)
             continue;
 
-        f64 const inclusive_sec =
-            ticks_to_sec(slot.inclusive_ticks, cpu_timer_freq);
-        f64 const exclusive_sec =
-            ticks_to_sec(slot.exclusive_ticks, cpu_timer_freq);
-
-        if (abs(inclusive_sec - exclusive_sec) < DBL_EPSILON) {
-            printer("%s[%u]: %lfs (%.1lf%%)",
-                slot.name, slot.hit_count,
-                inclusive_sec, 100.0 * inclusive_sec / total_sec);
-        } else {
-            printer("%s[%u]: %lfs (%.1lf%%) inc, %lfs (%.1lf%%) exc",
-                slot.name, slot.hit_count,
-                inclusive_sec, 100.0 * inclusive_sec / total_sec,
-                exclusive_sec, 100.0 * exclusive_sec / total_sec);
+        print_profiler_slot(printer, m.total, cpu_timer_freq, total_sec);
+        if (m.thread_cnt > 1) {
+            f64 const mean_ticks =
+                f64(m.total.inclusive_ticks) / f64(m.thread_cnt);
+            printer(", %u threads, imbalance x%.2lf",
+                m.thread_cnt, f64(m.max_thread_inclusive_ticks) / mean_ticks);
         }
 
-        if (slot.bytes_processed > 0) {
-            constexpr u64 c_bytes_in_mb = 1u << 20;
-            constexpr u64 c_bytes_in_gb = 1u << 30;
-            f64 const mb = large_divide(slot.bytes_processed, c_bytes_in_mb); 
-            f64 const gb = large_divide(slot.bytes_processed, c_bytes_in_gb); 
-            f64 const gb_per_sec = gb / inclusive_sec;
+        printer("\n");
+    }
+
+    printer("Call tree:\n");
+    print_profiler_call_tree(printer, 0,
+        max(g_profiler.end_ticks - g_profiler.start_ticks, u64(1)), 0,
+        cpu_timer_freq, total_sec);
+
+    if (thread_cnt > 1) {
+        for (u32 t = 0; t < thread_cnt; ++t) {
+            profiler_thread_t *pt = g_profiler.threads[t];
+            if (!pt)
+                continue;
 
-            printer(", %.3lfmb (%.2lfgb/s)", mb, gb_per_sec);
+            u64 const profiled_ticks = u64(0) - pt->root_edge.exclusive_ticks;
+            printer("Thread '%s': %lfs profiled\n",
+                pt->name, ticks_to_sec(profiled_ticks, cpu_timer_freq));
+
+            // Merged already, the table can be reordered
+            insertion_sort(
+                &pt->slots[0], &pt->slots[c_profiler_slots_count],
+                [](profiler_slot_t const &s1, profiler_slot_t const &s2) {
+                    return
+                        s1.name &&
+                        (!s2.name || s1.inclusive_ticks > s2.inclusive_ticks);
+                });
+            for (usize i = 0; i < c_profiler_slots_count; ++i) {
+                if (!pt->slots[i].name)
+                    continue;
+                printer("  ");
+                print_profiler_slot(
+                    printer, pt->slots[i], cpu_timer_freq, total_sec);
+                printer("\n");
+            }
         }
+    }
+    if (g_profiler.unprofiled_thread_cnt) {
+        printer("%u threads past the first %u not profiled\n",
+            g_profiler.unprofiled_thread_cnt, c_profiler_max_threads);
+    }
 
 #if PROFILER_PAGEFAULTS
-        u64 const total_pagefaults =
-            g_profiler.end_pagefaults - g_profiler.start_pagefaults;
-        if (slot.inclusive_pagefaults == 0) {
-        } else if (slot.inclusive_pagefaults == slot.exclusive_pagefaults) {
-            printer(", %llu pfaults (%.1lf%%)",
-                slot.inclusive_pagefaults,
-                100.0 * slot.inclusive_pagefaults / total_pagefaults);
-        } else {
-            printer(", %llu pfaults inc (%.1lf%%), %llu pfaults exc (%.1lf%%)",
-                slot.inclusive_pagefaults,slot.exclusive_pagefaults,
-                100.0 * slot.inclusive_pagefaults / total_pagefaults,
-                100.0 * slot.exclusive_pagefaults / total_pagefaults);
-        }
+    f64 const pf_read_ticks = measure_page_fault_counter_overhead();
+    printer("Page faults: %llu, counter read: %.0lf ticks (%.3lfus)\n",
+        g_profiler.end_pagefaults - g_profiler.start_pagefaults,
+        pf_read_ticks, 1e6 * pf_read_ticks / f64(cpu_timer_freq));
 #endif
-
-        printer("\n");
-    }
     printer("Total: %lfs\n", total_sec);
 }
 
-template <u32 t_slot, bool t_pagefaults>
+template <bool t_pagefaults>
 class ScopedProfile {
     u64 m_ref_ticks;
     u64 m_inclusive_snapshot;
@@ -237,28 +1037,69 @@ class ScopedProfile {
     u64 m_ref_pagefaults;
     u64 m_inclusive_pf_snapshot;
 #endif
-    profiler_slot_t *m_parent;
+    profiler_thread_t *m_thread;
+    profiler_edge_t *m_edge;
+    profiler_edge_t *m_parent;
+#if PROFILER_HWCOUNTERS
+    u64 m_ref_hw[e_phc_count];
+    u64 m_inclusive_hw_snapshot[e_phc_count];
+#endif
+#if PROFILER_TRACE
+    u64 m_bytes;
+#endif
 
 public:
-    ScopedProfile(char const *name, u64 bytes = 0) {
-        auto &slot = g_profiler.slots[t_slot];
+    ScopedProfile(u32 slot_id, char const *name, u64 bytes = 0) {
+        m_thread = get_profiler_thread();
+        if (!m_thread)
+            return; // Not profiled
+        m_parent = m_thread->current_edge;
 
-        slot.name = name;
-        ++slot.hit_count;
-        slot.bytes_processed += bytes;
-        m_parent = xchg(g_profiler.current_slot, &g_profiler.slots[t_slot]);
+        auto &slot = m_thread->slots[slot_id];
+        if (slot.last_parent_edge == m_parent) {
+            m_edge = slot.last_edge;
+        } else {
+            u32 const parent_id = m_parent == &m_thread->root_edge ?
+                0 : u32(m_parent - m_thread->edges) + 1;
+            m_edge = find_profiler_edge(m_thread->edges, parent_id, slot_id);
+            if (!m_edge)
+                m_edge = &m_thread->root_edge;
+            slot.last_edge = m_edge;
+            slot.last_parent_edge = m_parent;
+        }
+
+        auto &edge = *m_edge;
+        edge.name = name;
+        ++edge.hit_count;
+        edge.bytes_processed += bytes;
+        m_thread->current_edge = &edge;
+#if PROFILER_TRACE
+        m_bytes = bytes;
+#endif
 
 #if PROFILER_PAGEFAULTS
         if constexpr (t_pagefaults) {
-            m_inclusive_pf_snapshot = slot.inclusive_pagefaults;
+            m_inclusive_pf_snapshot = edge.inclusive_pagefaults;
             m_ref_pagefaults = READ_PAGE_FAULT_COUNTER();
         }
 #endif
-        m_inclusive_snapshot = slot.inclusive_ticks;
+#if PROFILER_HWCOUNTERS
+        memcpy(m_inclusive_hw_snapshot, edge.inclusive_hw,
+            sizeof(m_inclusive_hw_snapshot));
+        read_profiler_hw_counters(m_thread->hw_group, m_ref_hw);
+#endif
+        m_inclusive_snapshot = edge.inclusive_ticks;
         m_ref_ticks = READ_TIMER();
     }
     ~ScopedProfile() {
+        if (!m_thread)
+            return;
         u64 delta_ticks = READ_TIMER() - m_ref_ticks;
+#if PROFILER_TRACE
+        profiler_trace_event_t &ev = m_thread->trace[
+            m_thread->trace_event_cnt++ & (c_profiler_trace_events - 1)];
+        ev = {m_ref_ticks, delta_ticks, m_bytes, m_edge->name};
+#endif
 #if PROFILER_PAGEFAULTS
         u64 delta_pagefaults = 0;
         if constexpr (t_pagefaults) {
@@ -266,24 +1107,35 @@ public:
                 READ_PAGE_FAULT_COUNTER() - m_ref_pagefaults;
         }
 #endif
+#if PROFILER_HWCOUNTERS
+        u64 hw[e_phc_count];
+        read_profiler_hw_counters(m_thread->hw_group, hw);
+#endif
 
-        auto &slot = g_profiler.slots[t_slot];
+        auto &edge = *m_edge;
 
-        slot.exclusive_ticks += delta_ticks;
+        edge.exclusive_ticks += delta_ticks;
         m_parent->exclusive_ticks -= delta_ticks;
 
-        slot.inclusive_ticks = m_inclusive_snapshot + delta_ticks;
+        edge.inclusive_ticks = m_inclusive_snapshot + delta_ticks;
 
 #if PROFILER_PAGEFAULTS
         if constexpr (t_pagefaults) {
-            slot.exclusive_pagefaults += delta_pagefaults;
+            edge.exclusive_pagefaults += delta_pagefaults;
             m_parent->exclusive_pagefaults -= delta_pagefaults;
-            slot.inclusive_pagefaults =
+            edge.inclusive_pagefaults =
                 m_inclusive_pf_snapshot + delta_pagefaults;
         }
 #endif
 
-        g_profiler.current_slot = m_parent;
+#if PROFILER_HWCOUNTERS
+        for (u32 c = 0; c < e_phc_count; ++c) {
+            edge.inclusive_hw[c] =
+                m_inclusive_hw_snapshot[c] + (hw[c] - m_ref_hw[c]);
+        }
+#endif
+
+        m_thread->current_edge = m_parent;
     }
 
     ScopedProfile(ScopedProfile const &) = delete;
@@ -292,29 +1144,26 @@ public:
     ScopedProfile& operator=(ScopedProfile &&) = delete;
 };
 
-// @TODO: figure out a cross-translation unit decision for fast indexing
-
 #if PROFILER
 
-#define PROFILED_BLOCK(name_)             \
-    ScopedProfile<__COUNTER__ + 1, false> \
-    CAT(profiled_block__, __LINE__){name_}
+#define PROFILED_SCOPE_(pagefaults_, name_, bytes_)                    \
+    static u32 volatile CAT(profiled_slot__, __LINE__) = 0;            \
+    ScopedProfile<pagefaults_> CAT(profiled_block__, __LINE__){        \
+        get_profiler_slot(CAT(profiled_slot__, __LINE__)), name_, bytes_}
+
+#define PROFILED_BLOCK(name_) PROFILED_SCOPE_(false, name_, 0)
 #define PROFILED_FUNCTION PROFILED_BLOCK(__FUNCTION__)
 
 #define PROFILED_BANDWIDTH_BLOCK(name_, bytes_) \
-    ScopedProfile<__COUNTER__ + 1, false>       \
-    CAT(profiled_block__, __LINE__){name_, bytes_}
+    PROFILED_SCOPE_(false, name_, bytes_)
 #define PROFILED_BANDWIDTH_FUNCTION(bytes_) \
     PROFILED_BANDWIDTH_BLOCK(__FUNCTION__, bytes_)
 
-#define PROFILED_BLOCK_PF(name_)         \
-    ScopedProfile<__COUNTER__ + 1, true> \
-    CAT(profiled_block__, __LINE__){name_}
+#define PROFILED_BLOCK_PF(name_) PROFILED_SCOPE_(true, name_, 0)
 #define PROFILED_FUNCTION_PF PROFILED_BLOCK_PF(__FUNCTION__)
 
 #define PROFILED_BANDWIDTH_BLOCK_PF(name_, bytes_) \
-    ScopedProfile<__COUNTER__ + 1, true>           \
-    CAT(profiled_block__, __LINE__){name_, bytes_}
+    PROFILED_SCOPE_(true, name_, bytes_)
 #define PROFILED_BANDWIDTH_FUNCTION_PF(bytes_) \
     PROFILED_BANDWIDTH_BLOCK_PF(__FUNCTION__, bytes_)
 
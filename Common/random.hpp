@@ -0,0 +1,222 @@
+#pragma once
+
+#include "defs.hpp"
+#include "intrinsics.hpp"
+#include "cpuid.hpp"
+
+// xoshiro256++ (Blackman & Vigna). Seeded through splitmix64, so any u64
+// seed gives a well mixed state. jump() advances by 2^128 steps, which is
+// how independent streams are split off one seed: stream i is the seeded
+// state jumped i times, and no two streams of any realistic length overlap.
+// long_jump() advances by 2^192, for splitting streams that get split again.
+
+struct rng_state_t {
+    u64 s[4];
+};
+
+FINLINE u64 rotl64(u64 x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+inline u64 splitmix64_next(u64 &x)
+{
+    u64 z = (x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+inline rng_state_t make_rng_state(u64 seed)
+{
+    rng_state_t st;
+    for (u64 &w : st.s)
+        w = splitmix64_next(seed);
+    return st;
+}
+
+FINLINE u64 rng_next(rng_state_t &st)
+{
+    u64 *s = st.s;
+    u64 const res = rotl64(s[0] + s[3], 23) + s[0];
+    u64 const t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl64(s[3], 45);
+    return res;
+}
+
+inline void rng_apply_jump(rng_state_t &st, u64 const (&poly)[4])
+{
+    u64 acc[4] = {};
+    for (u64 j : poly) {
+        for (int b = 0; b < 64; ++b) {
+            if (j & (u64(1) << b)) {
+                for (int i = 0; i < 4; ++i)
+                    acc[i] ^= st.s[i];
+            }
+            rng_next(st);
+        }
+    }
+    memcpy(st.s, acc, sizeof(acc));
+}
+
+inline void rng_jump(rng_state_t &st)
+{
+    static constexpr u64 c_jump[4] = {
+        0x180EC6D33CFD0ABAull, 0xD5A61266F0C9392Cull,
+        0xA9582618E03FC9AAull, 0x39ABDC4529B1661Cull};
+    rng_apply_jump(st, c_jump);
+}
+
+inline void rng_long_jump(rng_state_t &st)
+{
+    static constexpr u64 c_long_jump[4] = {
+        0x76E15D3EFEFDCBBFull, 0xC5004E441C522FB3ull,
+        0x77710069854EE241ull, 0x39109BB02ACBE635ull};
+    rng_apply_jump(st, c_long_jump);
+}
+
+// Top 53 bits, [0, 1)
+FINLINE f64 rng_next_f64(rng_state_t &st)
+{
+    return f64(rng_next(st) >> 11) * 0x1.0p-53;
+}
+
+// [min, max]
+FINLINE f64 rng_next_f64(rng_state_t &st, f64 min, f64 max)
+{
+    return clamp(rng_next_f64(st) * (max - min) + min, min, max);
+}
+
+// 4 interleaved streams, one per avx2 lane: lane i is the source state
+// jumped i times. The scalar and avx2 paths produce the same numbers, so
+// output never depends on the cpu, only on the seed. Doubles are 52 bit
+// mantissas: bits | 1.0 is in [1, 2), minus 1 is exact. Scaling is an
+// explicit fma on both paths, left to the compiler a * b + c contracts or
+// not depending on flags.
+
+struct rng_state_4x_t {
+    alignas(32) u64 s[4][4]; // [state word][lane]
+};
+
+inline rng_state_4x_t make_rng_state_4x(rng_state_t st)
+{
+    rng_state_4x_t st4;
+    for (u32 l = 0; l < 4; ++l) {
+        for (u32 w = 0; w < 4; ++w)
+            st4.s[w][l] = st.s[w];
+        rng_jump(st);
+    }
+    return st4;
+}
+
+FINLINE f64 rng_bits_to_f64_52(u64 bits)
+{
+    u64 const one_bits = (bits >> 12) | 0x3FF0000000000000ull;
+    f64 one;
+    memcpy(&one, &one_bits, sizeof(one));
+    return one - 1.0;
+}
+
+FINLINE void rng_next_4x(rng_state_4x_t &st4, u64 (&out)[4])
+{
+    for (u32 l = 0; l < 4; ++l) {
+        rng_state_t st = {st4.s[0][l], st4.s[1][l], st4.s[2][l], st4.s[3][l]};
+        out[l] = rng_next(st);
+        for (u32 w = 0; w < 4; ++w)
+            st4.s[w][l] = st.s[w];
+    }
+}
+
+// out[4 * i + l] is draw i of lane l in [min, max], cnt multiple of 4
+inline void rng_fill_f64_4x(
+    rng_state_4x_t &st4, f64 *out, u64 cnt, f64 min, f64 max)
+{
+    assert(cnt % 4 == 0);
+    f64 const scale = max - min;
+    for (u64 i = 0; i < cnt; i += 4) {
+        u64 bits[4];
+        rng_next_4x(st4, bits);
+        for (u32 l = 0; l < 4; ++l)
+            out[i + l] = fma(rng_bits_to_f64_52(bits[l]), scale, min);
+    }
+}
+
+ISA_REGION_BEGIN_AVX2
+
+struct rng_regs_4x_t {
+    __m256i s0, s1, s2, s3;
+};
+
+FINLINE rng_regs_4x_t load_rng_regs_4x(rng_state_4x_t const &st4)
+{
+    return {
+        _mm256_load_si256((__m256i const *)st4.s[0]),
+        _mm256_load_si256((__m256i const *)st4.s[1]),
+        _mm256_load_si256((__m256i const *)st4.s[2]),
+        _mm256_load_si256((__m256i const *)st4.s[3])};
+}
+
+FINLINE void store_rng_regs_4x(rng_state_4x_t &st4, rng_regs_4x_t const &r)
+{
+    _mm256_store_si256((__m256i *)st4.s[0], r.s0);
+    _mm256_store_si256((__m256i *)st4.s[1], r.s1);
+    _mm256_store_si256((__m256i *)st4.s[2], r.s2);
+    _mm256_store_si256((__m256i *)st4.s[3], r.s3);
+}
+
+FINLINE __m256i rotl64_epi64(__m256i x, int k)
+{
+    return _mm256_or_si256(_mm256_slli_epi64(x, k), _mm256_srli_epi64(x, 64 - k));
+}
+
+FINLINE __m256i rng_next_epi64(rng_regs_4x_t &r)
+{
+    __m256i const res = _mm256_add_epi64(
+        rotl64_epi64(_mm256_add_epi64(r.s0, r.s3), 23), r.s0);
+    __m256i const t = _mm256_slli_epi64(r.s1, 17);
+    r.s2 = _mm256_xor_si256(r.s2, r.s0);
+    r.s3 = _mm256_xor_si256(r.s3, r.s1);
+    r.s1 = _mm256_xor_si256(r.s1, r.s2);
+    r.s0 = _mm256_xor_si256(r.s0, r.s3);
+    r.s2 = _mm256_xor_si256(r.s2, t);
+    r.s3 = rotl64_epi64(r.s3, 45);
+    return res;
+}
+
+// [0, 1)
+FINLINE __m256d rng_next_pd(rng_regs_4x_t &r)
+{
+    __m256i const bits = _mm256_or_si256(
+        _mm256_srli_epi64(rng_next_epi64(r), 12),
+        _mm256_set1_epi64x(0x3FF0000000000000ll));
+    return _mm256_sub_pd(_mm256_castsi256_pd(bits), _mm256_set1_pd(1.0));
+}
+
+inline void rng_fill_f64_4x_avx2(
+    rng_state_4x_t &st4, f64 *out, u64 cnt, f64 min, f64 max)
+{
+    assert(cnt % 4 == 0);
+    rng_regs_4x_t r = load_rng_regs_4x(st4);
+    __m256d const scale = _mm256_set1_pd(max - min);
+    __m256d const vmin = _mm256_set1_pd(min);
+    for (u64 i = 0; i < cnt; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_fmadd_pd(rng_next_pd(r), scale, vmin));
+    }
+    store_rng_regs_4x(st4, r);
+}
+
+ISA_REGION_END
+
+inline void rng_fill_f64_4x(
+    rng_state_4x_t &st4, f64 *out, u64 cnt, f64 min, f64 max, isa_level_t isa)
+{
+    if (isa >= e_isa_avx2)
+        rng_fill_f64_4x_avx2(st4, out, cnt, min, max);
+    else
+        rng_fill_f64_4x(st4, out, cnt, min, max);
+}
@@ -0,0 +1,167 @@
+#include <haversine_state.hpp>
+#include <haversine_calculation.hpp>
+#include <haversine_service.hpp>
+
+#include <buffer.hpp>
+#include <profiling.hpp>
+#include <logging.hpp>
+#include <defer.hpp>
+#include <os.hpp>
+#include <defs.hpp>
+
+// Load tester for the haversine server
+
+template <usize t_n>
+static char const *argpref(char const *arg, char const (&val)[t_n])
+{
+    if (strncmp(arg, val, t_n - 1) != 0)
+        return nullptr;
+    return arg + (t_n - 1);
+}
+
+static f64 randflt(f64 min, f64 max)
+{
+    return clamp((f64(rand()) / RAND_MAX) * (max - min) + min, min, max);
+}
+
+static haversine_latency_tracker_t g_round_trips = {};
+
+int main(int argc, char **argv)
+{
+    init_os_process_state(g_os_proc_state);
+
+    char const *socket_path = c_haversine_service_default_socket;
+    u64 batch_count = 1000;
+    u64 batch_size = 1000;
+    uint rand_seed = 1;
+    bool validate = false;
+    bool shutdown_server = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (char const *p = argpref(argv[i], "-socket=")) {
+            socket_path = p;
+        } else if (char const *p = argpref(argv[i], "-batches=")) {
+            batch_count = u64(atoll(p));
+        } else if (char const *p = argpref(argv[i], "-batch-size=")) {
+            batch_size = u64(atoll(p));
+        } else if (char const *p = argpref(argv[i], "-seed=")) {
+            rand_seed = uint(atoi(p));
+        } else if (streq(argv[i], "-validate")) {
+            validate = true;
+        } else if (streq(argv[i], "-shutdown")) {
+            shutdown_server = true;
+        } else {
+            LOGERR("Invalid arg: %s", argv[i]);
+            return 1;
+        }
+    }
+
+    if (batch_size == 0) {
+        LOGERR("Invalid arg, specify positive pair count in -batch-size=[val]");
+        return 1;
+    }
+
+    u64 const cpu_timer_freq = measure_cpu_timer_freq(0.1l);
+
+    buffer_t pairs_buf = allocate_best(batch_size * sizeof(point_pair_t));
+    buffer_t answers_buf = allocate_best(batch_size * sizeof(f64));
+    DEFER([&] { deallocate(pairs_buf); deallocate(answers_buf); });
+    if (!is_valid(pairs_buf) || !is_valid(answers_buf))
+        return 2;
+
+    point_pair_t *pairs = (point_pair_t *)pairs_buf.data;
+    f64 *answers = (f64 *)answers_buf.data;
+
+    srand(rand_seed);
+    for (u64 i = 0; i < batch_size; ++i) {
+        pairs[i] = point_pair_t{
+            randflt(-180.0, 180.0), randflt(-90.0, 90.0),
+            randflt(-180.0, 180.0), randflt(-90.0, 90.0)
+        };
+    }
+
+    int fd = connect_service_socket(socket_path);
+    if (fd < 0)
+        return 2;
+    DEFER([fd] { close(fd); });
+
+    f64 max_error = 0.0;
+    u64 const start = READ_TIMER();
+
+    for (u64 b = 0; b < batch_count; ++b) {
+        haversine_service_header_t header =
+            {c_haversine_service_magic, e_hsmt_batch, batch_size};
+        haversine_service_reply_t reply;
+
+        u64 const rt_start = READ_TIMER();
+        if (!write_full(fd, &header, sizeof(header)) ||
+            !write_full(fd, pairs, batch_size * sizeof(point_pair_t)) ||
+            !read_full(fd, &reply, sizeof(reply)))
+        {
+            LOGERR("Connection lost on batch %llu", (unsigned long long)b);
+            return 3;
+        }
+        if (reply.magic != c_haversine_service_magic) {
+            LOGERR("Invalid reply magic on batch %llu", (unsigned long long)b);
+            return 3;
+        }
+        if (reply.status != e_hss_ok || reply.pair_cnt != batch_size) {
+            LOGERR("Server rejected batch, status=%u", reply.status);
+            return 3;
+        }
+        if (!read_full(fd, answers, batch_size * sizeof(f64))) {
+            LOGERR("Connection lost on batch %llu", (unsigned long long)b);
+            return 3;
+        }
+        record_batch(g_round_trips, READ_TIMER() - rt_start, batch_size);
+
+        if (validate && b == 0) {
+            for (u64 i = 0; i < batch_size; ++i) {
+                max_error = max(
+                    max_error,
+                    abs(answers[i] - haversine_dist_reference(pairs[i])));
+            }
+        }
+    }
+
+    f64 const total_sec =
+        ticks_to_sec(READ_TIMER() - start, cpu_timer_freq);
+
+    fprintf(stderr, "Round trip: ");
+    print_service_stats(
+        calculate_service_stats(g_round_trips, cpu_timer_freq));
+    fprintf(stderr, "Throughput: %.3lfmpairs/s (%.3lfs)\n",
+        f64(batch_count * batch_size) * 1e-6 / total_sec, total_sec);
+    if (validate)
+        fprintf(stderr, "MaxError=%.16g\n", max_error);
+
+    haversine_service_header_t header =
+        {c_haversine_service_magic, e_hsmt_stats, 0};
+    haversine_service_reply_t reply;
+    haversine_service_stats_t stats;
+    if (!write_full(fd, &header, sizeof(header)) ||
+        !read_full(fd, &reply, sizeof(reply)))
+    {
+        LOGERR("Connection lost on stats request");
+        return 3;
+    }
+    // The stats payload only follows an ok reply
+    if (reply.magic != c_haversine_service_magic || reply.status != e_hss_ok) {
+        LOGERR("Server rejected stats request, status=%u", reply.status);
+        return 3;
+    }
+    if (!read_full(fd, &stats, sizeof(stats))) {
+        LOGERR("Connection lost on stats request");
+        return 3;
+    }
+    fprintf(stderr, "Server compute: ");
+    print_service_stats(stats);
+
+    if (shutdown_server) {
+        header.type = e_hsmt_shutdown;
+        if (write_full(fd, &header, sizeof(header)))
+            read_full(fd, &reply, sizeof(reply));
+    }
+
+    return 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <files.hpp>
+#include <defer.hpp>
+#include <defs.hpp>
+
+// Binary pair file, as written by the Generator with -format=bin: this
+// header, then pair_cnt point_pair_t (x0, y0, x1, y1 f64 degrees) at
+// pairs_offset. Same .check.bin as for json. Native endianness, the Solver
+// maps it as is.
+
+inline constexpr u32 c_haversine_bin_magic = 0x4E424856; // VHBN
+inline constexpr u32 c_haversine_bin_version = 1;
+
+struct haversine_bin_header_t {
+    u32 magic;
+    u32 version;
+    u64 pair_cnt;
+    u64 pairs_offset; // From the start of the file, 32 byte aligned
+    u64 reserved;
+};
+
+static_assert(sizeof(haversine_bin_header_t) == 32);
+
+inline haversine_bin_header_t make_haversine_bin_header(u64 pair_cnt)
+{
+    return {
+        c_haversine_bin_magic, c_haversine_bin_version,
+        pair_cnt, sizeof(haversine_bin_header_t), 0};
+}
+
+inline bool is_haversine_bin_file(char const *fn)
+{
+    os_file_t f = os_read_open_file(fn);
+    if (!is_valid(f))
+        return false;
+    DEFER([&f] { os_close_file(f); });
+
+    u32 magic = 0;
+    return
+        os_file_read(f, &magic, sizeof(magic)) == sizeof(magic) &&
+        magic == c_haversine_bin_magic;
+}
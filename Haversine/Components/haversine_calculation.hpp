@@ -5,6 +5,7 @@
 #include "haversine_math.hpp"
 
 #include <defs.hpp>
+#include <cpuid.hpp>
 
 inline f64 haversine_dist_naive_templ(
     point_pair_t pair,
@@ -46,6 +47,8 @@ inline f64 haversine_dist_range_check(
         pair, &range_cos, &range_asin, &range_sqrt, &rngs);
 }
 
+ISA_REGION_BEGIN_AVX2
+
 inline f64 haversine_dist_our_funcs(point_pair_t pair)
 {
     return haversine_dist_naive_templ(
@@ -56,12 +59,12 @@ inline f64 haversine_dist_our_funcs(point_pair_t pair)
         nullptr);
 }
 
+ISA_REGION_END
+
 inline void calculate_haversine_distances(
     haversine_state_t &s, auto &&calculator)
 {
-    PROFILED_BANDWIDTH_FUNCTION_PF(s.pair_cnt * sizeof(point_pair_t));
-
-    s.sum_answer = 0.0;
+    s.sum_answer = s.base_sum;
 
     for (u32 i = 0; i < s.pair_cnt; ++i) {
         f64 const dist = calculator(s.pairs[i]);
@@ -75,105 +78,559 @@ inline void calculate_haversine_distances_naive(haversine_state_t &s)
     calculate_haversine_distances(s, &haversine_dist_naive);
 }
 
+ISA_REGION_BEGIN_AVX2
+
 inline void calculate_haversine_distances_our_funcs(haversine_state_t &s)
 {
     calculate_haversine_distances(s, &haversine_dist_our_funcs);
 }
 
+ISA_REGION_END
+
 inline f64 haversine_dist_reference(point_pair_t pair)
 {
     return haversine_dist_naive(pair);
 }
 
-inline void calculate_haversine_distances_inline(haversine_state_t &s)
-{
-    PROFILED_BANDWIDTH_FUNCTION_PF(s.pair_cnt * sizeof(point_pair_t));
+ISA_REGION_BEGIN_AVX2
 
-    static constexpr f64 c_deg2rad = c_pi64 / 180.0;
-    static constexpr f64 c_rad_coeff = c_earth_rad64 * 2.0;
-    static __m128d const absmask =
+FINLINE f64 haversine_dist_inline(f64 x0, f64 y0, f64 x1, f64 y1)
+{
+    constexpr f64 c_deg2rad = c_pi64 / 180.0;
+    constexpr f64 c_rad_coeff = c_earth_rad64 * 2.0;
+    __m128d const absmask =
         _mm_castsi128_pd(_mm_set1_epi64x(0x7FFFFFFFFFFFFFFF));
 
-    s.sum_answer = 0.0;
-
-    point_pair_t const *src = s.pairs;
-    f64 *dst = s.answers;
-
     // @TODO: make a proper helper func? Can't decide on return types yet.
     auto ternary = [](bool cond, f64 l, f64 r) {
         return _mm_cvtsd_f64(_mm_blendv_pd(
             _mm_set_sd(r), _mm_set_sd(l), bool2mask_sd(cond)));
     };
     // @TODO: definitely should pull this out
-    auto toabs = [](f64 d) {
+    auto toabs = [absmask](f64 d) {
         return _mm_cvtsd_f64(_mm_and_pd(_mm_set_sd(d), absmask));
     };
 
-    for (u32 i = 0; i < s.pair_cnt; ++i, ++src) {
-        f64 xr0 = fmadd(src->x0, c_deg2rad, c_pi_half64);
-        f64 xr1 = fmadd(src->x1, c_deg2rad, c_pi_half64);
-        f64 yr0 = c_deg2rad * src->y0;
-        f64 yr1 = c_deg2rad * src->y1;
-
-        f64 dxr = xr0 - xr1;
-        f64 dyr = yr0 - yr1;
-        f64 adxr = toabs(dxr);
-        f64 dx = ternary(adxr > c_pi64, c_2pi64 - adxr, adxr);
-        f64 dy = toabs(dyr); // Already from -pi to pi
-
-        __m256d a = _mm256_set_pd(
-            c_pi_half64 - dy,
-            c_pi_half64 - dx,
-            ternary(xr1 > c_pi_half64, c_pi64 - xr1, xr1),
-            ternary(xr0 > c_pi_half64, c_pi64 - xr0, xr0));
-        __m256d a2 = _mm256_mul_pd(a, a);
-        __m256d cosines = _mm256_set1_pd(0x1.883c1c5deffbep-49);
-        cosines = _mm256_fmadd_pd(cosines, a2, _mm256_set1_pd(-0x1.ae43dc9bf8ba7p-41));
-        cosines = _mm256_fmadd_pd(cosines, a2, _mm256_set1_pd(0x1.6123ce513b09fp-33));
-        cosines = _mm256_fmadd_pd(cosines, a2, _mm256_set1_pd(-0x1.ae6454d960ac4p-26));
-        cosines = _mm256_fmadd_pd(cosines, a2, _mm256_set1_pd(0x1.71de3a52aab96p-19));
-        cosines = _mm256_fmadd_pd(cosines, a2, _mm256_set1_pd(-0x1.a01a01a014eb6p-13));
-        cosines = _mm256_fmadd_pd(cosines, a2, _mm256_set1_pd(0x1.11111111110c9p-7));
-        cosines = _mm256_fmadd_pd(cosines, a2, _mm256_set1_pd(-0x1.5555555555555p-3));
-        cosines = _mm256_fmadd_pd(cosines, a2, _mm256_set1_pd(0x1p0));
-        cosines = _mm256_mul_pd(cosines, a);
-
-        f64 cosx0 = _mm256_cvtsd_f64(cosines);
-        f64 cosx1 = _mm256_cvtsd_f64(_mm256_permute4x64_pd(cosines, 0b01010101));
-        f64 cosdx = _mm256_cvtsd_f64(_mm256_permute4x64_pd(cosines, 0b10101010));
-        f64 cosdy = _mm256_cvtsd_f64(_mm256_permute4x64_pd(cosines, 0b11111111));
-
-        f64 hsterm = 0.5 * fmadd(cosx0 * cosx1, 1.0 - cosdy, 1.0 - cosdx);
-
-        __m128d cvt_mask = bool2mask_sd(hsterm > 0.5);
-        __m128d angle_x2 = _mm_blendv_pd(
-            _mm_set_sd(hsterm), _mm_set_sd(1.0 - hsterm), cvt_mask);
-        __m128d angle_x = _mm_sqrt_sd(angle_x2, angle_x2);
-        __m128d angle_r = _mm_set_sd(0x1.7f820d52c2775p-1);
-        angle_r = _mm_fmadd_sd(angle_r, angle_x2, _mm_set_sd(-0x1.4d84801ff1aa1p1));
-        angle_r = _mm_fmadd_sd(angle_r, angle_x2, _mm_set_sd(0x1.14672d35db97ep2));
-        angle_r = _mm_fmadd_sd(angle_r, angle_x2, _mm_set_sd(-0x1.188f223fe5f34p2));
-        angle_r = _mm_fmadd_sd(angle_r, angle_x2, _mm_set_sd(0x1.86bbff2a6c7b6p1));
-        angle_r = _mm_fmadd_sd(angle_r, angle_x2, _mm_set_sd(-0x1.83633c76e4551p0));
-        angle_r = _mm_fmadd_sd(angle_r, angle_x2, _mm_set_sd(0x1.224c4dbe13cbdp-1));
-        angle_r = _mm_fmadd_sd(angle_r, angle_x2, _mm_set_sd(-0x1.2ab04ba9012e3p-3));
-        angle_r = _mm_fmadd_sd(angle_r, angle_x2, _mm_set_sd(0x1.5565a3d3908b9p-5));
-        angle_r = _mm_fmadd_sd(angle_r, angle_x2, _mm_set_sd(0x1.b1b8d27cd7e72p-8));
-        angle_r = _mm_fmadd_sd(angle_r, angle_x2, _mm_set_sd(0x1.dc086c5d99cdcp-7));
-        angle_r = _mm_fmadd_sd(angle_r, angle_x2, _mm_set_sd(0x1.1b8cc838ee86ep-6));
-        angle_r = _mm_fmadd_sd(angle_r, angle_x2, _mm_set_sd(0x1.6e96be6dbe49ep-6));
-        angle_r = _mm_fmadd_sd(angle_r, angle_x2, _mm_set_sd(0x1.f1c6b0ea300d7p-6));
-        angle_r = _mm_fmadd_sd(angle_r, angle_x2, _mm_set_sd(0x1.6db6dca9f82d4p-5));
-        angle_r = _mm_fmadd_sd(angle_r, angle_x2, _mm_set_sd(0x1.3333333148aa7p-4));
-        angle_r = _mm_fmadd_sd(angle_r, angle_x2, _mm_set_sd(0x1.555555555683fp-3));
-        angle_r = _mm_fmadd_sd(angle_r, angle_x2, _mm_set_sd(0x1.fffffffffffffp-1));
-        angle_r = _mm_mul_sd(angle_r, angle_x);
-        __m128d angle = _mm_blendv_pd(
-            angle_r, _mm_sub_sd(_mm_set_sd(c_pi_half64), angle_r), cvt_mask);
-
-        f64 dist = c_rad_coeff * _mm_cvtsd_f64(angle);
+    f64 xr0 = fmadd(x0, c_deg2rad, c_pi_half64);
+    f64 xr1 = fmadd(x1, c_deg2rad, c_pi_half64);
+    f64 yr0 = c_deg2rad * y0;
+    f64 yr1 = c_deg2rad * y1;
+
+    f64 dxr = xr0 - xr1;
+    f64 dyr = yr0 - yr1;
+    f64 adxr = toabs(dxr);
+    f64 dx = ternary(adxr > c_pi64, c_2pi64 - adxr, adxr);
+    f64 dy = toabs(dyr); // Already from -pi to pi
+
+    __m256d a = _mm256_set_pd(
+        c_pi_half64 - dy,
+        c_pi_half64 - dx,
+        ternary(xr1 > c_pi_half64, c_pi64 - xr1, xr1),
+        ternary(xr0 > c_pi_half64, c_pi64 - xr0, xr0));
+    __m256d a2 = _mm256_mul_pd(a, a);
+    __m256d cosines = odd_poly_pd<c_sin_poly64>(a2, a);
+
+    f64 cosx0 = _mm256_cvtsd_f64(cosines);
+    f64 cosx1 = _mm256_cvtsd_f64(_mm256_permute4x64_pd(cosines, 0b01010101));
+    f64 cosdx = _mm256_cvtsd_f64(_mm256_permute4x64_pd(cosines, 0b10101010));
+    f64 cosdy = _mm256_cvtsd_f64(_mm256_permute4x64_pd(cosines, 0b11111111));
+
+    f64 hsterm = 0.5 * fmadd(cosx0 * cosx1, 1.0 - cosdy, 1.0 - cosdx);
 
+    __m128d cvt_mask = bool2mask_sd(hsterm > 0.5);
+    __m128d angle_x2 = _mm_blendv_pd(
+        _mm_set_sd(hsterm), _mm_set_sd(1.0 - hsterm), cvt_mask);
+    __m128d angle_x = _mm_sqrt_sd(angle_x2, angle_x2);
+    __m128d angle_r = odd_poly_sd<c_asin_poly64>(angle_x2, angle_x);
+    __m128d angle = _mm_blendv_pd(
+        angle_r, _mm_sub_sd(_mm_set_sd(c_pi_half64), angle_r), cvt_mask);
+
+    return c_rad_coeff * _mm_cvtsd_f64(angle);
+}
+
+inline void calculate_haversine_distances_inline(haversine_state_t &s)
+{
+    PROFILED_BANDWIDTH_FUNCTION_PF(s.pair_cnt * sizeof(point_pair_t));
+
+    s.sum_answer = s.base_sum;
+
+    point_pair_t const *src = s.pairs;
+    f64 *dst = s.answers;
+
+    for (u32 i = 0; i < s.pair_cnt; ++i, ++src) {
+        f64 dist = haversine_dist_inline(src->x0, src->y0, src->x1, src->y1);
         *dst++ = dist;
         s.sum_answer += dist;
     }
 }
+
+// Every op lane-parallel over 4 pairs, same math as haversine_dist_inline
+FINLINE __m256d haversine_dist_4x(
+    __m256d x0, __m256d y0, __m256d x1, __m256d y1)
+{
+    __m256d const deg2rad = _mm256_set1_pd(c_pi64 / 180.0);
+    __m256d const pi = _mm256_set1_pd(c_pi64);
+    __m256d const pi_half = _mm256_set1_pd(c_pi_half64);
+    __m256d const two_pi = _mm256_set1_pd(c_2pi64);
+    __m256d const one = _mm256_set1_pd(1.0);
+    __m256d const half = _mm256_set1_pd(0.5);
+
+    __m256d xr0 = _mm256_fmadd_pd(x0, deg2rad, pi_half);
+    __m256d xr1 = _mm256_fmadd_pd(x1, deg2rad, pi_half);
+    __m256d yr0 = _mm256_mul_pd(y0, deg2rad);
+    __m256d yr1 = _mm256_mul_pd(y1, deg2rad);
+
+    __m256d adxr = abs_pd(_mm256_sub_pd(xr0, xr1));
+    __m256d dx = _mm256_blendv_pd(
+        adxr, _mm256_sub_pd(two_pi, adxr),
+        _mm256_cmp_pd(adxr, pi, _CMP_GT_OQ));
+    __m256d dy = abs_pd(_mm256_sub_pd(yr0, yr1)); // Already from -pi to pi
+
+    __m256d a0 = _mm256_blendv_pd(
+        xr0, _mm256_sub_pd(pi, xr0), _mm256_cmp_pd(xr0, pi_half, _CMP_GT_OQ));
+    __m256d a1 = _mm256_blendv_pd(
+        xr1, _mm256_sub_pd(pi, xr1), _mm256_cmp_pd(xr1, pi_half, _CMP_GT_OQ));
+
+    __m256d cosx0 = sin_poly_pd(a0);
+    __m256d cosx1 = sin_poly_pd(a1);
+    __m256d cosdx = sin_poly_pd(_mm256_sub_pd(pi_half, dx));
+    __m256d cosdy = sin_poly_pd(_mm256_sub_pd(pi_half, dy));
+
+    __m256d hsterm = _mm256_mul_pd(half, _mm256_fmadd_pd(
+        _mm256_mul_pd(cosx0, cosx1),
+        _mm256_sub_pd(one, cosdy),
+        _mm256_sub_pd(one, cosdx)));
+
+    __m256d cvt_mask = _mm256_cmp_pd(hsterm, half, _CMP_GT_OQ);
+    __m256d angle_x2 = _mm256_blendv_pd(
+        hsterm, _mm256_sub_pd(one, hsterm), cvt_mask);
+    __m256d angle_r = asin_poly_pd(angle_x2, _mm256_sqrt_pd(angle_x2));
+    __m256d angle = _mm256_blendv_pd(
+        angle_r, _mm256_sub_pd(pi_half, angle_r), cvt_mask);
+
+    return _mm256_mul_pd(_mm256_set1_pd(c_earth_rad64 * 2.0), angle);
+}
+
+FINLINE void store_and_sum_haversine_4x(
+    haversine_state_t &s, f64 *dst, __m256d dists, u32 cnt)
+{
+    if (cnt == 4) {
+        _mm256_storeu_pd(dst, dists);
+    } else {
+        f64 lanes[4];
+        _mm256_storeu_pd(lanes, dists);
+        memcpy(dst, lanes, cnt * sizeof(f64));
+    }
+    // In pair order, so the sum matches the one-pair-at-a-time kernels
+    for (u32 i = 0; i < cnt; ++i)
+        s.sum_answer += dst[i];
+}
+
+inline void calculate_haversine_distances_4x(haversine_state_t &s)
+{
+    s.sum_answer = s.base_sum;
+
+    point_pair_t const *src = s.pairs;
+    f64 *dst = s.answers;
+
+    auto process = [&](point_pair_t const *p, u32 cnt) {
+        __m256d r0 = _mm256_loadu_pd(&p[0].x0);
+        __m256d r1 = _mm256_loadu_pd(&p[1].x0);
+        __m256d r2 = _mm256_loadu_pd(&p[2].x0);
+        __m256d r3 = _mm256_loadu_pd(&p[3].x0);
+        transpose4x4_pd(r0, r1, r2, r3);
+        store_and_sum_haversine_4x(
+            s, dst, haversine_dist_4x(r0, r1, r2, r3), cnt);
+    };
+
+    u64 const full_cnt = round_down(s.pair_cnt, u64(4));
+    for (u64 i = 0; i < full_cnt; i += 4, src += 4, dst += 4)
+        process(src, 4);
+
+    if (u32 rem = u32(s.pair_cnt - full_cnt)) {
+        point_pair_t tail[4] = {}; // Zero pairs are harmless, dist is 0
+        memcpy(tail, src, rem * sizeof(point_pair_t));
+        process(tail, rem);
+    }
+}
+
+// calculate_haversine_distances_4x with t_interleave independent groups of
+// 4 pairs written out side by side, so their chains overlap, and that step
+// repeated t_unroll times per loop iteration. Which one wins depends on the
+// uarch, see haversine_tuning.hpp. Sums stay in pair order, so the results
+// are bit-identical to calculate_haversine_distances_4x.
+template <u32 t_interleave, u32 t_unroll>
+inline void calculate_haversine_distances_4x_tuned(haversine_state_t &s)
+{
+    constexpr u64 c_step = 4 * t_interleave;
+    constexpr u64 c_iter = c_step * t_unroll;
+
+    s.sum_answer = s.base_sum;
+
+    point_pair_t const *src = s.pairs;
+    f64 *dst = s.answers;
+
+    auto step = [&](point_pair_t const *p, f64 *d) {
+        __m256d dists[t_interleave];
+#pragma GCC unroll 16
+        for (u32 l = 0; l < t_interleave; ++l) {
+            __m256d r0 = _mm256_loadu_pd(&p[4 * l + 0].x0);
+            __m256d r1 = _mm256_loadu_pd(&p[4 * l + 1].x0);
+            __m256d r2 = _mm256_loadu_pd(&p[4 * l + 2].x0);
+            __m256d r3 = _mm256_loadu_pd(&p[4 * l + 3].x0);
+            transpose4x4_pd(r0, r1, r2, r3);
+            dists[l] = haversine_dist_4x(r0, r1, r2, r3);
+        }
+#pragma GCC unroll 16
+        for (u32 l = 0; l < t_interleave; ++l)
+            store_and_sum_haversine_4x(s, d + 4 * l, dists[l], 4);
+    };
+
+    u64 const full_cnt = round_down(s.pair_cnt, c_iter);
+    for (u64 i = 0; i < full_cnt; i += c_iter, src += c_iter, dst += c_iter) {
+#pragma GCC unroll 16
+        for (u32 u = 0; u < t_unroll; ++u)
+            step(src + u * c_step, dst + u * c_step);
+    }
+
+    // Tail a group of 4 at a time, zero pairs pad the last one
+    for (u64 i = full_cnt; i < s.pair_cnt; i += 4, src += 4, dst += 4) {
+        u32 const cnt = u32(min(s.pair_cnt - i, u64(4)));
+        point_pair_t p[4] = {};
+        memcpy(p, src, cnt * sizeof(point_pair_t));
+        __m256d r0 = _mm256_loadu_pd(&p[0].x0);
+        __m256d r1 = _mm256_loadu_pd(&p[1].x0);
+        __m256d r2 = _mm256_loadu_pd(&p[2].x0);
+        __m256d r3 = _mm256_loadu_pd(&p[3].x0);
+        transpose4x4_pd(r0, r1, r2, r3);
+        store_and_sum_haversine_4x(
+            s, dst, haversine_dist_4x(r0, r1, r2, r3), cnt);
+    }
+}
+
+// Same 4-pair kernel over fixed-point microdegree storage, half the input
+// traffic, dequantized in registers
+inline void calculate_haversine_distances_quantized(haversine_state_t &s)
+{
+    PROFILED_BANDWIDTH_FUNCTION_PF(
+        s.pair_cnt * sizeof(quantized_point_pair_t));
+
+    assert(s.quantized_pairs);
+
+    s.sum_answer = s.base_sum;
+
+    quantized_point_pair_t const *src = s.quantized_pairs;
+    f64 *dst = s.answers;
+
+    auto process = [&](quantized_point_pair_t const *p, u32 cnt) {
+        __m256d const dequant_scale =
+            _mm256_set1_pd(1.0 / c_quantized_units_per_deg);
+        auto load = [&](quantized_point_pair_t const *q) {
+            return _mm256_mul_pd(
+                _mm256_cvtepi32_pd(_mm_loadu_si128((__m128i const *)q)),
+                dequant_scale);
+        };
+        __m256d r0 = load(&p[0]);
+        __m256d r1 = load(&p[1]);
+        __m256d r2 = load(&p[2]);
+        __m256d r3 = load(&p[3]);
+        transpose4x4_pd(r0, r1, r2, r3);
+        store_and_sum_haversine_4x(
+            s, dst, haversine_dist_4x(r0, r1, r2, r3), cnt);
+    };
+
+    u64 const full_cnt = round_down(s.pair_cnt, u64(4));
+    for (u64 i = 0; i < full_cnt; i += 4, src += 4, dst += 4)
+        process(src, 4);
+
+    if (u32 rem = u32(s.pair_cnt - full_cnt)) {
+        quantized_point_pair_t tail[4] = {};
+        memcpy(tail, src, rem * sizeof(quantized_point_pair_t));
+        process(tail, rem);
+    }
+}
+
+// Error bound of the f32 kernel vs haversine_dist_reference. hsterm and
+// 1 - hsterm are both sums of squares, so sqrt of the one that goes to asin
+// is the length of a vector of two sine products, each off by <= ~5e-7 abs
+// (argument roundings + polys), i.e. off by <= ~7e-7. asin' <= sqrt(2) there
+// and the poly adds ~1e-7, so the distance is off by <= 2R * 1.1e-6 ~ 14m.
+// Narrowing the inputs to f32 adds up to ~1e-5 deg per coordinate, ~2m.
+inline constexpr f64 c_haversine_f32_max_error_km = 0.016;
+
+// f32 version, 8 pairs per iteration. With h = dx/2, k = dy/2 and
+// m = (x0 + x1)/2, cosx0 * cosx1 = cos^2(m) - sin^2(h), so
+//   hsterm     = sin^2(h)cos^2(k) + cos^2(m)sin^2(k)
+//   1 - hsterm = cos^2(h)cos^2(k) + sin^2(m)sin^2(k)
+// Neither can cancel, in f32 the textbook form loses ~2km on short and up to
+// ~11km on cancelling pairs. The smaller one goes to asin.
+FINLINE __m256 haversine_dist_f32_8x(
+    __m256 x0, __m256 y0, __m256 x1, __m256 y1)
+{
+    __m256 const deg2rad = _mm256_set1_ps(f32(c_pi64 / 180.0));
+    __m256 const half_deg2rad = _mm256_set1_ps(f32(c_pi64 / 360.0));
+    __m256 const pi = _mm256_set1_ps(f32(c_pi64));
+    __m256 const pi_half = _mm256_set1_ps(f32(c_pi_half64));
+    __m256 const half = _mm256_set1_ps(0.5f);
+    __m256 const deg90 = _mm256_set1_ps(90.f);
+    __m256 const deg180 = _mm256_set1_ps(180.f);
+
+    // Only squares are used, so h and m are folded from [0, pi] to
+    // [0, pi/2], k is already there. m is folded in degrees, where
+    // 180 - m and 90 - m are exact.
+    __m256 hdxr = _mm256_mul_ps(abs_ps(_mm256_sub_ps(x0, x1)), half_deg2rad);
+    __m256 hdx = _mm256_blendv_ps(
+        hdxr, _mm256_sub_ps(pi, hdxr), _mm256_cmp_ps(hdxr, pi_half, _CMP_GT_OQ));
+    __m256 hdy = _mm256_mul_ps(abs_ps(_mm256_sub_ps(y0, y1)), half_deg2rad);
+    __m256 mxd = _mm256_mul_ps(abs_ps(_mm256_add_ps(x0, x1)), half);
+    mxd = _mm256_blendv_ps(
+        mxd, _mm256_sub_ps(deg180, mxd), _mm256_cmp_ps(mxd, deg90, _CMP_GT_OQ));
+
+    __m256 sinhdx = sin_poly_ps(hdx);
+    __m256 coshdx = sin_poly_ps(_mm256_sub_ps(pi_half, hdx));
+    __m256 sinhdy = sin_poly_ps(hdy);
+    __m256 coshdy = sin_poly_ps(_mm256_sub_ps(pi_half, hdy));
+    __m256 sinmx = sin_poly_ps(_mm256_mul_ps(mxd, deg2rad));
+    __m256 cosmx =
+        sin_poly_ps(_mm256_mul_ps(_mm256_sub_ps(deg90, mxd), deg2rad));
+
+    __m256 t0 = _mm256_mul_ps(sinhdx, coshdy);
+    __m256 t1 = _mm256_mul_ps(cosmx, sinhdy);
+    __m256 hsterm = _mm256_fmadd_ps(t0, t0, _mm256_mul_ps(t1, t1));
+    __m256 c0 = _mm256_mul_ps(coshdx, coshdy);
+    __m256 c1 = _mm256_mul_ps(sinmx, sinhdy);
+    __m256 hsterm_compl = _mm256_fmadd_ps(c0, c0, _mm256_mul_ps(c1, c1));
+
+    __m256 cvt_mask = _mm256_cmp_ps(hsterm, half, _CMP_GT_OQ);
+    __m256 angle_x2 = _mm256_blendv_ps(hsterm, hsterm_compl, cvt_mask);
+    __m256 angle_r = asin_poly_ps(angle_x2, _mm256_sqrt_ps(angle_x2));
+    __m256 angle = _mm256_blendv_ps(
+        angle_r, _mm256_sub_ps(pi_half, angle_r), cvt_mask);
+
+    return _mm256_mul_ps(_mm256_set1_ps(f32(c_earth_rad64 * 2.0)), angle);
+}
+
+inline void calculate_haversine_distances_f32(haversine_state_t &s)
+{
+    PROFILED_BANDWIDTH_FUNCTION_PF(s.pair_cnt * sizeof(point_pair_f32_t));
+
+    assert(s.f32_pairs);
+
+    s.sum_answer = s.base_sum;
+
+    point_pair_f32_t const *src = s.f32_pairs;
+    f64 *dst = s.answers;
+
+    auto process = [&](point_pair_f32_t const *p, u32 cnt) {
+        // Pairs 0-3 go to the low lanes and 4-7 to the high ones
+        auto load = [&](u32 i) {
+            return _mm256_insertf128_ps(
+                _mm256_castps128_ps256(_mm_loadu_ps(&p[i].x0)),
+                _mm_loadu_ps(&p[i + 4].x0), 1);
+        };
+        __m256 r0 = load(0);
+        __m256 r1 = load(1);
+        __m256 r2 = load(2);
+        __m256 r3 = load(3);
+        transpose4x4_ps_lanes(r0, r1, r2, r3);
+        __m256 dists = haversine_dist_f32_8x(r0, r1, r2, r3);
+
+        store_and_sum_haversine_4x(
+            s, dst, _mm256_cvtps_pd(_mm256_castps256_ps128(dists)),
+            min(cnt, 4u));
+        if (cnt > 4) {
+            store_and_sum_haversine_4x(
+                s, dst + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(dists, 1)),
+                cnt - 4);
+        }
+    };
+
+    u64 const full_cnt = round_down(s.pair_cnt, u64(8));
+    for (u64 i = 0; i < full_cnt; i += 8, src += 8, dst += 8)
+        process(src, 8);
+
+    if (u32 rem = u32(s.pair_cnt - full_cnt)) {
+        point_pair_f32_t tail[8] = {};
+        memcpy(tail, src, rem * sizeof(point_pair_f32_t));
+        process(tail, rem);
+    }
+}
+
+ISA_REGION_END
+
+ISA_REGION_BEGIN_AVX512
+
+// 8 pairs per iteration, the range fixups are masked subs instead of blends
+FINLINE __m512d haversine_dist_8x(
+    __m512d x0, __m512d y0, __m512d x1, __m512d y1)
+{
+    __m512d const deg2rad = _mm512_set1_pd(c_pi64 / 180.0);
+    __m512d const pi = _mm512_set1_pd(c_pi64);
+    __m512d const pi_half = _mm512_set1_pd(c_pi_half64);
+    __m512d const two_pi = _mm512_set1_pd(c_2pi64);
+    __m512d const one = _mm512_set1_pd(1.0);
+    __m512d const half = _mm512_set1_pd(0.5);
+
+    __m512d xr0 = _mm512_fmadd_pd(x0, deg2rad, pi_half);
+    __m512d xr1 = _mm512_fmadd_pd(x1, deg2rad, pi_half);
+    __m512d yr0 = _mm512_mul_pd(y0, deg2rad);
+    __m512d yr1 = _mm512_mul_pd(y1, deg2rad);
+
+    __m512d adxr = _mm512_abs_pd(_mm512_sub_pd(xr0, xr1));
+    __m512d dx = _mm512_mask_sub_pd(
+        adxr, _mm512_cmp_pd_mask(adxr, pi, _CMP_GT_OQ), two_pi, adxr);
+    __m512d dy = _mm512_abs_pd(_mm512_sub_pd(yr0, yr1)); // Already from -pi to pi
+
+    __m512d a0 = _mm512_mask_sub_pd(
+        xr0, _mm512_cmp_pd_mask(xr0, pi_half, _CMP_GT_OQ), pi, xr0);
+    __m512d a1 = _mm512_mask_sub_pd(
+        xr1, _mm512_cmp_pd_mask(xr1, pi_half, _CMP_GT_OQ), pi, xr1);
+
+    __m512d cosx0 = sin_poly_pd512(a0);
+    __m512d cosx1 = sin_poly_pd512(a1);
+    __m512d cosdx = sin_poly_pd512(_mm512_sub_pd(pi_half, dx));
+    __m512d cosdy = sin_poly_pd512(_mm512_sub_pd(pi_half, dy));
+
+    __m512d hsterm = _mm512_mul_pd(half, _mm512_fmadd_pd(
+        _mm512_mul_pd(cosx0, cosx1),
+        _mm512_sub_pd(one, cosdy),
+        _mm512_sub_pd(one, cosdx)));
+
+    __mmask8 cvt_mask = _mm512_cmp_pd_mask(hsterm, half, _CMP_GT_OQ);
+    __m512d angle_x2 = _mm512_mask_sub_pd(hsterm, cvt_mask, one, hsterm);
+    __m512d angle_r = asin_poly_pd512(angle_x2, _mm512_sqrt_pd(angle_x2));
+    __m512d angle = _mm512_mask_sub_pd(angle_r, cvt_mask, pi_half, angle_r);
+
+    return _mm512_mul_pd(_mm512_set1_pd(c_earth_rad64 * 2.0), angle);
+}
+
+// 8 pairs from src, pairs past pair_mask are zeroed
+FINLINE __m512d haversine_dist_8x_pairs(f64 const *src, __mmask8 pair_mask)
+{
+    // Gather {x0s, y0s} and {x1s, y1s} of 4 pairs from 2 regs of 2 pairs
+    __m512i const idx_p0 = _mm512_setr_epi64(0, 4, 8, 12, 1, 5, 9, 13);
+    __m512i const idx_p1 = _mm512_setr_epi64(2, 6, 10, 14, 3, 7, 11, 15);
+
+    // Masked tail loads don't fault and zero pairs give dist 0
+    auto load2 = [&](u32 k) {
+        __mmask8 const m =
+            ((pair_mask >> (2 * k)) & 1 ? 0x0F : 0) |
+            ((pair_mask >> (2 * k + 1)) & 1 ? 0xF0 : 0);
+        return _mm512_maskz_loadu_pd(m, src + 8 * k);
+    };
+    __m512d z0 = load2(0);
+    __m512d z1 = load2(1);
+    __m512d z2 = load2(2);
+    __m512d z3 = load2(3);
+
+    __m512d p0_lo = _mm512_permutex2var_pd(z0, idx_p0, z1);
+    __m512d p1_lo = _mm512_permutex2var_pd(z0, idx_p1, z1);
+    __m512d p0_hi = _mm512_permutex2var_pd(z2, idx_p0, z3);
+    __m512d p1_hi = _mm512_permutex2var_pd(z2, idx_p1, z3);
+
+    return haversine_dist_8x(
+        _mm512_shuffle_f64x2(p0_lo, p0_hi, 0x44),
+        _mm512_shuffle_f64x2(p0_lo, p0_hi, 0xEE),
+        _mm512_shuffle_f64x2(p1_lo, p1_hi, 0x44),
+        _mm512_shuffle_f64x2(p1_lo, p1_hi, 0xEE));
+}
+
+FINLINE void store_and_sum_haversine_8x(
+    haversine_state_t &s, f64 *dst, __m512d dists, __mmask8 pair_mask, u32 cnt)
+{
+    _mm512_mask_storeu_pd(dst, pair_mask, dists);
+    // In pair order, so the sum matches the one-pair-at-a-time kernels
+    for (u32 j = 0; j < cnt; ++j)
+        s.sum_answer += dst[j];
+}
+
+inline void calculate_haversine_distances_8x(haversine_state_t &s)
+{
+    s.sum_answer = s.base_sum;
+
+    for (u64 i = 0; i < s.pair_cnt; i += 8) {
+        u32 const cnt = u32(min(s.pair_cnt - i, u64(8)));
+        __mmask8 const pair_mask = __mmask8((1u << cnt) - 1);
+        store_and_sum_haversine_8x(
+            s, &s.answers[i],
+            haversine_dist_8x_pairs(&s.pairs[i].x0, pair_mask),
+            pair_mask, cnt);
+    }
+}
+
+// Same interleave/unroll split as calculate_haversine_distances_4x_tuned
+template <u32 t_interleave, u32 t_unroll>
+inline void calculate_haversine_distances_8x_tuned(haversine_state_t &s)
+{
+    constexpr u64 c_step = 8 * t_interleave;
+    constexpr u64 c_iter = c_step * t_unroll;
+
+    s.sum_answer = s.base_sum;
+
+    auto step = [&](u64 i) {
+        __m512d dists[t_interleave];
+#pragma GCC unroll 16
+        for (u32 l = 0; l < t_interleave; ++l)
+            dists[l] = haversine_dist_8x_pairs(&s.pairs[i + 8 * l].x0, 0xFF);
+#pragma GCC unroll 16
+        for (u32 l = 0; l < t_interleave; ++l) {
+            store_and_sum_haversine_8x(
+                s, &s.answers[i + 8 * l], dists[l], 0xFF, 8);
+        }
+    };
+
+    u64 const full_cnt = round_down(s.pair_cnt, c_iter);
+    for (u64 i = 0; i < full_cnt; i += c_iter) {
+#pragma GCC unroll 16
+        for (u32 u = 0; u < t_unroll; ++u)
+            step(i + u * c_step);
+    }
+
+    for (u64 i = full_cnt; i < s.pair_cnt; i += 8) {
+        u32 const cnt = u32(min(s.pair_cnt - i, u64(8)));
+        __mmask8 const pair_mask = __mmask8((1u << cnt) - 1);
+        store_and_sum_haversine_8x(
+            s, &s.answers[i],
+            haversine_dist_8x_pairs(&s.pairs[i].x0, pair_mask),
+            pair_mask, cnt);
+    }
+}
+
+ISA_REGION_END
+
+// Dispatched kernels are not profiled themselves, callers wrap them in a
+// block named after the kernel
+struct haversine_kernel_t {
+    void (*calculate)(haversine_state_t &);
+    isa_level_t isa;
+    char const *name;
+};
+
+inline constexpr haversine_kernel_t c_haversine_kernels[e_isa_count] =
+{
+    {&calculate_haversine_distances_naive, e_isa_scalar, "Distance kernel (scalar)"},
+    {&calculate_haversine_distances_4x, e_isa_avx2, "Distance kernel (avx2)"},
+    {&calculate_haversine_distances_8x, e_isa_avx512, "Distance kernel (avx512)"},
+};
+
+inline haversine_kernel_t const &select_haversine_kernel(isa_level_t isa)
+{
+    return c_haversine_kernels[isa];
+}
+
+// Interleave/unroll candidates for haversine_tuning.hpp, the untuned
+// kernels above are the fallback
+inline constexpr haversine_kernel_t c_haversine_kernel_variants[] =
+{
+    {&calculate_haversine_distances_4x_tuned<1, 1>, e_isa_avx2, "Distance kernel (avx2 i1 u1)"},
+    {&calculate_haversine_distances_4x_tuned<1, 2>, e_isa_avx2, "Distance kernel (avx2 i1 u2)"},
+    {&calculate_haversine_distances_4x_tuned<2, 1>, e_isa_avx2, "Distance kernel (avx2 i2 u1)"},
+    {&calculate_haversine_distances_4x_tuned<2, 2>, e_isa_avx2, "Distance kernel (avx2 i2 u2)"},
+    {&calculate_haversine_distances_4x_tuned<4, 1>, e_isa_avx2, "Distance kernel (avx2 i4 u1)"},
+    {&calculate_haversine_distances_4x_tuned<8, 1>, e_isa_avx2, "Distance kernel (avx2 i8 u1)"},
+    {&calculate_haversine_distances_8x_tuned<1, 1>, e_isa_avx512, "Distance kernel (avx512 i1 u1)"},
+    {&calculate_haversine_distances_8x_tuned<1, 2>, e_isa_avx512, "Distance kernel (avx512 i1 u2)"},
+    {&calculate_haversine_distances_8x_tuned<2, 1>, e_isa_avx512, "Distance kernel (avx512 i2 u1)"},
+    {&calculate_haversine_distances_8x_tuned<2, 2>, e_isa_avx512, "Distance kernel (avx512 i2 u2)"},
+    {&calculate_haversine_distances_8x_tuned<4, 1>, e_isa_avx512, "Distance kernel (avx512 i4 u1)"},
+};
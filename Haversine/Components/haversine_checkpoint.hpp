@@ -0,0 +1,180 @@
+#pragma once
+
+#include "haversine_common.hpp"
+#include "haversine_state.hpp"
+#include "haversine_file_io.hpp"
+
+#include <defs.hpp>
+#include <buffer.hpp>
+#include <logging.hpp>
+#include <profiling.hpp>
+
+// Incremental re-solve of append-only point files. The checkpoint lives
+// next to the input as <json>.ckpt.bin and covers every record up to
+// records_end_offset, so a later run only parses and computes the tail.
+
+inline constexpr u32 c_haversine_checkpoint_magic = 0x4B434856; // VHCK
+inline constexpr u32 c_haversine_checkpoint_max_guard_len = 32;
+
+struct haversine_checkpoint_t {
+    u32 magic;
+    u32 guard_len;
+    u64 records_end_offset;
+    u64 pair_cnt;
+    f64 sum;
+    // Last bytes before records_end_offset, catches rewritten inputs
+    u8 guard[c_haversine_checkpoint_max_guard_len];
+};
+
+inline void make_checkpoint_fn(char (&buf)[256], char const *json_fn)
+{
+    snprintf(buf, sizeof(buf), "%s.ckpt.bin", json_fn);
+}
+
+inline bool load_haversine_checkpoint(
+    char const *json_fn, haversine_checkpoint_t &out)
+{
+    char fn[256];
+    make_checkpoint_fn(fn, json_fn);
+
+    FILE *f = fopen(fn, "rb");
+    if (!f)
+        return false;
+    DEFER([f] { fclose(f); });
+
+    if (fread(&out, sizeof(out), 1, f) != 1 ||
+        out.magic != c_haversine_checkpoint_magic ||
+        out.guard_len > c_haversine_checkpoint_max_guard_len ||
+        out.guard_len > out.records_end_offset)
+    {
+        LOGERR("Invalid checkpoint file '%s'", fn);
+        return false;
+    }
+
+    return true;
+}
+
+inline bool save_haversine_checkpoint(
+    char const *json_fn, haversine_checkpoint_t const &ckpt)
+{
+    char fn[256], tmp_fn[256 + 4];
+    make_checkpoint_fn(fn, json_fn);
+    snprintf(tmp_fn, sizeof(tmp_fn), "%s.tmp", fn);
+
+    // Write aside and rename, a torn checkpoint is worse than none
+    FILE *f = fopen(tmp_fn, "wb");
+    if (!f) {
+        LOGERR("Failed to open %s for write, error: %s",
+            tmp_fn, strerror(errno));
+        return false;
+    }
+    bool const written = fwrite(&ckpt, sizeof(ckpt), 1, f) == 1;
+    if (fclose(f) != 0 || !written || rename(tmp_fn, fn) != 0) {
+        LOGERR("Failed to write checkpoint '%s'", fn);
+        remove(tmp_fn);
+        return false;
+    }
+
+    return true;
+}
+
+// False if the points array does not end the document (other root fields
+// after it), records can not be appended to such a file
+inline bool make_haversine_checkpoint(
+    haversine_state_t const &s, haversine_checkpoint_t &ckpt)
+{
+    u64 const local_end = find_points_records_end(s.json_source_buffer);
+    if (local_end == 0) {
+        LOGDBG("Points are not at the end of the json, no checkpoint");
+        return false;
+    }
+
+    ckpt = {};
+    ckpt.magic = c_haversine_checkpoint_magic;
+    ckpt.guard_len = u32(min(u64(c_haversine_checkpoint_max_guard_len), local_end));
+    ckpt.records_end_offset = s.json_source_offset + local_end;
+    ckpt.pair_cnt = s.base_pair_cnt + s.pair_cnt;
+    ckpt.sum = s.sum_answer;
+    memcpy(
+        ckpt.guard, s.json_source_buffer.data + local_end - ckpt.guard_len,
+        ckpt.guard_len);
+    return true;
+}
+
+// Loads only the records appended after the checkpoint. Returns false if
+// the checkpoint does not match the file, the caller should do a full run.
+inline bool setup_haversine_state_incremental(
+    haversine_state_t &s, char const *json_fn,
+    haversine_checkpoint_t const &ckpt)
+{
+    assert(json_fn);
+
+    PROFILED_FUNCTION_PF;
+
+    cleanup_haversine_state(s);
+
+    usize const file_len = get_file_len(json_fn);
+    if (file_len < ckpt.records_end_offset) {
+        LOGDBG("'%s' is shorter than its checkpoint", json_fn);
+        return false;
+    }
+
+    u64 const start = ckpt.records_end_offset - ckpt.guard_len;
+    s.json_source_buffer = load_file_section(json_fn, start, file_len - start);
+    s.json_source_offset = start;
+    if (!is_valid(s.json_source_buffer)) {
+        LOGERR("Failed to load json file '%s'", json_fn);
+        return false;
+    }
+
+    if (memcmp(s.json_source_buffer.data, ckpt.guard, ckpt.guard_len) != 0) {
+        LOGDBG("'%s' was rewritten before its checkpoint", json_fn);
+        cleanup_haversine_state(s);
+        return false;
+    }
+
+    s.parsed_json_root =
+        parse_json_array_tail(s.json_source_buffer, ckpt.guard_len);
+    if (!s.parsed_json_root) {
+        cleanup_haversine_state(s);
+        return false;
+    }
+
+    if (!read_haversine_pairs(s, s.parsed_json_root->arr)) {
+        cleanup_haversine_state(s);
+        return false;
+    }
+
+    s.base_pair_cnt = ckpt.pair_cnt;
+    s.base_sum = ckpt.sum;
+
+    // Only the new answers and the total sum are read from the checksum
+    char checksum_fn[256];
+    snprintf(checksum_fn, sizeof(checksum_fn), "%s.check.bin", json_fn);
+    usize const checksum_len = get_file_len(checksum_fn);
+    if (checksum_len == 0) {
+        LOGDBG(
+            "Failed to load checksum file from '%s', no validation",
+            checksum_fn);
+        return true;
+    }
+    if (checksum_len != (s.base_pair_cnt + s.pair_cnt + 1) * sizeof(f64)) {
+        LOGERR("Invalid checksum file '%s'", checksum_fn);
+        cleanup_haversine_state(s);
+        return false;
+    }
+
+    s.checksum_buffer = load_file_section(
+        checksum_fn, s.base_pair_cnt * sizeof(f64),
+        (s.pair_cnt + 1) * sizeof(f64));
+    if (!is_valid(s.checksum_buffer)) {
+        LOGERR("Failed to load checksum file '%s'", checksum_fn);
+        cleanup_haversine_state(s);
+        return false;
+    }
+
+    s.validation_answers = (f64 *)s.checksum_buffer.data;
+    s.validation_sum = s.validation_answers[s.pair_cnt];
+
+    return true;
+}
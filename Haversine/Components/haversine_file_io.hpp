@@ -49,3 +49,27 @@ inline buffer_t load_entire_file(char const *fn)
 
     return b;
 }
+
+inline buffer_t load_file_section(char const *fn, usize off, usize len)
+{
+    PROFILED_BANDWIDTH_FUNCTION_PF(len);
+
+    os_file_t of = os_read_open_file(fn);
+    if (!is_valid(of))
+        return {};
+    DEFER([&of] { os_close_file(of); });
+
+    if (off + len > of.len || !os_file_seek(of, off))
+        return {};
+
+    buffer_t b = allocate_best(len);
+    if (!is_valid(b))
+        return {};
+
+    if (os_file_read(of, b.data, b.len) != b.len) {
+        deallocate(b);
+        return {};
+    }
+
+    return b;
+}
@@ -93,8 +93,6 @@ inline bool parse_double(string_t repr, f64 &out)
     }
     if (p == start || (minus && p == start + 1))
         return false;
-    else if (p == end)
-        return true;
 
     if (p < end && *p == '.') {
         ++p;
@@ -121,11 +119,15 @@ inline bool parse_double(string_t repr, f64 &out)
         if (p == end || !is_digit(*p))
             return false;
         i32 exp = 0;
-        while (p < end && is_digit(*p))
-            exp = exp * 10 + i32(*p - '0');
-        if (eminus)
-            exp = -exp;
-        out = pow(out, f64(exp));
+        while (p < end && is_digit(*p)) {
+            // Saturated, anything past this is 0 or inf anyway
+            exp = min(exp * 10 + i32(*p - '0'), 100000);
+            ++p;
+        }
+        // 10^k is exact up to k = 22, dividing by it rounds once where
+        // multiplying by 10^-k would round twice
+        f64 const scale = pow(10.0, f64(exp));
+        out = eminus ? out / scale : out * scale;
     }
     if (minus)
         out = -out;
@@ -139,6 +141,7 @@ inline token_t get_next_token(input_file_t &input)
     token_t tok = {e_tt_error};
     string_t identifier_view = {};
     bool is_in_string = false;
+    bool is_escaped = false;       // after a \ in a string
     bool token_had_string = false; // for "" tokens
     int c;
 
@@ -148,7 +151,10 @@ inline token_t get_next_token(input_file_t &input)
         if (is_in_string && is_eof(c))
             goto yield; // tok type is error
 
-        if (c == '"') {
+        // Escapes are kept as is in the string, only \" must not end it
+        if (is_in_string && (is_escaped || c == '\\'))
+            is_escaped = !is_escaped;
+        else if (c == '"') {
             is_in_string = !is_in_string;
             // Only the first assignment is needed
             token_had_string = true;
@@ -532,6 +538,41 @@ inline json_ent_t *parse_json_input(buffer_t &source)
     return root;
 }
 
+// Continues a root { "...": [ ... ] } document that was cut right after an
+// array element: accepts either "]}" or ", elem, ..., elem ]}"
+inline json_ent_t *parse_json_array_tail(buffer_t &source, u64 start)
+{
+    PROFILED_BANDWIDTH_FUNCTION_PF(source.len - start);
+
+    input_file_t inf = {source, start};
+    json_ent_t *arr = allocate_json_entity(e_jt_array);
+
+    for (;;) {
+        token_t tok = GET_TOK(inf);
+        DEFER([&] { cleanup(tok); });
+
+        if (tok.type == e_tt_rsqbracket)
+            break;
+        if (tok.type != e_tt_comma)
+            PARSE_ERR(arr, "Invalid token, should be a comma or ]");
+
+        json_ent_t *elem = parse_json_entity(inf);
+        if (!elem)
+            PARSE_ERR(arr, "Invalid token, should be a json entity");
+
+        push_json_element(*arr, elem);
+    }
+
+    for (token_type_t expected : {e_tt_rbrace, e_tt_eof}) {
+        token_t tok = GET_TOK(inf);
+        DEFER([&] { cleanup(tok); });
+        if (tok.type != expected)
+            PARSE_ERR(arr, "Invalid token after array tail");
+    }
+
+    return arr;
+}
+
 inline void print_json(json_ent_t *ent, int depth, bool indent, bool put_comma)
 {
     PROFILED_FUNCTION;
@@ -2,12 +2,34 @@
 
 #include <defs.hpp>
 #include <intrinsics.hpp>
+#include <cpuid.hpp>
+
+#include "minimax_tables.hpp"
 
 constexpr f64 c_pi64 = 3.141592653589793238462643383279502884197169399375105820974944592307816406286208998628034825342117067982148086513282306647093844609550582231725359408128481117450284102701938521105559644622948954930382;
 constexpr f64 c_pi_half64 = 1.570796326794896619231321691639751442098584699687552910487472296153908203143104499314017412671058533991074043256641153323546922304775291115862679704064240558725142051350969260552779822311474477465191;
 constexpr f64 c_2pi64 = 6.2831853071795864769252867665590057683943387987502116419498891846156328125724179972560696506842341359642961730265646132941876892191011644634507188162569622349005682054038770422111192892458979098607639;
 constexpr f64 c_1oversqrt2_64 = 0.70710678118654752440084436210484903928483593768847403658833986899536623923105351942519376716382078636750692311545614851246241802792536860632206074854996791570661133296375279637789997525057639103028574;
 constexpr f64 c_earth_rad64 = 6378.1;
+// pi - c_pi64, for range reduction against pi split in 2
+constexpr f64 c_pi_lo64 = 0x1.1a62633145c07p-53;
+constexpr f64 c_1overpi64 = 0x1.45f306dc9c883p-2;
+
+// Polynomial error budgets (relative), the cheapest ones meeting these are
+// picked from the Remez tables at compile time. The f64 ones stay under half
+// an ulp so the kernels are only off by rounding. A full DBL_EPSILON would
+// drop sin to 8 coeffs and double the f64 kernels' max error, which the
+// precision test's kernel bounds catch.
+inline constexpr minimax_poly_t c_sin_poly64 =
+    select_minimax_poly64(c_sin_minimax_polys, 0.5 * DBL_EPSILON);
+inline constexpr minimax_poly_t c_asin_poly64 =
+    select_minimax_poly64(c_asin_minimax_polys, 0.5 * DBL_EPSILON);
+inline constexpr minimax_poly_t c_sin_poly32 =
+    select_minimax_poly32(c_sin_minimax_polys, FLT_EPSILON);
+inline constexpr minimax_poly_t c_asin_poly32 =
+    select_minimax_poly32(c_asin_minimax_polys, FLT_EPSILON);
+
+ISA_REGION_BEGIN_AVX2
 
 FINLINE __m128d bool2mask_sd(bool b)
 {
@@ -30,7 +52,6 @@ FINLINE f64 sqrt_e(f64 in)
 
 FINLINE f64 sin_a(f64 in)
 {
-#if 1
     auto ternary = [](bool cond, f64 l, f64 r) {
         return _mm_blendv_pd(_mm_set_sd(r), _mm_set_sd(l), bool2mask_sd(cond));
     };
@@ -41,36 +62,9 @@ FINLINE f64 sin_a(f64 in)
     __m128d x = ternary(inseg > c_pi_half64, c_pi64 - inseg, inseg);
     __m128d x2 = _mm_mul_sd(x, x);
 
-    __m128d r = _mm_set_sd(0x1.883c1c5deffbep-49);
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(-0x1.ae43dc9bf8ba7p-41));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(0x1.6123ce513b09fp-33));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(-0x1.ae6454d960ac4p-26));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(0x1.71de3a52aab96p-19));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(-0x1.a01a01a014eb6p-13));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(0x1.11111111110c9p-7));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(-0x1.5555555555555p-3));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(0x1p0));
-    r = _mm_mul_sd(r, x);
+    __m128d r = odd_poly_sd<c_sin_poly64>(x2, x);
 
     return _mm_cvtsd_f64(_mm_mul_sd(ysign, r));
-#else
-    f64 posx = abs(in);
-    f64 x = posx > c_pi_half64 ? c_pi64 - posx : posx;
-    f64 x2 = x * x;
-
-    f64 r = 0x1.883c1c5deffbep-49;
-    r = fmadd(r, x2, -0x1.ae43dc9bf8ba7p-41);
-    r = fmadd(r, x2, 0x1.6123ce513b09fp-33);
-    r = fmadd(r, x2, -0x1.ae6454d960ac4p-26);
-    r = fmadd(r, x2, 0x1.71de3a52aab96p-19);
-    r = fmadd(r, x2, -0x1.a01a01a014eb6p-13);
-    r = fmadd(r, x2, 0x1.11111111110c9p-7);
-    r = fmadd(r, x2, -0x1.5555555555555p-3);
-    r = fmadd(r, x2, 0x1p0);
-    r *= x;
-
-    return in < 0.0 ? -r : r;
-#endif
 }
 
 FINLINE f64 cos_a(f64 in)
@@ -80,7 +74,6 @@ FINLINE f64 cos_a(f64 in)
 
 FINLINE f64 asin_a(f64 in)
 {
-#if 1
     __m128d cvt_mask = bool2mask_sd(in > c_1oversqrt2_64);
 
     __m128d insin = _mm_set_sd(in);
@@ -92,57 +85,393 @@ FINLINE f64 asin_a(f64 in)
     __m128d x = _mm_blendv_pd(insin, incos, cvt_mask);
     __m128d x2 = _mm_blendv_pd(insin2, incos2, cvt_mask);
 
-    __m128d r = _mm_set_sd(0x1.7f820d52c2775p-1);
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(-0x1.4d84801ff1aa1p1));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(0x1.14672d35db97ep2));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(-0x1.188f223fe5f34p2));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(0x1.86bbff2a6c7b6p1));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(-0x1.83633c76e4551p0));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(0x1.224c4dbe13cbdp-1));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(-0x1.2ab04ba9012e3p-3));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(0x1.5565a3d3908b9p-5));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(0x1.b1b8d27cd7e72p-8));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(0x1.dc086c5d99cdcp-7));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(0x1.1b8cc838ee86ep-6));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(0x1.6e96be6dbe49ep-6));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(0x1.f1c6b0ea300d7p-6));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(0x1.6db6dca9f82d4p-5));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(0x1.3333333148aa7p-4));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(0x1.555555555683fp-3));
-    r = _mm_fmadd_sd(r, x2, _mm_set_sd(0x1.fffffffffffffp-1));
-    r = _mm_mul_sd(r, x);
+    __m128d r = odd_poly_sd<c_asin_poly64>(x2, x);
 
     __m128d cr = _mm_sub_sd(_mm_set_sd(c_pi_half64), r);
     return _mm_cvtsd_f64(_mm_blendv_pd(r, cr, cvt_mask));
-#else
-    bool flip = in > c_1oversqrt2_64;
-    f64 x = flip ? sqrt_e(1.0 - in * in) : in;
-    f64 x2 = x * x;
-
-    f64 r = 0x1.7f820d52c2775p-1;
-    r = fmadd(r, x2, -0x1.4d84801ff1aa1p1);
-    r = fmadd(r, x2, 0x1.14672d35db97ep2);
-    r = fmadd(r, x2, -0x1.188f223fe5f34p2);
-    r = fmadd(r, x2, 0x1.86bbff2a6c7b6p1);
-    r = fmadd(r, x2, -0x1.83633c76e4551p0);
-    r = fmadd(r, x2, 0x1.224c4dbe13cbdp-1);
-    r = fmadd(r, x2, -0x1.2ab04ba9012e3p-3);
-    r = fmadd(r, x2, 0x1.5565a3d3908b9p-5);
-    r = fmadd(r, x2, 0x1.b1b8d27cd7e72p-8);
-    r = fmadd(r, x2, 0x1.dc086c5d99cdcp-7);
-    r = fmadd(r, x2, 0x1.1b8cc838ee86ep-6);
-    r = fmadd(r, x2, 0x1.6e96be6dbe49ep-6);
-    r = fmadd(r, x2, 0x1.f1c6b0ea300d7p-6);
-    r = fmadd(r, x2, 0x1.6db6dca9f82d4p-5);
-    r = fmadd(r, x2, 0x1.3333333148aa7p-4);
-    r = fmadd(r, x2, 0x1.555555555683fp-3);
-    r = fmadd(r, x2, 0x1.fffffffffffffp-1);
-    r *= x;
-    
-    return flip ? c_pi_half64 - r : r;
-#endif
 }
 
+// 4-wide versions of the sin_a/asin_a polynomials. Inputs must already be
+// range reduced: x in [-pi/2, pi/2] for sin, x2 = x*x in [0, 1/2] for asin.
+FINLINE __m256d sin_poly_pd(__m256d x)
+{
+    return odd_poly_pd<c_sin_poly64>(_mm256_mul_pd(x, x), x);
+}
+
+FINLINE __m256d asin_poly_pd(__m256d x2, __m256d x)
+{
+    return odd_poly_pd<c_asin_poly64>(x2, x);
+}
+
+FINLINE __m256d abs_pd(__m256d x)
+{
+    return _mm256_andnot_pd(_mm256_set1_pd(-0.0), x);
+}
+
+// Rows of 4 pairs {x0, y0, x1, y1} in, columns x0s, y0s, x1s, y1s out
+FINLINE void transpose4x4_pd(__m256d &r0, __m256d &r1, __m256d &r2, __m256d &r3)
+{
+    __m256d t0 = _mm256_unpacklo_pd(r0, r1); // x0a x0b x1a x1b
+    __m256d t1 = _mm256_unpackhi_pd(r0, r1); // y0a y0b y1a y1b
+    __m256d t2 = _mm256_unpacklo_pd(r2, r3); // x0c x0d x1c x1d
+    __m256d t3 = _mm256_unpackhi_pd(r2, r3); // y0c y0d y1c y1d
+    r0 = _mm256_permute2f128_pd(t0, t2, 0x20);
+    r1 = _mm256_permute2f128_pd(t1, t3, 0x20);
+    r2 = _mm256_permute2f128_pd(t0, t2, 0x31);
+    r3 = _mm256_permute2f128_pd(t1, t3, 0x31);
+}
+
+// 8-wide f32 polynomials, lower degree for the f32 budget. Same input
+// ranges as the f64 ones, max abs error ~1.5e-7 for both with f32 rounding.
+FINLINE __m256 sin_poly_ps(__m256 x)
+{
+    return odd_poly_ps<c_sin_poly32>(_mm256_mul_ps(x, x), x);
+}
+
+FINLINE __m256 asin_poly_ps(__m256 x2, __m256 x)
+{
+    return odd_poly_ps<c_asin_poly32>(x2, x);
+}
+
+FINLINE __m256 abs_ps(__m256 x)
+{
+    return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x);
+}
+
+// Same as transpose4x4_pd, but for 2 independent groups of 4 f32 pairs,
+// one per 128 bit lane
+FINLINE void transpose4x4_ps_lanes(__m256 &r0, __m256 &r1, __m256 &r2, __m256 &r3)
+{
+    __m256 t0 = _mm256_unpacklo_ps(r0, r1); // x0a x0b y0a y0b
+    __m256 t1 = _mm256_unpackhi_ps(r0, r1); // x1a x1b y1a y1b
+    __m256 t2 = _mm256_unpacklo_ps(r2, r3); // x0c x0d y0c y0d
+    __m256 t3 = _mm256_unpackhi_ps(r2, r3); // x1c x1d y1c y1d
+    r0 = _mm256_shuffle_ps(t0, t2, 0x44);
+    r1 = _mm256_shuffle_ps(t0, t2, 0xEE);
+    r2 = _mm256_shuffle_ps(t1, t3, 0x44);
+    r3 = _mm256_shuffle_ps(t1, t3, 0xEE);
+}
+
+ISA_REGION_END
+
+ISA_REGION_BEGIN_AVX512
+
+// 8-wide versions, same polynomials and input ranges as the 4-wide ones
+FINLINE __m512d sin_poly_pd512(__m512d x)
+{
+    return odd_poly_pd512<c_sin_poly64>(_mm512_mul_pd(x, x), x);
+}
+
+FINLINE __m512d asin_poly_pd512(__m512d x2, __m512d x)
+{
+    return odd_poly_pd512<c_asin_poly64>(x2, x);
+}
+
+ISA_REGION_END
+
+// Batch array api: out[i] = f(in[i]) for i < cnt, in and out may alias
+// exactly. Same domains as libm on every path: sin and cos take any x,
+// asin [-1, 1], sqrt x >= 0. Unlike the scalar sin_a/cos_a, sin and cos
+// are range reduced, x - n*pi against pi split in 2, which stays within
+// the error budget for |x| <= c_batch_trig_max_reduced. Lanes past that
+// (and inf) go through libm. Any alignment/count, heads and tails are
+// masked.
+
+inline constexpr f64 c_batch_trig_max_reduced = 0x1.0p30;
+
+ISA_REGION_BEGIN_AVX2
+
+// x - q*pi for integer or half integer q
+FINLINE __m256d sub_pi_multiple_pd(__m256d x, __m256d q)
+{
+    __m256d r = _mm256_fnmadd_pd(q, _mm256_set1_pd(c_pi64), x);
+    return _mm256_fnmadd_pd(q, _mm256_set1_pd(c_pi_lo64), r);
+}
+
+// Sign bit for odd integer n, the low mantissa bit after adding 1.5*2^52
+FINLINE __m256d odd_sign_pd(__m256d n)
+{
+    __m256i const bits = _mm256_castpd_si256(
+        _mm256_add_pd(n, _mm256_set1_pd(0x1.8p52)));
+    return _mm256_castsi256_pd(_mm256_slli_epi64(bits, 63));
+}
+
+// Lanes too large to reduce are redone with libm, rare enough to spill
+FINLINE __m256d fix_unreduced_pd(__m256d in, __m256d r, f64 (*libm_func)(f64))
+{
+    int const big = _mm256_movemask_pd(_mm256_cmp_pd(
+        abs_pd(in), _mm256_set1_pd(c_batch_trig_max_reduced), _CMP_GT_OQ));
+    if (!big)
+        return r;
+    alignas(32) f64 xs[4], rs[4];
+    _mm256_store_pd(xs, in);
+    _mm256_store_pd(rs, r);
+    for (u32 l = 0; l < 4; ++l) {
+        if (big & (1 << l))
+            rs[l] = libm_func(xs[l]);
+    }
+    return _mm256_load_pd(rs);
+}
+
+// sin(x) = (-1)^n sin(x - n*pi), n = round(x/pi)
+FINLINE __m256d sin_pd(__m256d in)
+{
+    __m256d const n = _mm256_round_pd(
+        _mm256_mul_pd(in, _mm256_set1_pd(c_1overpi64)),
+        _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d const r = _mm256_xor_pd(
+        sin_poly_pd(sub_pi_multiple_pd(in, n)), odd_sign_pd(n));
+    return fix_unreduced_pd(in, r, &sin);
+}
+
+// cos(x) = sin(x + pi/2) = (-1)^n sin(x - (n - 1/2)*pi),
+// n = round(x/pi + 1/2)
+FINLINE __m256d cos_pd(__m256d in)
+{
+    __m256d const half = _mm256_set1_pd(0.5);
+    __m256d const n = _mm256_round_pd(
+        _mm256_fmadd_pd(in, _mm256_set1_pd(c_1overpi64), half),
+        _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d const r = _mm256_xor_pd(
+        sin_poly_pd(sub_pi_multiple_pd(in, _mm256_sub_pd(n, half))),
+        odd_sign_pd(n));
+    return fix_unreduced_pd(in, r, &cos);
+}
+
+FINLINE __m256d asin_pd(__m256d in)
+{
+    __m256d const one = _mm256_set1_pd(1.0);
+    __m256d sign = _mm256_and_pd(in, _mm256_set1_pd(-0.0));
+    __m256d a = abs_pd(in);
+    __m256d cvt_mask = _mm256_cmp_pd(
+        a, _mm256_set1_pd(c_1oversqrt2_64), _CMP_GT_OQ);
+    __m256d a2 = _mm256_mul_pd(a, a);
+    __m256d x2 = _mm256_blendv_pd(a2, _mm256_sub_pd(one, a2), cvt_mask);
+    __m256d x = _mm256_blendv_pd(a, _mm256_sqrt_pd(x2), cvt_mask);
+    __m256d r = asin_poly_pd(x2, x);
+    r = _mm256_blendv_pd(
+        r, _mm256_sub_pd(_mm256_set1_pd(c_pi_half64), r), cvt_mask);
+    return _mm256_xor_pd(r, sign);
+}
+
+FINLINE __m256i first_n_mask_pd(usize n)
+{
+    return _mm256_cmpgt_epi64(
+        _mm256_set1_epi64x(i64(n)), _mm256_setr_epi64x(0, 1, 2, 3));
+}
+
+FINLINE __m256d sqrt_pd(__m256d in)
+{
+    return _mm256_sqrt_pd(in);
+}
+
+// Masked head up to 32 byte store alignment, aligned full vectors, masked
+// tail. Masked-off lanes read as 0, which is in every function's domain.
+// The op is a template argument, not a lambda: a lambda's function pointer
+// thunk is emitted outside the isa region, with the other vector abi.
+template <__m256d (*t_op)(__m256d)>
+FINLINE void apply_batch_pd(f64 const *in, f64 *out, usize cnt)
+{
+    usize head = 0;
+    if ((usize(out) & 7) == 0)
+        head = min(cnt, ((32 - (usize(out) & 31)) & 31) / sizeof(f64));
+    if (head) {
+        __m256i mask = first_n_mask_pd(head);
+        _mm256_maskstore_pd(out, mask, t_op(_mm256_maskload_pd(in, mask)));
+    }
+
+    usize i = head;
+    if ((usize(out + i) & 31) == 0) {
+        for (; i + 4 <= cnt; i += 4)
+            _mm256_store_pd(out + i, t_op(_mm256_loadu_pd(in + i)));
+    } else {
+        for (; i + 4 <= cnt; i += 4)
+            _mm256_storeu_pd(out + i, t_op(_mm256_loadu_pd(in + i)));
+    }
+
+    if (i < cnt) {
+        __m256i mask = first_n_mask_pd(cnt - i);
+        _mm256_maskstore_pd(
+            out + i, mask, t_op(_mm256_maskload_pd(in + i, mask)));
+    }
+}
+
+inline void sin_batch_avx2(f64 const *in, f64 *out, usize cnt)
+{
+    apply_batch_pd<&sin_pd>(in, out, cnt);
+}
+
+inline void cos_batch_avx2(f64 const *in, f64 *out, usize cnt)
+{
+    apply_batch_pd<&cos_pd>(in, out, cnt);
+}
+
+inline void asin_batch_avx2(f64 const *in, f64 *out, usize cnt)
+{
+    apply_batch_pd<&asin_pd>(in, out, cnt);
+}
+
+inline void sqrt_batch_avx2(f64 const *in, f64 *out, usize cnt)
+{
+    apply_batch_pd<&sqrt_pd>(in, out, cnt);
+}
+
+ISA_REGION_END
+
+ISA_REGION_BEGIN_AVX512
+
+FINLINE __m512d sub_pi_multiple_pd512(__m512d x, __m512d q)
+{
+    __m512d r = _mm512_fnmadd_pd(q, _mm512_set1_pd(c_pi64), x);
+    return _mm512_fnmadd_pd(q, _mm512_set1_pd(c_pi_lo64), r);
+}
+
+FINLINE __m512d odd_sign_pd512(__m512d n)
+{
+    __m512i const bits = _mm512_castpd_si512(
+        _mm512_add_pd(n, _mm512_set1_pd(0x1.8p52)));
+    return _mm512_castsi512_pd(_mm512_slli_epi64(bits, 63));
+}
+
+FINLINE __m512d fix_unreduced_pd512(
+    __m512d in, __m512d r, f64 (*libm_func)(f64))
+{
+    __mmask8 const big = _mm512_cmp_pd_mask(_mm512_abs_pd(in),
+        _mm512_set1_pd(c_batch_trig_max_reduced), _CMP_GT_OQ);
+    if (!big)
+        return r;
+    alignas(64) f64 xs[8], rs[8];
+    _mm512_store_pd(xs, in);
+    _mm512_store_pd(rs, r);
+    for (u32 l = 0; l < 8; ++l) {
+        if (big & (1 << l))
+            rs[l] = libm_func(xs[l]);
+    }
+    return _mm512_load_pd(rs);
+}
+
+FINLINE __m512d sin_pd512(__m512d in)
+{
+    __m512d const n = _mm512_roundscale_pd(
+        _mm512_mul_pd(in, _mm512_set1_pd(c_1overpi64)),
+        _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512d const r = _mm512_xor_pd(
+        sin_poly_pd512(sub_pi_multiple_pd512(in, n)), odd_sign_pd512(n));
+    return fix_unreduced_pd512(in, r, &sin);
+}
+
+FINLINE __m512d cos_pd512(__m512d in)
+{
+    __m512d const half = _mm512_set1_pd(0.5);
+    __m512d const n = _mm512_roundscale_pd(
+        _mm512_fmadd_pd(in, _mm512_set1_pd(c_1overpi64), half),
+        _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512d const r = _mm512_xor_pd(
+        sin_poly_pd512(sub_pi_multiple_pd512(in, _mm512_sub_pd(n, half))),
+        odd_sign_pd512(n));
+    return fix_unreduced_pd512(in, r, &cos);
+}
+
+FINLINE __m512d asin_pd512(__m512d in)
+{
+    __m512d const one = _mm512_set1_pd(1.0);
+    __m512d sign = _mm512_and_pd(in, _mm512_set1_pd(-0.0));
+    __m512d a = _mm512_abs_pd(in);
+    __mmask8 cvt_mask = _mm512_cmp_pd_mask(
+        a, _mm512_set1_pd(c_1oversqrt2_64), _CMP_GT_OQ);
+    __m512d a2 = _mm512_mul_pd(a, a);
+    __m512d x2 = _mm512_mask_sub_pd(a2, cvt_mask, one, a2);
+    __m512d x = _mm512_mask_sqrt_pd(a, cvt_mask, x2);
+    __m512d r = asin_poly_pd512(x2, x);
+    r = _mm512_mask_sub_pd(r, cvt_mask, _mm512_set1_pd(c_pi_half64), r);
+    return _mm512_xor_pd(r, sign);
+}
+
+FINLINE __m512d sqrt_pd512(__m512d in)
+{
+    return _mm512_sqrt_pd(in);
+}
+
+template <__m512d (*t_op)(__m512d)>
+FINLINE void apply_batch_pd512(f64 const *in, f64 *out, usize cnt)
+{
+    usize head = 0;
+    if ((usize(out) & 7) == 0)
+        head = min(cnt, ((64 - (usize(out) & 63)) & 63) / sizeof(f64));
+    if (head) {
+        __mmask8 mask = __mmask8((1u << head) - 1);
+        _mm512_mask_storeu_pd(out, mask, t_op(_mm512_maskz_loadu_pd(mask, in)));
+    }
+
+    usize i = head;
+    if ((usize(out + i) & 63) == 0) {
+        for (; i + 8 <= cnt; i += 8)
+            _mm512_store_pd(out + i, t_op(_mm512_loadu_pd(in + i)));
+    } else {
+        for (; i + 8 <= cnt; i += 8)
+            _mm512_storeu_pd(out + i, t_op(_mm512_loadu_pd(in + i)));
+    }
+
+    if (i < cnt) {
+        __mmask8 mask = __mmask8((1u << (cnt - i)) - 1);
+        _mm512_mask_storeu_pd(
+            out + i, mask, t_op(_mm512_maskz_loadu_pd(mask, in + i)));
+    }
+}
+
+inline void sin_batch_avx512(f64 const *in, f64 *out, usize cnt)
+{
+    apply_batch_pd512<&sin_pd512>(in, out, cnt);
+}
+
+inline void cos_batch_avx512(f64 const *in, f64 *out, usize cnt)
+{
+    apply_batch_pd512<&cos_pd512>(in, out, cnt);
+}
+
+inline void asin_batch_avx512(f64 const *in, f64 *out, usize cnt)
+{
+    apply_batch_pd512<&asin_pd512>(in, out, cnt);
+}
+
+inline void sqrt_batch_avx512(f64 const *in, f64 *out, usize cnt)
+{
+    apply_batch_pd512<&sqrt_pd512>(in, out, cnt);
+}
+
+ISA_REGION_END
+
+// Dispatched on the cpu, libm per element without avx2. Detected on first
+// use, not in the static init of every includer.
+inline isa_level_t get_batch_math_isa()
+{
+    static isa_level_t const isa = best_isa_level(detect_cpu_features());
+    return isa;
+}
+
+#define BATCH_MATH_FUNC(name_, libm_func_)                     \
+    inline void name_##_batch(f64 const *in, f64 *out, usize cnt) \
+    {                                                          \
+        switch (get_batch_math_isa()) {                        \
+        case e_isa_avx512:                                     \
+            name_##_batch_avx512(in, out, cnt);                \
+            break;                                             \
+        case e_isa_avx2:                                       \
+            name_##_batch_avx2(in, out, cnt);                  \
+            break;                                             \
+        default:                                               \
+            for (usize i = 0; i < cnt; ++i)                    \
+                out[i] = libm_func_(in[i]);                    \
+        }                                                      \
+    }
+
+BATCH_MATH_FUNC(sin, sin)
+BATCH_MATH_FUNC(cos, cos)
+BATCH_MATH_FUNC(asin, asin)
+BATCH_MATH_FUNC(sqrt, sqrt)
+
+#undef BATCH_MATH_FUNC
+
 // Range test stuff
 struct function_input_range_t {
     f64 min = DBL_MAX, max = -DBL_MAX;
@@ -0,0 +1,260 @@
+#pragma once
+
+#include "haversine_math.hpp"
+#include "haversine_parallel.hpp"
+
+#include <buffer.hpp>
+#include <cpuid.hpp>
+#include <logging.hpp>
+#include <defs.hpp>
+
+// All-pairs N x M distances between two point sets. Everything that depends
+// on one point only is done once per point: points become unit vectors, and
+// the distance is 2R * asin(|a - b| / 2), or 2R * (pi/2 - asin(|a + b| / 2))
+// past 90 degrees, which keeps the asin argument in the minimax range and
+// never subtracts two close numbers. That leaves 6 fmas, a sqrt and the asin
+// polynomial per entry.
+//
+// The matrix is produced in tiles and handed to a sink per row segment
+// (row, first col, dists, cnt), so it never has to exist in memory. Sinks
+// are called from worker threads; each row belongs to one thread.
+
+struct haversine_point_set_t {
+    buffer_t buffer;
+    // SoA, padded to a multiple of 8 with zero vectors
+    f64 *x;
+    f64 *y;
+    f64 *z;
+    u64 cnt;
+};
+
+inline void cleanup_haversine_point_set(haversine_point_set_t &ps)
+{
+    deallocate(ps.buffer);
+    ps = {};
+}
+
+// Same convention as haversine_dist_naive, x is the latitude. stride is in
+// f64s, so pairs can be read in place:
+// make_haversine_point_set(ps, &pairs[0].x0, &pairs[0].y0, cnt, 4)
+inline bool make_haversine_point_set(
+    haversine_point_set_t &ps, f64 const *xs, f64 const *ys,
+    u64 cnt, u64 stride)
+{
+    constexpr f64 c_deg2rad = c_pi64 / 180.0;
+
+    u64 const padded_cnt = round_up(max(cnt, u64(1)), u64(8));
+    ps.buffer = allocate_best(3 * padded_cnt * sizeof(f64));
+    if (!is_valid(ps.buffer)) {
+        LOGERR("Failed to allocate point set for %llu points",
+            (unsigned long long)cnt);
+        return false;
+    }
+
+    ps.x = (f64 *)ps.buffer.data;
+    ps.y = ps.x + padded_cnt;
+    ps.z = ps.y + padded_cnt;
+    ps.cnt = cnt;
+
+    for (u64 i = 0; i < cnt; ++i) {
+        f64 const lat = xs[i * stride] * c_deg2rad;
+        f64 const lon = ys[i * stride] * c_deg2rad;
+        f64 const cos_lat = cos(lat);
+        ps.x[i] = cos_lat * cos(lon);
+        ps.y[i] = cos_lat * sin(lon);
+        ps.z[i] = sin(lat);
+    }
+    for (u64 i = cnt; i < padded_cnt; ++i)
+        ps.x[i] = ps.y[i] = ps.z[i] = 0.0;
+
+    return true;
+}
+
+inline f64 haversine_dist_unit(
+    f64 ax, f64 ay, f64 az, f64 bx, f64 by, f64 bz)
+{
+    f64 const dx = bx - ax, dy = by - ay, dz = bz - az;
+    f64 const sx = bx + ax, sy = by + ay, sz = bz + az;
+    f64 const d2 = dx * dx + dy * dy + dz * dz;
+    f64 const s2 = sx * sx + sy * sy + sz * sz;
+    f64 const half_angle = d2 <= s2 ?
+        asin(0.5 * sqrt(d2)) : c_pi_half64 - asin(0.5 * sqrt(s2));
+    return 2.0 * c_earth_rad64 * half_angle;
+}
+
+// Columns per tile: their 12KB of vectors stay in L1 while a block of rows
+// sweeps over them, and a row segment of output is 4KB
+inline constexpr u64 c_haversine_matrix_tile_cols = 512;
+// Rows per block, a block is the unit of work for threads
+inline constexpr u64 c_haversine_matrix_tile_rows = 64;
+
+using haversine_matrix_segment_func_t = void (*)(
+    haversine_point_set_t const &rows, u64 row,
+    haversine_point_set_t const &cols, u64 col_begin, u64 cnt, f64 *out);
+
+inline void calculate_haversine_matrix_segment_scalar(
+    haversine_point_set_t const &rows, u64 row,
+    haversine_point_set_t const &cols, u64 col_begin, u64 cnt, f64 *out)
+{
+    for (u64 j = 0; j < cnt; ++j) {
+        u64 const c = col_begin + j;
+        out[j] = haversine_dist_unit(
+            rows.x[row], rows.y[row], rows.z[row],
+            cols.x[c], cols.y[c], cols.z[c]);
+    }
+}
+
+ISA_REGION_BEGIN_AVX2
+
+FINLINE __m256d haversine_dist_unit_4x(
+    __m256d ax, __m256d ay, __m256d az, __m256d bx, __m256d by, __m256d bz)
+{
+    __m256d const dx = _mm256_sub_pd(bx, ax);
+    __m256d const dy = _mm256_sub_pd(by, ay);
+    __m256d const dz = _mm256_sub_pd(bz, az);
+    __m256d const sx = _mm256_add_pd(bx, ax);
+    __m256d const sy = _mm256_add_pd(by, ay);
+    __m256d const sz = _mm256_add_pd(bz, az);
+    __m256d const d2 = _mm256_fmadd_pd(dz, dz,
+        _mm256_fmadd_pd(dy, dy, _mm256_mul_pd(dx, dx)));
+    __m256d const s2 = _mm256_fmadd_pd(sz, sz,
+        _mm256_fmadd_pd(sy, sy, _mm256_mul_pd(sx, sx)));
+
+    // min(d2, s2) <= 2, so x <= 1/sqrt(2)
+    __m256d const far = _mm256_cmp_pd(d2, s2, _CMP_GT_OQ);
+    __m256d const x2 = _mm256_mul_pd(
+        _mm256_blendv_pd(d2, s2, far), _mm256_set1_pd(0.25));
+    __m256d const x = _mm256_sqrt_pd(x2);
+    __m256d r = asin_poly_pd(x2, x);
+    r = _mm256_blendv_pd(
+        r, _mm256_sub_pd(_mm256_set1_pd(c_pi_half64), r), far);
+
+    return _mm256_mul_pd(_mm256_set1_pd(c_earth_rad64 * 2.0), r);
+}
+
+// Reads up to 7 padding columns past cnt, out must have room for them
+inline void calculate_haversine_matrix_segment_avx2(
+    haversine_point_set_t const &rows, u64 row,
+    haversine_point_set_t const &cols, u64 col_begin, u64 cnt, f64 *out)
+{
+    __m256d const ax = _mm256_set1_pd(rows.x[row]);
+    __m256d const ay = _mm256_set1_pd(rows.y[row]);
+    __m256d const az = _mm256_set1_pd(rows.z[row]);
+
+    f64 const *bx = cols.x + col_begin;
+    f64 const *by = cols.y + col_begin;
+    f64 const *bz = cols.z + col_begin;
+
+    // 2 independent chains to hide the asin polynomial latency
+    for (u64 j = 0; j < cnt; j += 8) {
+        __m256d const d0 = haversine_dist_unit_4x(ax, ay, az,
+            _mm256_loadu_pd(bx + j), _mm256_loadu_pd(by + j),
+            _mm256_loadu_pd(bz + j));
+        __m256d const d1 = haversine_dist_unit_4x(ax, ay, az,
+            _mm256_loadu_pd(bx + j + 4), _mm256_loadu_pd(by + j + 4),
+            _mm256_loadu_pd(bz + j + 4));
+        _mm256_storeu_pd(out + j, d0);
+        _mm256_storeu_pd(out + j + 4, d1);
+    }
+}
+
+ISA_REGION_END
+
+// Row blocks are the unit of work, all tiles cost the same
+template <class TSink>
+inline bool calculate_haversine_matrix(
+    haversine_point_set_t const &rows, haversine_point_set_t const &cols,
+    isa_level_t isa, u32 thread_cnt, TSink &sink)
+{
+    haversine_matrix_segment_func_t const segment_func =
+        isa >= e_isa_avx2 ?
+            &calculate_haversine_matrix_segment_avx2 :
+            &calculate_haversine_matrix_segment_scalar;
+
+    auto process_block = [&](u64 b) {
+        alignas(32) f64 segment[c_haversine_matrix_tile_cols];
+
+        u64 const row_begin = b * c_haversine_matrix_tile_rows;
+        u64 const row_end =
+            min(row_begin + c_haversine_matrix_tile_rows, rows.cnt);
+        for (u64 c = 0; c < cols.cnt; c += c_haversine_matrix_tile_cols) {
+            u64 const cnt = min(c_haversine_matrix_tile_cols, cols.cnt - c);
+            for (u64 r = row_begin; r < row_end; ++r) {
+                (*segment_func)(rows, r, cols, c, cnt, segment);
+                sink(r, c, (f64 const *)segment, cnt);
+            }
+        }
+    };
+
+    u64 const block_cnt = (rows.cnt + c_haversine_matrix_tile_rows - 1) /
+        c_haversine_matrix_tile_rows;
+    return run_haversine_parallel(block_cnt, thread_cnt, process_block);
+}
+
+// k nearest columns per row, as a sink for calculate_haversine_matrix
+
+struct haversine_neighbour_t {
+    f64 dist;
+    u64 idx;
+};
+
+struct haversine_top_k_t {
+    buffer_t buffer;
+    // row_cnt x k, ascending by dist, unfilled slots have dist = DBL_MAX
+    haversine_neighbour_t *neighbours;
+    u64 row_cnt;
+    u32 k;
+};
+
+// Empties every row, for reusing the table across runs
+inline void reset_haversine_top_k(haversine_top_k_t &tk)
+{
+    for (u64 i = 0; i < tk.row_cnt * tk.k; ++i)
+        tk.neighbours[i] = {DBL_MAX, ~u64(0)};
+}
+
+inline bool init_haversine_top_k(haversine_top_k_t &tk, u64 row_cnt, u32 k)
+{
+    assert(k > 0);
+    tk.buffer = allocate_best(row_cnt * k * sizeof(haversine_neighbour_t));
+    if (!is_valid(tk.buffer)) {
+        LOGERR("Failed to allocate top-%u for %llu rows",
+            k, (unsigned long long)row_cnt);
+        return false;
+    }
+    tk.neighbours = (haversine_neighbour_t *)tk.buffer.data;
+    tk.row_cnt = row_cnt;
+    tk.k = k;
+    reset_haversine_top_k(tk);
+    return true;
+}
+
+inline void cleanup_haversine_top_k(haversine_top_k_t &tk)
+{
+    deallocate(tk.buffer);
+    tk = {};
+}
+
+// Sorted insertion, k is expected to be small and most candidates fail the
+// first compare against the current k-th distance
+FINLINE void insert_haversine_neighbour(
+    haversine_neighbour_t *best, u32 k, f64 dist, u64 idx)
+{
+    if (dist >= best[k - 1].dist)
+        return;
+    u32 pos = k - 1;
+    for (; pos > 0 && best[pos - 1].dist > dist; --pos)
+        best[pos] = best[pos - 1];
+    best[pos] = {dist, idx};
+}
+
+struct haversine_top_k_sink_t {
+    haversine_top_k_t *tk;
+
+    void operator()(u64 row, u64 col_begin, f64 const *dists, u64 cnt) const
+    {
+        haversine_neighbour_t *best = tk->neighbours + row * tk->k;
+        for (u64 j = 0; j < cnt; ++j)
+            insert_haversine_neighbour(best, tk->k, dists[j], col_begin + j);
+    }
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <threads.hpp>
+#include <logging.hpp>
+#include <defs.hpp>
+
+// Blocks of work are dealt to threads round-robin, the calling thread is
+// one of them. func(block) must be safe to call concurrently for different
+// blocks.
+
+inline constexpr u32 c_haversine_max_threads = 256;
+
+template <class TFunc>
+struct haversine_parallel_job_t {
+    TFunc *func;
+    u64 block_cnt;
+    u32 thread_id;
+    u32 thread_cnt;
+};
+
+template <class TFunc>
+inline void run_haversine_parallel_job(
+    haversine_parallel_job_t<TFunc> const &job)
+{
+    for (u64 b = job.thread_id; b < job.block_cnt; b += job.thread_cnt)
+        (*job.func)(b);
+}
+
+template <class TFunc>
+static THREAD_ENTRY(haversine_parallel_worker, payload)
+{
+    run_haversine_parallel_job(*(haversine_parallel_job_t<TFunc> const *)payload);
+    return 0;
+}
+
+template <class TFunc>
+inline bool run_haversine_parallel(u64 block_cnt, u32 thread_cnt, TFunc &func)
+{
+    thread_cnt = clamp(thread_cnt, u32(1), c_haversine_max_threads);
+
+    haversine_parallel_job_t<TFunc> jobs[c_haversine_max_threads];
+    os_thread_t threads[c_haversine_max_threads] = {};
+    for (u32 t = 0; t < thread_cnt; ++t)
+        jobs[t] = {&func, block_cnt, t, thread_cnt};
+
+    bool ok = true;
+    for (u32 t = 1; t < thread_cnt; ++t) {
+        threads[t] =
+            os_spawn_thread(&haversine_parallel_worker<TFunc>, &jobs[t]);
+        if (!is_valid(threads[t])) {
+            LOGERR("Failed to spawn worker %u", t);
+            ok = false;
+            break;
+        }
+    }
+    if (ok)
+        run_haversine_parallel_job(jobs[0]);
+    for (u32 t = 1; t < thread_cnt; ++t) {
+        if (is_valid(threads[t]))
+            os_join_thread(threads[t]);
+    }
+    return ok;
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include "haversine_common.hpp"
+#include "haversine_state.hpp"
+
+#include <defs.hpp>
+#include <logging.hpp>
+
+#if _WIN32
+#error "Haversine service is only implemented for posix"
+#endif
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Binary framing, native endianness (the service is local only).
+// Request:  header, then pair_cnt * point_pair_t for e_hsmt_batch
+// Response: reply header, then pair_cnt * f64 distances for e_hsmt_batch,
+//           or a haversine_service_stats_t for e_hsmt_stats
+
+inline constexpr u32 c_haversine_service_magic = 0x48565253; // HVRS
+inline constexpr char c_haversine_service_default_socket[] =
+    "/tmp/haversine.sock";
+
+enum haversine_service_msg_type_t : u32 {
+    e_hsmt_batch = 1,
+    e_hsmt_stats = 2,
+    e_hsmt_shutdown = 3,
+};
+
+enum haversine_service_status_t : u32 {
+    e_hss_ok = 0,
+    e_hss_batch_too_large = 1,
+    e_hss_invalid_request = 2,
+};
+
+struct haversine_service_header_t {
+    u32 magic;
+    haversine_service_msg_type_t type;
+    u64 pair_cnt;
+};
+
+struct haversine_service_reply_t {
+    u32 magic;
+    haversine_service_status_t status;
+    u64 pair_cnt;
+    f64 sum;
+};
+
+struct haversine_service_stats_t {
+    u64 batch_count;
+    u64 pair_count;
+    f64 p50_sec;
+    f64 p99_sec;
+    f64 max_sec;
+};
+
+// Per-batch latency, over a window of the last c_window batches
+struct haversine_latency_tracker_t {
+    static constexpr u32 c_window = 1 << 14;
+
+    u64 ticks[c_window];
+    u64 batch_count;
+    u64 pair_count;
+    u64 max_ticks;
+};
+
+inline void record_batch(
+    haversine_latency_tracker_t &t, u64 ticks, u64 pair_cnt)
+{
+    t.ticks[t.batch_count++ % t.c_window] = ticks;
+    t.pair_count += pair_cnt;
+    t.max_ticks = max(t.max_ticks, ticks);
+}
+
+inline haversine_service_stats_t calculate_service_stats(
+    haversine_latency_tracker_t const &t, u64 cpu_timer_freq)
+{
+    haversine_service_stats_t stats = {};
+    stats.batch_count = t.batch_count;
+    stats.pair_count = t.pair_count;
+    stats.max_sec = ticks_to_sec(t.max_ticks, cpu_timer_freq);
+
+    u64 const cnt = min(t.batch_count, u64(t.c_window));
+    if (cnt == 0)
+        return stats;
+
+    static u64 sorted[haversine_latency_tracker_t::c_window];
+    memcpy(sorted, t.ticks, cnt * sizeof(u64));
+    qsort(sorted, cnt, sizeof(u64), [](void const *a, void const *b) {
+        u64 const l = *(u64 const *)a, r = *(u64 const *)b;
+        return l < r ? -1 : (l > r ? 1 : 0);
+    });
+
+    stats.p50_sec = ticks_to_sec(sorted[(cnt - 1) / 2], cpu_timer_freq);
+    stats.p99_sec = ticks_to_sec(sorted[(cnt - 1) * 99 / 100], cpu_timer_freq);
+    return stats;
+}
+
+inline void print_service_stats(haversine_service_stats_t const &stats)
+{
+    fprintf(stderr,
+        "Batches=%llu Pairs=%llu P50=%.3lfus P99=%.3lfus Max=%.3lfus\n",
+        (unsigned long long)stats.batch_count,
+        (unsigned long long)stats.pair_count,
+        stats.p50_sec * 1e6, stats.p99_sec * 1e6, stats.max_sec * 1e6);
+}
+
+// Blocking full-length io over pipes and stream sockets
+inline bool read_full(int fd, void *buf, usize bytes)
+{
+    u8 *p = (u8 *)buf;
+    while (bytes > 0) {
+        isize res = read(fd, p, bytes);
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res <= 0)
+            return false;
+        p += res;
+        bytes -= usize(res);
+    }
+    return true;
+}
+
+inline bool write_full(int fd, void const *buf, usize bytes)
+{
+    u8 const *p = (u8 const *)buf;
+    while (bytes > 0) {
+        isize res = write(fd, p, bytes);
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res <= 0)
+            return false;
+        p += res;
+        bytes -= usize(res);
+    }
+    return true;
+}
+
+inline int open_service_listen_socket(char const *path)
+{
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        LOGERR("Socket path '%s' is too long", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        LOGERR("Failed to create socket, error: %s", strerror(errno));
+        return -1;
+    }
+
+    unlink(path);
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(fd, 16) != 0)
+    {
+        LOGERR("Failed to listen on '%s', error: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+inline int connect_service_socket(char const *path)
+{
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        LOGERR("Socket path '%s' is too long", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        LOGERR("Failed to create socket, error: %s", strerror(errno));
+        return -1;
+    }
+
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0) {
+        LOGERR("Failed to connect to '%s', error: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
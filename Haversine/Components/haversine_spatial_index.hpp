@@ -0,0 +1,309 @@
+#pragma once
+
+#include "haversine_matrix.hpp"
+
+#include <buffer.hpp>
+#include <logging.hpp>
+#include <defs.hpp>
+
+// k-d tree over the unit vectors of a point set, for batched k-NN and radius
+// queries. Great-circle distance is monotonic in chord length, so the tree
+// prunes with plain 3D box distances against the chord of the current
+// search radius, and only the points of leaves that survive go through the
+// matrix segment kernel. Points are stored in tree order, so a leaf is a
+// contiguous SoA range and the kernel runs over it as is.
+
+// Multiple of 8, the avx2 segment kernel works in 8s
+inline constexpr u32 c_haversine_index_leaf_size = 32;
+
+struct haversine_index_node_t {
+    f64 lo[3];
+    f64 hi[3];
+    u32 begin, end; // Point range in tree order
+    u32 left;       // 0 for leaves, the root is never a child
+    u32 right;
+};
+
+struct haversine_spatial_index_t {
+    buffer_t ids_buffer;
+    buffer_t nodes_buffer;
+    haversine_point_set_t points; // In tree order
+    u32 *ids;                     // Tree order -> original index
+    haversine_index_node_t *nodes;
+    u32 node_cnt;
+};
+
+inline void cleanup_haversine_spatial_index(haversine_spatial_index_t &idx)
+{
+    cleanup_haversine_point_set(idx.points);
+    deallocate(idx.ids_buffer);
+    deallocate(idx.nodes_buffer);
+    idx = {};
+}
+
+inline f64 const *haversine_point_axis(haversine_point_set_t const &ps, u32 a)
+{
+    return a == 0 ? ps.x : a == 1 ? ps.y : ps.z;
+}
+
+// Hoare quickselect on perm by key, leaves perm[nth] in its sorted place
+inline void select_nth_by_key(u32 *perm, f64 const *key, i64 lo, i64 hi, i64 nth)
+{
+    while (hi - lo > 1) {
+        f64 const pivot = key[perm[lo + (hi - lo) / 2]];
+        i64 i = lo, j = hi - 1;
+        while (i <= j) {
+            while (key[perm[i]] < pivot)
+                ++i;
+            while (key[perm[j]] > pivot)
+                --j;
+            if (i <= j) {
+                u32 const tmp = perm[i];
+                perm[i++] = perm[j];
+                perm[j--] = tmp;
+            }
+        }
+        if (nth <= j)
+            hi = j + 1;
+        else if (nth >= i)
+            lo = i;
+        else
+            return;
+    }
+}
+
+inline u32 build_haversine_index_node(
+    haversine_spatial_index_t &idx, haversine_point_set_t const &src,
+    u32 *perm, u32 begin, u32 end)
+{
+    u32 const id = idx.node_cnt++;
+    haversine_index_node_t &node = idx.nodes[id];
+    node.begin = begin;
+    node.end = end;
+    node.left = node.right = 0;
+
+    for (u32 a = 0; a < 3; ++a) {
+        f64 const *coord = haversine_point_axis(src, a);
+        node.lo[a] = DBL_MAX;
+        node.hi[a] = -DBL_MAX;
+        for (u32 i = begin; i < end; ++i) {
+            node.lo[a] = min(node.lo[a], coord[perm[i]]);
+            node.hi[a] = max(node.hi[a], coord[perm[i]]);
+        }
+    }
+
+    if (end - begin <= c_haversine_index_leaf_size)
+        return id;
+
+    u32 axis = 0;
+    for (u32 a = 1; a < 3; ++a) {
+        if (node.hi[a] - node.lo[a] > node.hi[axis] - node.lo[axis])
+            axis = a;
+    }
+
+    // Split on a multiple of the leaf size, so leaves are mostly full
+    u32 const half = (end - begin) / 2;
+    u32 const mid = begin +
+        max(round_down(half, c_haversine_index_leaf_size),
+            c_haversine_index_leaf_size);
+    select_nth_by_key(perm, haversine_point_axis(src, axis), begin, end, mid);
+
+    u32 const left = build_haversine_index_node(idx, src, perm, begin, mid);
+    u32 const right = build_haversine_index_node(idx, src, perm, mid, end);
+    idx.nodes[id].left = left;
+    idx.nodes[id].right = right;
+    return id;
+}
+
+inline bool build_haversine_spatial_index(
+    haversine_spatial_index_t &idx, haversine_point_set_t const &src)
+{
+    if (src.cnt == 0 || src.cnt > u64(UINT32_MAX)) {
+        LOGERR("Spatial index needs 1..2^32-1 points, got %llu",
+            (unsigned long long)src.cnt);
+        return false;
+    }
+
+    u32 const cnt = u32(src.cnt);
+    u64 const padded_cnt = round_up(src.cnt, u64(8));
+    // Left children get a multiple of the leaf size, so at least every
+    // other leaf is full
+    u64 const max_nodes = 4 * (src.cnt / c_haversine_index_leaf_size) + 1;
+
+    idx.ids_buffer = allocate_best(src.cnt * sizeof(u32));
+    idx.nodes_buffer = allocate_best(max_nodes * sizeof(haversine_index_node_t));
+    idx.points.buffer = allocate_best(3 * padded_cnt * sizeof(f64));
+    if (!is_valid(idx.ids_buffer) || !is_valid(idx.nodes_buffer) ||
+        !is_valid(idx.points.buffer))
+    {
+        LOGERR("Failed to allocate spatial index for %u points", cnt);
+        cleanup_haversine_spatial_index(idx);
+        return false;
+    }
+
+    idx.ids = (u32 *)idx.ids_buffer.data;
+    idx.nodes = (haversine_index_node_t *)idx.nodes_buffer.data;
+    idx.node_cnt = 0;
+
+    for (u32 i = 0; i < cnt; ++i)
+        idx.ids[i] = i;
+    build_haversine_index_node(idx, src, idx.ids, 0, cnt);
+    assert(idx.node_cnt <= max_nodes);
+
+    idx.points.x = (f64 *)idx.points.buffer.data;
+    idx.points.y = idx.points.x + padded_cnt;
+    idx.points.z = idx.points.y + padded_cnt;
+    idx.points.cnt = src.cnt;
+    for (u32 i = 0; i < cnt; ++i) {
+        idx.points.x[i] = src.x[idx.ids[i]];
+        idx.points.y[i] = src.y[idx.ids[i]];
+        idx.points.z[i] = src.z[idx.ids[i]];
+    }
+    for (u64 i = src.cnt; i < padded_cnt; ++i)
+        idx.points.x[i] = idx.points.y[i] = idx.points.z[i] = 0.0;
+
+    return true;
+}
+
+// Squared chord for a great-circle distance, slightly inflated so kernel
+// rounding never prunes a point that the kernel would have accepted
+inline f64 haversine_dist_to_chord2(f64 dist)
+{
+    if (dist >= c_pi64 * c_earth_rad64)
+        return 4.0;
+    f64 const chord = 2.0 * sin(dist / (2.0 * c_earth_rad64));
+    return chord * chord * (1.0 + 1e-9) + 1e-18;
+}
+
+inline f64 haversine_index_box_dist2(
+    haversine_index_node_t const &node, f64 const (&q)[3])
+{
+    f64 d2 = 0.0;
+    for (u32 a = 0; a < 3; ++a) {
+        f64 const d = max(max(node.lo[a] - q[a], q[a] - node.hi[a]), 0.0);
+        d2 += d * d;
+    }
+    return d2;
+}
+
+struct haversine_index_stack_entry_t {
+    u32 node;
+    f64 box_dist2;
+};
+
+// Depth is ~log2(n / leaf), with one pending sibling per level
+inline constexpr u32 c_haversine_index_max_depth = 64;
+
+// Visits leaves nearest first, func(begin, end) returns the chord2 bound
+// to prune with from then on
+template <class TLeafFunc>
+inline void traverse_haversine_index(
+    haversine_spatial_index_t const &idx, f64 const (&q)[3],
+    f64 chord2, TLeafFunc &&leaf_func)
+{
+    haversine_index_stack_entry_t stack[c_haversine_index_max_depth];
+    u32 depth = 0;
+    stack[depth++] = {0, haversine_index_box_dist2(idx.nodes[0], q)};
+
+    while (depth > 0) {
+        haversine_index_stack_entry_t const e = stack[--depth];
+        if (e.box_dist2 > chord2)
+            continue;
+        haversine_index_node_t const &node = idx.nodes[e.node];
+        if (node.left == 0) {
+            chord2 = leaf_func(node.begin, node.end);
+            continue;
+        }
+        f64 const dl = haversine_index_box_dist2(idx.nodes[node.left], q);
+        f64 const dr = haversine_index_box_dist2(idx.nodes[node.right], q);
+        assert(depth + 2 <= c_haversine_index_max_depth);
+        if (dl <= dr) {
+            stack[depth++] = {node.right, dr};
+            stack[depth++] = {node.left, dl};
+        } else {
+            stack[depth++] = {node.left, dl};
+            stack[depth++] = {node.right, dr};
+        }
+    }
+}
+
+// Queries are processed in blocks of this many, a block is the unit of
+// work for threads
+inline constexpr u64 c_haversine_index_query_block = 64;
+
+// k nearest points of the index for every query point, into tk (indices are
+// original point indices). tk must be set up for queries.cnt rows.
+inline bool query_haversine_knn(
+    haversine_spatial_index_t const &idx, haversine_point_set_t const &queries,
+    isa_level_t isa, u32 thread_cnt, haversine_top_k_t &tk)
+{
+    assert(tk.row_cnt == queries.cnt);
+
+    haversine_matrix_segment_func_t const segment_func =
+        isa >= e_isa_avx2 ?
+            &calculate_haversine_matrix_segment_avx2 :
+            &calculate_haversine_matrix_segment_scalar;
+
+    auto process_block = [&](u64 b) {
+        alignas(32) f64 dists[c_haversine_index_leaf_size + 8];
+
+        u64 const end = min((b + 1) * c_haversine_index_query_block, queries.cnt);
+        for (u64 r = b * c_haversine_index_query_block; r < end; ++r) {
+            f64 const q[3] = {queries.x[r], queries.y[r], queries.z[r]};
+            haversine_neighbour_t *best = tk.neighbours + r * tk.k;
+
+            traverse_haversine_index(idx, q,
+                haversine_dist_to_chord2(best[tk.k - 1].dist),
+                [&](u32 leaf_begin, u32 leaf_end) {
+                    (*segment_func)(queries, r, idx.points,
+                        leaf_begin, leaf_end - leaf_begin, dists);
+                    for (u32 i = leaf_begin; i < leaf_end; ++i) {
+                        insert_haversine_neighbour(
+                            best, tk.k, dists[i - leaf_begin], idx.ids[i]);
+                    }
+                    return haversine_dist_to_chord2(best[tk.k - 1].dist);
+                });
+        }
+    };
+
+    u64 const block_cnt = (queries.cnt + c_haversine_index_query_block - 1) /
+        c_haversine_index_query_block;
+    return run_haversine_parallel(block_cnt, thread_cnt, process_block);
+}
+
+// Calls sink(query, point idx, dist) for every point within radius of every
+// query, in no particular order. Concurrent for different queries.
+template <class TSink>
+inline bool query_haversine_radius(
+    haversine_spatial_index_t const &idx, haversine_point_set_t const &queries,
+    f64 radius, isa_level_t isa, u32 thread_cnt, TSink &sink)
+{
+    haversine_matrix_segment_func_t const segment_func =
+        isa >= e_isa_avx2 ?
+            &calculate_haversine_matrix_segment_avx2 :
+            &calculate_haversine_matrix_segment_scalar;
+    f64 const chord2 = haversine_dist_to_chord2(radius);
+
+    auto process_block = [&](u64 b) {
+        alignas(32) f64 dists[c_haversine_index_leaf_size + 8];
+
+        u64 const end = min((b + 1) * c_haversine_index_query_block, queries.cnt);
+        for (u64 r = b * c_haversine_index_query_block; r < end; ++r) {
+            f64 const q[3] = {queries.x[r], queries.y[r], queries.z[r]};
+            traverse_haversine_index(idx, q, chord2,
+                [&](u32 leaf_begin, u32 leaf_end) {
+                    (*segment_func)(queries, r, idx.points,
+                        leaf_begin, leaf_end - leaf_begin, dists);
+                    for (u32 i = leaf_begin; i < leaf_end; ++i) {
+                        if (dists[i - leaf_begin] <= radius)
+                            sink(r, u64(idx.ids[i]), dists[i - leaf_begin]);
+                    }
+                    return chord2;
+                });
+        }
+    };
+
+    u64 const block_cnt = (queries.cnt + c_haversine_index_query_block - 1) /
+        c_haversine_index_query_block;
+    return run_haversine_parallel(block_cnt, thread_cnt, process_block);
+}
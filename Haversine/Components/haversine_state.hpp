@@ -4,25 +4,55 @@
 
 #include "haversine_file_io.hpp"
 #include "haversine_json_parser.hpp"
+#include "haversine_bin_format.hpp"
 
 #include <buffer.hpp>
 #include <profiling.hpp>
+#include <intrinsics.hpp>
 
 struct point_pair_t {
     f64 x0, y0, x1, y1;
 };
 
+// Compact coordinate storage: fixed-point microdegrees, 16 bytes per pair
+// instead of 32. Rounding error is <= 0.5e-6 deg per coordinate, which is
+// ~5.6cm along a meridian, so the distance error stays under ~0.25m.
+struct quantized_point_pair_t {
+    i32 x0, y0, x1, y1;
+};
+
+inline constexpr f64 c_quantized_units_per_deg = 1'000'000.0;
+
+// Single precision storage for the f32 kernel. Rounding is <= 2^-18 deg
+// for |coord| <= 180, i.e. under ~0.5m per coordinate.
+struct point_pair_f32_t {
+    f32 x0, y0, x1, y1;
+};
+
 struct haversine_state_t {
     buffer_t json_source_buffer;
     buffer_t checksum_buffer;
     buffer_t parsed_pairs_buffer;
     buffer_t answers_buffer;
+    buffer_t quantized_pairs_buffer;
+    buffer_t f32_pairs_buffer;
+    os_mapped_file_t bin_mapping; // Binary input, pairs point into it
+    os_mapped_file_t checksum_mapping; // Instead of checksum_buffer if mapped
 
     u64 parsed_byte_count;
 
+    // Incremental mode: json_source_buffer holds the file from this offset,
+    // pairs/answers hold only the new tail, base_* cover everything before.
+    // Kernels continue sum_answer from base_sum, so it is always the total.
+    u64 json_source_offset;
+    u64 base_pair_cnt;
+    f64 base_sum;
+
     json_ent_t *parsed_json_root;
 
     point_pair_t *pairs;
+    quantized_point_pair_t *quantized_pairs; // null unless quantized
+    point_pair_f32_t *f32_pairs; // null unless narrowed to f32
     f64 *answers;
     u64 pair_cnt;
 
@@ -42,12 +72,130 @@ void cleanup_haversine_state(haversine_state_t &s)
     deallocate(s.checksum_buffer);
     deallocate(s.parsed_pairs_buffer);
     deallocate(s.answers_buffer);
+    deallocate(s.quantized_pairs_buffer);
+    deallocate(s.f32_pairs_buffer);
     deallocate(s.parsed_json_root); 
+    if (is_mapped(s.bin_mapping))
+        os_unmap_file(s.bin_mapping);
+    if (is_mapped(s.checksum_mapping))
+        os_unmap_file(s.checksum_mapping);
     s = {};
 }
 
+// Byte offset right past the last point record, i.e. before the "]}"
+// closing the points array. Only valid for an already parsed document.
+u64 find_points_records_end(buffer_t const &json)
+{
+    u64 pos = json.len;
+    auto skip_back = [&](char const *expected) {
+        while (pos > 0 && is_whitespace(json.data[pos - 1]))
+            --pos;
+        for (char const *c = expected; *c; ++c) {
+            if (pos == 0 || json.data[pos - 1] != *c)
+                return false;
+            --pos;
+            while (pos > 0 && is_whitespace(json.data[pos - 1]))
+                --pos;
+        }
+        return true;
+    };
+    return skip_back("}]") ? pos : 0;
+}
+
+bool read_haversine_pairs(
+    haversine_state_t &s, json_array_t const &points_arr)
+{
+    json_ent_t *const *points = points_arr.elements;
+
+    s.pair_cnt = points_arr.element_cnt;
+
+    s.parsed_pairs_buffer = allocate_best(s.pair_cnt * sizeof(point_pair_t));
+    s.pairs = (point_pair_t *)s.parsed_pairs_buffer.data;
+
+    s.answers_buffer = allocate_best(s.pair_cnt * sizeof(f64));
+    s.answers = (f64 *)s.answers_buffer.data;
+
+    PROFILED_BLOCK_PF("Haversine parsing");
+
+    for (u32 i = 0; i < s.pair_cnt; ++i) {
+        json_ent_t const *elem = points[i];
+        auto print_point_format_error = [] {
+            LOGERR(
+                "Invalid point format: correct is "
+                "{ \"x0\": .f, \"y0\": .f, \"x1\": .f, \"y1\": .f }");
+        };
+        // Extra fields are allowed and ignored
+        if (elem->type != e_jt_object || elem->obj.field_cnt < 4) {
+            print_point_format_error();
+            return false;
+        }
+
+        auto read_f64 = [elem](char const *name, f64 &out) {
+            if (json_ent_t const *d = json_object_query(*elem, name)) {
+                if (d->type == e_jt_number) {
+                    out = d->num;
+                    return true;
+                }
+            }
+            return false;
+        };
+        f64 x0, y0, x1, y1;
+        if (!read_f64("x0", x0) ||
+            !read_f64("y0", y0) ||
+            !read_f64("x1", x1) ||
+            !read_f64("y1", y1))
+        {
+            print_point_format_error();
+            return false;
+        }
+
+        s.pairs[i] = {x0, y0, x1, y1};
+    }
+
+    return true;
+}
+
+// Optional, no checksum file just means no validation. Mapped, only the
+// pages validation looks at get read, for sampled validation.
+bool load_haversine_checksum(
+    haversine_state_t &s, char const *input_fn, bool map_checksum = false)
+{
+    char checksum_fn[256];
+    snprintf(
+        checksum_fn, sizeof(checksum_fn),
+        "%s.check.bin", input_fn);
+
+    u64 checksum_len;
+    if (map_checksum) {
+        s.checksum_mapping =
+            os_read_map_file(checksum_fn, e_osfmf_random_access);
+        checksum_len = s.checksum_mapping.len;
+    } else {
+        s.checksum_buffer = load_entire_file(checksum_fn);
+        checksum_len = s.checksum_buffer.len;
+    }
+    if (!is_valid(s.checksum_buffer) && !is_mapped(s.checksum_mapping)) {
+        LOGDBG(
+            "Failed to load checksum file from '%s', no validation",
+            checksum_fn);
+        s.checksum_mapping = {};
+        return true;
+    }
+
+    if (checksum_len != (s.pair_cnt + 1) * sizeof(f64)) {
+        LOGERR("Invalid checksum file '%s'", checksum_fn);
+        return false;
+    }
+
+    s.validation_answers = map_checksum ?
+        (f64 *)s.checksum_mapping.data : (f64 *)s.checksum_buffer.data;
+    s.validation_sum = s.validation_answers[s.pair_cnt];
+    return true;
+}
+
 bool setup_haversine_state(
-    haversine_state_t &s, char const *json_fn, bool only_load_json = false)
+    haversine_state_t &s, char const *json_fn, bool only_load_json = false,
+    bool map_checksum = false)
 {
     assert(json_fn);
 
@@ -69,91 +217,131 @@ bool setup_haversine_state(
         return false;
     }
     
+    json_ent_t const *points = nullptr;
     {
         PROFILED_BLOCK_PF("Misc preparation");
 
-        if (s.parsed_json_root->obj.field_cnt != 1 ||
-            !streq(s.parsed_json_root->obj.fields[0].name.s, "points") ||
-            s.parsed_json_root->obj.fields[0].ent->type != e_jt_array)
-        {
+        // Other root fields are allowed and ignored
+        points = json_object_query(*s.parsed_json_root, "points");
+        if (!points || points->type != e_jt_array) {
             LOGERR("Invalid format: correct is { \"points\": [ ... ] }");
             cleanup_haversine_state(s);
             return false;
         }
+    }
 
-        char checksum_fn[256];
-        snprintf(
-            checksum_fn, sizeof(checksum_fn),
-            "%s.check.bin", json_fn);
-        s.checksum_buffer = load_entire_file(checksum_fn);
-        if (!is_valid(s.checksum_buffer)) {
-            LOGDBG(
-                "Failed to load checksum file from '%s', no validation",
-                checksum_fn);
-        }
+    json_array_t const &points_arr = points->arr;
+
+    if (!read_haversine_pairs(s, points_arr) ||
+        !load_haversine_checksum(s, json_fn, map_checksum))
+    {
+        cleanup_haversine_state(s);
+        return false;
     }
 
-    json_array_t &points_arr = s.parsed_json_root->obj.fields[0].ent->arr;
-    json_ent_t *const *points = points_arr.elements;
+    return true;
+}
 
-    s.pair_cnt = points_arr.element_cnt;
+// Maps a -format=bin file, pairs are used in place
+bool setup_haversine_state_bin(
+    haversine_state_t &s, char const *bin_fn, bool map_checksum = false)
+{
+    assert(bin_fn);
 
-    s.parsed_pairs_buffer = allocate_best(s.pair_cnt * sizeof(point_pair_t));
-    s.pairs = (point_pair_t *)s.parsed_pairs_buffer.data;
+    PROFILED_FUNCTION_PF;
+
+    cleanup_haversine_state(s);
+
+    s.bin_mapping = os_read_map_file(bin_fn);
+    if (!is_mapped(s.bin_mapping)) {
+        LOGERR("Failed to map binary file '%s'", bin_fn);
+        s.bin_mapping = {};
+        return false;
+    }
+
+    haversine_bin_header_t header;
+    if (s.bin_mapping.len < sizeof(header)) {
+        LOGERR("Invalid binary file '%s': no header", bin_fn);
+        cleanup_haversine_state(s);
+        return false;
+    }
+    memcpy(&header, s.bin_mapping.data, sizeof(header));
+
+    if (header.magic != c_haversine_bin_magic ||
+        header.version != c_haversine_bin_version ||
+        header.pairs_offset % alignof(point_pair_t) != 0 ||
+        header.pairs_offset > s.bin_mapping.len ||
+        header.pair_cnt >
+            (s.bin_mapping.len - header.pairs_offset) / sizeof(point_pair_t))
+    {
+        LOGERR("Invalid binary file '%s': bad header", bin_fn);
+        cleanup_haversine_state(s);
+        return false;
+    }
+
+    s.pair_cnt = header.pair_cnt;
+    s.pairs = (point_pair_t *)(s.bin_mapping.data + header.pairs_offset);
 
     s.answers_buffer = allocate_best(s.pair_cnt * sizeof(f64));
     s.answers = (f64 *)s.answers_buffer.data;
 
-    if (is_valid(s.checksum_buffer)) {
-        if (s.checksum_buffer.len != (s.pair_cnt + 1) * sizeof(f64)) {
-            LOGERR("Invalid checksum file '%s.check.bin'", json_fn);
-            cleanup_haversine_state(s);
-            return false;
-        }
-        
-        s.validation_answers = (f64 *)s.checksum_buffer.data;
-        s.validation_sum = s.validation_answers[s.pair_cnt];
+    if (!load_haversine_checksum(s, bin_fn, map_checksum)) {
+        cleanup_haversine_state(s);
+        return false;
     }
 
-    {
-        PROFILED_BLOCK_PF("Haversine parsing");
-
-        for (u32 i = 0; i < s.pair_cnt; ++i) {
-            json_ent_t const *elem = points[i];
-            auto print_point_format_error = [] {
-                LOGERR(
-                    "Invalid point format: correct is "
-                    "{ \"x0\": .f, \"y0\": .f, \"x1\": .f, \"y1\": .f }");
-            };
-            if (elem->type != e_jt_object || elem->obj.field_cnt != 4) {
-                print_point_format_error();
-                cleanup_haversine_state(s);
-                return false;
-            }
+    return true;
+}
 
-            auto read_f64 = [elem](char const *name, f64 &out) {
-                if (json_ent_t const *d = json_object_query(*elem, name)) {
-                    if (d->type == e_jt_number) {
-                        out = d->num;
-                        return true;
-                    }
-                }
-                return false;
-            };
-            f64 x0, y0, x1, y1;
-            if (!read_f64("x0", x0) ||
-                !read_f64("y0", y0) ||
-                !read_f64("x1", x1) ||
-                !read_f64("y1", y1))
-            {
-                print_point_format_error();
-                cleanup_haversine_state(s);
-                return false;
-            }
+ISA_REGION_BEGIN_AVX2
 
-            s.pairs[i] = {x0, y0, x1, y1};
-        }
+bool quantize_haversine_pairs(haversine_state_t &s)
+{
+    PROFILED_BANDWIDTH_FUNCTION_PF(s.pair_cnt * sizeof(point_pair_t));
+
+    deallocate(s.quantized_pairs_buffer);
+    s.quantized_pairs = nullptr;
+
+    s.quantized_pairs_buffer =
+        allocate_best(s.pair_cnt * sizeof(quantized_point_pair_t));
+    if (!is_valid(s.quantized_pairs_buffer)) {
+        LOGERR("Failed to allocate quantized pairs");
+        return false;
+    }
+    s.quantized_pairs =
+        (quantized_point_pair_t *)s.quantized_pairs_buffer.data;
+
+    __m256d const scale = _mm256_set1_pd(c_quantized_units_per_deg);
+    for (u64 i = 0; i < s.pair_cnt; ++i) {
+        __m256d const deg = _mm256_loadu_pd(&s.pairs[i].x0);
+        // Rounds to nearest with the default mxcsr
+        __m128i const q = _mm256_cvtpd_epi32(_mm256_mul_pd(deg, scale));
+        _mm_storeu_si128((__m128i *)&s.quantized_pairs[i], q);
+    }
+
+    return true;
+}
+
+bool narrow_haversine_pairs_f32(haversine_state_t &s)
+{
+    PROFILED_BANDWIDTH_FUNCTION_PF(s.pair_cnt * sizeof(point_pair_t));
+
+    deallocate(s.f32_pairs_buffer);
+    s.f32_pairs = nullptr;
+
+    s.f32_pairs_buffer = allocate_best(s.pair_cnt * sizeof(point_pair_f32_t));
+    if (!is_valid(s.f32_pairs_buffer)) {
+        LOGERR("Failed to allocate f32 pairs");
+        return false;
+    }
+    s.f32_pairs = (point_pair_f32_t *)s.f32_pairs_buffer.data;
+
+    for (u64 i = 0; i < s.pair_cnt; ++i) {
+        __m128 const narrow = _mm256_cvtpd_ps(_mm256_loadu_pd(&s.pairs[i].x0));
+        _mm_storeu_ps(&s.f32_pairs[i].x0, narrow);
     }
 
     return true;
 }
+
+ISA_REGION_END
@@ -0,0 +1,328 @@
+#pragma once
+
+#include <defs.hpp>
+#include <intrinsics.hpp>
+#include <cpuid.hpp>
+
+// Alternative reductions of the answers into sum_answer. The kernels always
+// sum inline in pair order (naive), the other modes are a second pass over
+// answers, 8 bytes/pair against the kernels' 16-32 bytes/pair of input.
+
+enum haversine_sum_mode_t {
+    e_hsm_naive,        // In pair order, error grows ~n * eps * sum
+    e_hsm_kahan,        // Compensated, per-lane, error ~eps * sum
+    e_hsm_neumaier,     // Compensated with exact TwoSum, also for |x| > |sum|
+    e_hsm_pairwise,     // Blocks summed in lanes, blocks combined as a tree
+    e_hsm_reproducible, // Fixed reduction tree, same bits on any isa/threads
+
+    e_hsm_count
+};
+
+inline constexpr char const *c_haversine_sum_mode_names[e_hsm_count] =
+    {"naive", "kahan", "neumaier", "pairwise", "reproducible"};
+
+// Exact error of sum + x goes into c (Knuth TwoSum). Branch-free, so it
+// vectorizes, and covers Neumaier's |x| > |sum| case without the compare.
+FINLINE void two_sum_acc(f64 &sum, f64 &c, f64 x)
+{
+    f64 const t = sum + x;
+    f64 const bp = t - sum;
+    c += (sum - (t - bp)) + (x - bp);
+    sum = t;
+}
+
+// Block partials are pushed in block order and merged like a binary counter,
+// which gives a balanced tree over block indices with log2(n) stack slots
+struct pairwise_sum_stack_t {
+    f64 partials[64];
+    u64 block_cnt = 0;
+    u32 depth = 0;
+};
+
+FINLINE void push_block_sum(pairwise_sum_stack_t &st, f64 block_sum)
+{
+    for (u64 b = st.block_cnt++; b & 1; b >>= 1)
+        block_sum = st.partials[--st.depth] + block_sum;
+    st.partials[st.depth++] = block_sum;
+}
+
+FINLINE f64 finish_pairwise_sum(pairwise_sum_stack_t &st)
+{
+    f64 res = 0.0;
+    while (st.depth > 0)
+        res = st.partials[--st.depth] + res;
+    return res;
+}
+
+inline constexpr u64 c_pairwise_sum_block = 256;
+
+// Canonical layout for e_hsm_reproducible: blocks of this many answers,
+// padded with zeros, answer i of a block goes to lane i % 8, each lane is a
+// TwoSum accumulator, lanes are folded as 0-3 + 4-7, then halves, then the
+// last two. Every isa implements exactly this sequence of adds, and block
+// sums only depend on block indices, so threads given power-of-two aligned
+// block ranges can merge their stacks into the same result.
+inline constexpr u64 c_reproducible_sum_block = 1024;
+inline constexpr u32 c_reproducible_sum_lanes = 8;
+
+inline f64 sum_naive(f64 const *a, u64 cnt)
+{
+    f64 sum = 0.0;
+    for (u64 i = 0; i < cnt; ++i)
+        sum += a[i];
+    return sum;
+}
+
+inline f64 sum_kahan(f64 const *a, u64 cnt)
+{
+    f64 sum = 0.0, c = 0.0;
+    for (u64 i = 0; i < cnt; ++i) {
+        f64 const y = a[i] - c;
+        f64 const t = sum + y;
+        c = (t - sum) - y;
+        sum = t;
+    }
+    return sum - c;
+}
+
+inline f64 sum_neumaier(f64 const *a, u64 cnt)
+{
+    f64 sum = 0.0, c = 0.0;
+    for (u64 i = 0; i < cnt; ++i)
+        two_sum_acc(sum, c, a[i]);
+    return sum + c;
+}
+
+inline f64 sum_pairwise(f64 const *a, u64 cnt)
+{
+    pairwise_sum_stack_t st{};
+    for (u64 i = 0; i < cnt; i += c_pairwise_sum_block)
+        push_block_sum(st, sum_naive(a + i, min(c_pairwise_sum_block, cnt - i)));
+    return finish_pairwise_sum(st);
+}
+
+inline f64 fold_reproducible_lanes(f64 const (&v)[c_reproducible_sum_lanes])
+{
+    f64 const w0 = v[0] + v[4], w1 = v[1] + v[5];
+    f64 const w2 = v[2] + v[6], w3 = v[3] + v[7];
+    return (w0 + w2) + (w1 + w3);
+}
+
+inline f64 sum_reproducible(f64 const *a, u64 cnt)
+{
+    pairwise_sum_stack_t st{};
+    for (u64 i = 0; i < cnt; i += c_reproducible_sum_block) {
+        u64 const block_cnt = min(c_reproducible_sum_block, cnt - i);
+        f64 s[c_reproducible_sum_lanes] = {}, c[c_reproducible_sum_lanes] = {};
+        for (u64 j = 0; j < block_cnt; ++j) {
+            u32 const lane = u32(j % c_reproducible_sum_lanes);
+            two_sum_acc(s[lane], c[lane], a[i + j]);
+        }
+        // Zero padding, to keep signed zeros the same as in vector paths
+        for (u64 j = block_cnt; j < round_up(block_cnt, u64(8)); ++j) {
+            u32 const lane = u32(j % c_reproducible_sum_lanes);
+            two_sum_acc(s[lane], c[lane], 0.0);
+        }
+        f64 v[c_reproducible_sum_lanes];
+        for (u32 l = 0; l < c_reproducible_sum_lanes; ++l)
+            v[l] = s[l] + c[l];
+        push_block_sum(st, fold_reproducible_lanes(v));
+    }
+    return finish_pairwise_sum(st);
+}
+
+ISA_REGION_BEGIN_AVX2
+
+FINLINE void two_sum_acc_pd(__m256d &sum, __m256d &c, __m256d x)
+{
+    __m256d const t = _mm256_add_pd(sum, x);
+    __m256d const bp = _mm256_sub_pd(t, sum);
+    c = _mm256_add_pd(c, _mm256_add_pd(
+        _mm256_sub_pd(sum, _mm256_sub_pd(t, bp)), _mm256_sub_pd(x, bp)));
+    sum = t;
+}
+
+FINLINE f64 fold_reproducible_lanes_pd(__m256d lo, __m256d hi)
+{
+    __m256d const w = _mm256_add_pd(lo, hi);
+    __m128d const u = _mm_add_pd(
+        _mm256_castpd256_pd128(w), _mm256_extractf128_pd(w, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(u, _mm_unpackhi_pd(u, u)));
+}
+
+// Accumulator latency is 4 cycles for an add and ~16 for a Kahan or TwoSum
+// step, so 4 independent vectors keep the adders busy on all of them
+
+inline f64 sum_kahan_avx2(f64 const *a, u64 cnt)
+{
+    __m256d sum[4], c[4];
+    for (u32 k = 0; k < 4; ++k)
+        sum[k] = c[k] = _mm256_setzero_pd();
+
+    u64 const full_cnt = round_down(cnt, u64(16));
+    for (u64 i = 0; i < full_cnt; i += 16) {
+        for (u32 k = 0; k < 4; ++k) {
+            __m256d const y = _mm256_sub_pd(_mm256_loadu_pd(a + i + 4 * k), c[k]);
+            __m256d const t = _mm256_add_pd(sum[k], y);
+            c[k] = _mm256_sub_pd(_mm256_sub_pd(t, sum[k]), y);
+            sum[k] = t;
+        }
+    }
+
+    f64 lanes_sum[16], lanes_c[16];
+    for (u32 k = 0; k < 4; ++k) {
+        _mm256_storeu_pd(lanes_sum + 4 * k, sum[k]);
+        _mm256_storeu_pd(lanes_c + 4 * k, c[k]);
+    }
+    f64 res = 0.0, res_c = 0.0;
+    for (u32 l = 0; l < 16; ++l) {
+        two_sum_acc(res, res_c, lanes_sum[l]);
+        two_sum_acc(res, res_c, -lanes_c[l]);
+    }
+    for (u64 i = full_cnt; i < cnt; ++i)
+        two_sum_acc(res, res_c, a[i]);
+    return res + res_c;
+}
+
+inline f64 sum_neumaier_avx2(f64 const *a, u64 cnt)
+{
+    __m256d sum[4], c[4];
+    for (u32 k = 0; k < 4; ++k)
+        sum[k] = c[k] = _mm256_setzero_pd();
+
+    u64 const full_cnt = round_down(cnt, u64(16));
+    for (u64 i = 0; i < full_cnt; i += 16) {
+        for (u32 k = 0; k < 4; ++k)
+            two_sum_acc_pd(sum[k], c[k], _mm256_loadu_pd(a + i + 4 * k));
+    }
+
+    f64 lanes_sum[16], lanes_c[16];
+    for (u32 k = 0; k < 4; ++k) {
+        _mm256_storeu_pd(lanes_sum + 4 * k, sum[k]);
+        _mm256_storeu_pd(lanes_c + 4 * k, c[k]);
+    }
+    f64 res = 0.0, res_c = 0.0;
+    for (u32 l = 0; l < 16; ++l) {
+        two_sum_acc(res, res_c, lanes_sum[l]);
+        res_c += lanes_c[l];
+    }
+    for (u64 i = full_cnt; i < cnt; ++i)
+        two_sum_acc(res, res_c, a[i]);
+    return res + res_c;
+}
+
+inline f64 sum_pairwise_avx2(f64 const *a, u64 cnt)
+{
+    static_assert(c_pairwise_sum_block % 16 == 0);
+
+    pairwise_sum_stack_t st{};
+    u64 const full_cnt = round_down(cnt, c_pairwise_sum_block);
+    for (u64 i = 0; i < full_cnt; i += c_pairwise_sum_block) {
+        __m256d sum[4];
+        for (u32 k = 0; k < 4; ++k)
+            sum[k] = _mm256_loadu_pd(a + i + 4 * k);
+        for (u64 j = 16; j < c_pairwise_sum_block; j += 16) {
+            for (u32 k = 0; k < 4; ++k)
+                sum[k] = _mm256_add_pd(sum[k], _mm256_loadu_pd(a + i + j + 4 * k));
+        }
+        push_block_sum(st, fold_reproducible_lanes_pd(
+            _mm256_add_pd(sum[0], sum[1]), _mm256_add_pd(sum[2], sum[3])));
+    }
+    if (full_cnt < cnt)
+        push_block_sum(st, sum_naive(a + full_cnt, cnt - full_cnt));
+    return finish_pairwise_sum(st);
+}
+
+inline f64 sum_reproducible_avx2(f64 const *a, u64 cnt)
+{
+    static_assert(c_reproducible_sum_block % 8 == 0);
+
+    pairwise_sum_stack_t st{};
+    for (u64 i = 0; i < cnt; i += c_reproducible_sum_block) {
+        u64 const block_cnt = min(c_reproducible_sum_block, cnt - i);
+        __m256d s_lo = _mm256_setzero_pd(), s_hi = _mm256_setzero_pd();
+        __m256d c_lo = _mm256_setzero_pd(), c_hi = _mm256_setzero_pd();
+
+        u64 const full_cnt = round_down(block_cnt, u64(8));
+        for (u64 j = 0; j < full_cnt; j += 8) {
+            two_sum_acc_pd(s_lo, c_lo, _mm256_loadu_pd(a + i + j));
+            two_sum_acc_pd(s_hi, c_hi, _mm256_loadu_pd(a + i + j + 4));
+        }
+        if (full_cnt < block_cnt) {
+            f64 tail[8] = {};
+            memcpy(tail, a + i + full_cnt, (block_cnt - full_cnt) * sizeof(f64));
+            two_sum_acc_pd(s_lo, c_lo, _mm256_loadu_pd(tail));
+            two_sum_acc_pd(s_hi, c_hi, _mm256_loadu_pd(tail + 4));
+        }
+
+        push_block_sum(st, fold_reproducible_lanes_pd(
+            _mm256_add_pd(s_lo, c_lo), _mm256_add_pd(s_hi, c_hi)));
+    }
+    return finish_pairwise_sum(st);
+}
+
+ISA_REGION_END
+
+ISA_REGION_BEGIN_AVX512
+
+inline f64 sum_reproducible_avx512(f64 const *a, u64 cnt)
+{
+    pairwise_sum_stack_t st{};
+    for (u64 i = 0; i < cnt; i += c_reproducible_sum_block) {
+        u64 const block_cnt = min(c_reproducible_sum_block, cnt - i);
+        __m512d s = _mm512_setzero_pd(), c = _mm512_setzero_pd();
+
+        auto acc = [&](__m512d x) {
+            __m512d const t = _mm512_add_pd(s, x);
+            __m512d const bp = _mm512_sub_pd(t, s);
+            c = _mm512_add_pd(c, _mm512_add_pd(
+                _mm512_sub_pd(s, _mm512_sub_pd(t, bp)), _mm512_sub_pd(x, bp)));
+            s = t;
+        };
+
+        u64 const full_cnt = round_down(block_cnt, u64(8));
+        for (u64 j = 0; j < full_cnt; j += 8)
+            acc(_mm512_loadu_pd(a + i + j));
+        if (full_cnt < block_cnt) {
+            __mmask8 const m = __mmask8((1u << (block_cnt - full_cnt)) - 1);
+            acc(_mm512_maskz_loadu_pd(m, a + i + full_cnt));
+        }
+
+        __m512d const v = _mm512_add_pd(s, c);
+        __m256d const w = _mm256_add_pd(
+            _mm512_castpd512_pd256(v), _mm512_extractf64x4_pd(v, 1));
+        __m128d const u = _mm_add_pd(
+            _mm256_castpd256_pd128(w), _mm256_extractf128_pd(w, 1));
+        push_block_sum(st, _mm_cvtsd_f64(_mm_add_sd(u, _mm_unpackhi_pd(u, u))));
+    }
+    return finish_pairwise_sum(st);
+}
+
+ISA_REGION_END
+
+inline f64 sum_haversine_answers(
+    f64 const *answers, u64 cnt, haversine_sum_mode_t mode, isa_level_t isa)
+{
+    bool const avx2 = isa >= e_isa_avx2;
+    switch (mode) {
+    case e_hsm_naive:
+        return sum_naive(answers, cnt);
+    case e_hsm_kahan:
+        return avx2 ? sum_kahan_avx2(answers, cnt) : sum_kahan(answers, cnt);
+    case e_hsm_neumaier:
+        return avx2 ?
+            sum_neumaier_avx2(answers, cnt) : sum_neumaier(answers, cnt);
+    case e_hsm_pairwise:
+        return avx2 ?
+            sum_pairwise_avx2(answers, cnt) : sum_pairwise(answers, cnt);
+    case e_hsm_reproducible:
+        if (isa >= e_isa_avx512)
+            return sum_reproducible_avx512(answers, cnt);
+        return avx2 ?
+            sum_reproducible_avx2(answers, cnt) :
+            sum_reproducible(answers, cnt);
+    default:
+        assert(0);
+        return 0.0;
+    }
+}
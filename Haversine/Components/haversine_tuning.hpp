@@ -0,0 +1,227 @@
+#pragma once
+
+#include "haversine_state.hpp"
+#include "haversine_calculation.hpp"
+
+#include <repetition.hpp>
+#include <profiling.hpp>
+#include <logging.hpp>
+#include <defer.hpp>
+#include <cpuid.hpp>
+#include <defs.hpp>
+
+// Startup choice between the interleave/unroll kernel variants. The best one
+// depends on the uarch (see dependency_chains), so each candidate is timed
+// on a sample of the real input, and the winner is cached per cpu model and
+// isa in a text file of "<cpu brand>\t<isa>\t<kernel name>" lines, so only
+// the first run on a machine pays for it. The cache lives in the user's
+// cache dir, so runs from any directory share it.
+
+#if _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+inline constexpr char c_haversine_tuning_cache_name[] = "haversine_tuning";
+inline constexpr u64 c_haversine_tuning_sample_pairs = 1 << 14;
+// Candidate is done when it finds no new min for this long
+inline constexpr f32 c_haversine_tuning_renew_sec = 0.05f;
+inline constexpr u32 c_haversine_tuning_max_line = 256;
+
+// %LOCALAPPDATA%, $XDG_CACHE_HOME or ~/.cache (created if missing). False
+// if there is none, tuning is not cached then.
+inline bool get_haversine_tuning_default_fn(char (&buf)[256])
+{
+#if _WIN32
+    char const *dir = getenv("LOCALAPPDATA");
+    if (!dir || !*dir)
+        return false;
+    int const len = snprintf(
+        buf, sizeof(buf), "%s\\%s", dir, c_haversine_tuning_cache_name);
+#else
+    char dir[200];
+    int dir_len = 0;
+    bool is_home_cache = false;
+    if (char const *xdg = getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+        dir_len = snprintf(dir, sizeof(dir), "%s", xdg);
+    } else if (char const *home = getenv("HOME"); home && *home) {
+        dir_len = snprintf(dir, sizeof(dir), "%s/.cache", home);
+        is_home_cache = true;
+    }
+    if (dir_len <= 0 || usize(dir_len) >= sizeof(dir))
+        return false;
+    if (is_home_cache && mkdir(dir, 0755) != 0 && errno != EEXIST)
+        return false;
+    int const len = snprintf(
+        buf, sizeof(buf), "%s/%s", dir, c_haversine_tuning_cache_name);
+#endif
+    return len > 0 && usize(len) < sizeof(buf);
+}
+
+inline haversine_kernel_t const *find_haversine_kernel_variant(
+    char const *name, isa_level_t isa)
+{
+    for (haversine_kernel_t const &k : c_haversine_kernel_variants) {
+        if (k.isa == isa && streq(k.name, name))
+            return &k;
+    }
+    return nullptr;
+}
+
+// Splits "<brand>\t<isa>\t<name>\n" in place
+inline bool parse_haversine_tuning_line(
+    char *line, char const *&brand, char const *&isa_name, char const *&name)
+{
+    char *tab0 = strchr(line, '\t');
+    char *tab1 = tab0 ? strchr(tab0 + 1, '\t') : nullptr;
+    if (!tab1)
+        return false;
+    *tab0 = *tab1 = '\0';
+    tab1[1 + strcspn(tab1 + 1, "\r\n")] = '\0';
+    brand = line;
+    isa_name = tab0 + 1;
+    name = tab1 + 1;
+    return true;
+}
+
+inline haversine_kernel_t const *load_haversine_tuning(
+    char const *fn, char const *cpu_brand, isa_level_t isa)
+{
+    FILE *f = fopen(fn, "r");
+    if (!f)
+        return nullptr;
+    DEFER([f] { fclose(f); });
+
+    char line[c_haversine_tuning_max_line];
+    while (fgets(line, sizeof(line), f)) {
+        char const *brand, *isa_name, *name;
+        if (!parse_haversine_tuning_line(line, brand, isa_name, name))
+            continue;
+        if (streq(brand, cpu_brand) && streq(isa_name, c_isa_names[isa])) {
+            if (haversine_kernel_t const *k = find_haversine_kernel_variant(name, isa))
+                return k;
+            // Stale entry from another build, recalibrate
+            LOGDBG("Unknown kernel '%s' in '%s'", name, fn);
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+inline bool save_haversine_tuning(
+    char const *fn, char const *cpu_brand, isa_level_t isa,
+    haversine_kernel_t const &kernel)
+{
+    // Cut short it could be fn itself, and opening it would wipe the cache
+    char tmp_fn[256];
+    int const tmp_len = snprintf(tmp_fn, sizeof(tmp_fn), "%s.tmp", fn);
+    if (tmp_len < 0 || usize(tmp_len) >= sizeof(tmp_fn)) {
+        LOGERR("Tuning cache path '%s' is too long", fn);
+        return false;
+    }
+
+    FILE *out = fopen(tmp_fn, "w");
+    if (!out) {
+        LOGERR("Failed to open %s for write, error: %s",
+            tmp_fn, strerror(errno));
+        return false;
+    }
+
+    // Keep entries for other cpus/isas
+    bool written = true;
+    if (FILE *in = fopen(fn, "r")) {
+        char line[c_haversine_tuning_max_line], parsed[c_haversine_tuning_max_line];
+        while (fgets(line, sizeof(line), in)) {
+            memcpy(parsed, line, sizeof(line));
+            char const *brand, *isa_name, *name;
+            if (!parse_haversine_tuning_line(parsed, brand, isa_name, name) ||
+                (streq(brand, cpu_brand) && streq(isa_name, c_isa_names[isa])))
+            {
+                continue;
+            }
+            written &= fputs(line, out) >= 0;
+        }
+        fclose(in);
+    }
+    written &= fprintf(out, "%s\t%s\t%s\n",
+        cpu_brand, c_isa_names[isa], kernel.name) > 0;
+
+    if (fclose(out) != 0 || !written || rename(tmp_fn, fn) != 0) {
+        LOGERR("Failed to write tuning cache '%s'", fn);
+        remove(tmp_fn);
+        return false;
+    }
+    return true;
+}
+
+// Times every variant for isa on the first pairs of s, answers get
+// overwritten
+inline haversine_kernel_t const &calibrate_haversine_kernel(
+    haversine_state_t const &s, isa_level_t isa)
+{
+    PROFILED_FUNCTION_PF;
+
+    u64 const cpu_timer_freq = measure_cpu_timer_freq(0.05l);
+
+    // Shallow, the kernels only touch pairs, answers and the sums
+    haversine_state_t sample = s;
+    sample.pair_cnt = min(s.pair_cnt, c_haversine_tuning_sample_pairs);
+    sample.base_sum = 0.0;
+
+    RepetitionTester rt{cpu_timer_freq, c_haversine_tuning_renew_sec};
+    repetition_test_results_t results{};
+    set_rtr_target_ops(results, sample.pair_cnt);
+
+    haversine_kernel_t const *best = &select_haversine_kernel(isa);
+    u64 best_ticks = u64(-1);
+    for (haversine_kernel_t const &k : c_haversine_kernel_variants) {
+        if (k.isa != isa)
+            continue;
+
+        rt.ReStart(results);
+        do {
+            rt.BeginTimeBlock();
+            k.calculate(sample);
+            rt.EndTimeBlock();
+            rt.ReportProcessedOps(sample.pair_cnt);
+        } while (rt.Tick());
+
+        LOGDBG("%s: %.3lfns/pair", k.name,
+            1e9 * large_divide(results.min_ticks, cpu_timer_freq) /
+                f64(max(sample.pair_cnt, u64(1))));
+        if (results.min_ticks < best_ticks) {
+            best_ticks = results.min_ticks;
+            best = &k;
+        }
+    }
+
+    return *best;
+}
+
+// Cached variant for this cpu if there is one, else calibrates and caches.
+// Null cache_fn calibrates every time.
+inline haversine_kernel_t const &select_tuned_haversine_kernel(
+    haversine_state_t const &s, cpu_features_t const &cpu, isa_level_t isa,
+    char const *cache_fn, bool recalibrate)
+{
+    bool has_variants = false;
+    for (haversine_kernel_t const &k : c_haversine_kernel_variants)
+        has_variants |= k.isa == isa;
+    if (!has_variants || s.pair_cnt == 0)
+        return select_haversine_kernel(isa);
+
+    if (cache_fn && !recalibrate) {
+        if (haversine_kernel_t const *k =
+                load_haversine_tuning(cache_fn, cpu.brand, isa))
+        {
+            return *k;
+        }
+    }
+
+    haversine_kernel_t const &k = calibrate_haversine_kernel(s, isa);
+    LOGDBG("Calibrated for %s: %s", cpu.brand, k.name);
+    if (cache_fn)
+        save_haversine_tuning(cache_fn, cpu.brand, isa, k);
+    return k;
+}
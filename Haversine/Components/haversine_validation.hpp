@@ -2,8 +2,15 @@
 
 #include "haversine_state.hpp"
 #include "haversine_common.hpp"
+#include "haversine_parallel.hpp"
 
+#include <random.hpp>
+#include <buffer.hpp>
+#include <intrinsics.hpp>
+#include <cpuid.hpp>
+#include <profiling.hpp>
 #include <logging.hpp>
+#include <defer.hpp>
 
 struct haversine_validation_result_t {
     f64 sum_error = 0.0;
@@ -11,31 +18,420 @@ struct haversine_validation_result_t {
     f64 max_error = 0.0;
     u64 answer_count_above_avg_error = 0;
     u64 answer_count_above_float_eps = 0;
+    // Distance in representable doubles between answer and reference,
+    // percentiles are bucket upper bounds
+    u64 ulp_error_p50 = 0;
+    u64 ulp_error_p90 = 0;
+    u64 ulp_error_p99 = 0;
+    u64 ulp_error_p999 = 0;
+    u64 max_ulp_error = 0;
+    // Sampled validation only, 0 when every answer was checked. Counts
+    // above are scaled up from the sample, and at the configured confidence
+    // at most exceed_max_error_cnt unchecked answers are above max_error.
+    u64 sample_cnt = 0;
+    f64 exceed_max_error_fraction = 0.0;
+    u64 exceed_max_error_cnt = 0;
 };
 
+// Validation is one pass: the average is not known until the end, so
+// errors go into a log-scale histogram (16 buckets per octave, from the
+// top mantissa bits) and the above-average count is read off it, exact
+// except inside the bucket the average lands in, where it is interpolated.
+// Ulp errors go into their own histogram for the percentiles.
+
+inline constexpr u32 c_haversine_error_sub_bits = 4;
+inline constexpr u32 c_haversine_error_min_exp = 1023 - 64; // 2^-64 and below
+inline constexpr u32 c_haversine_error_max_exp = 1023 + 16; // 2^16 and above
+inline constexpr u32 c_haversine_error_bucket_cnt =
+    (c_haversine_error_max_exp - c_haversine_error_min_exp) <<
+        c_haversine_error_sub_bits;
+
+// Ulp counts bucket the same way, through their value as a double: 8
+// buckets per octave, exact below 16, counts of 2^52 and more share the
+// last one
+inline constexpr u32 c_haversine_ulp_sub_bits = 3;
+inline constexpr u64 c_haversine_ulp_max_exact = (u64(1) << 52) - 1;
+inline constexpr u32 c_haversine_ulp_bucket_cnt =
+    (52 << c_haversine_ulp_sub_bits) + 1;
+
+// Smallest range worth giving a thread of its own
+inline constexpr u64 c_haversine_validation_min_range = 1 << 16;
+
+struct haversine_validation_partial_t {
+    f64 error_sum;
+    f64 max_error;
+    u64 count_above_float_eps;
+    u64 max_ulp_error;
+    u64 error_hist[c_haversine_error_bucket_cnt];
+    u64 ulp_hist[c_haversine_ulp_bucket_cnt];
+};
+
+FINLINE u32 haversine_error_bucket(f64 error)
+{
+    u64 bits;
+    memcpy(&bits, &error, sizeof(bits));
+    i64 const b = i64(bits >> (52 - c_haversine_error_sub_bits)) -
+        i64(c_haversine_error_min_exp << c_haversine_error_sub_bits);
+    return u32(clamp(b, i64(0), i64(c_haversine_error_bucket_cnt - 1)));
+}
+
+inline f64 haversine_error_bucket_start(u32 bucket)
+{
+    u64 const bits = (u64(bucket) +
+        (u64(c_haversine_error_min_exp) << c_haversine_error_sub_bits)) <<
+            (52 - c_haversine_error_sub_bits);
+    f64 v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+// Sign-magnitude to two's complement, so that adjacent doubles are adjacent
+// integers across zero too
+FINLINE i64 haversine_ordered_bits(f64 v)
+{
+    i64 bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return bits < 0 ? bits ^ INT64_MAX : bits;
+}
+
+FINLINE u64 haversine_ulp_distance(f64 a, f64 b)
+{
+    i64 const d = haversine_ordered_bits(a) - haversine_ordered_bits(b);
+    return d < 0 ? u64(0) - u64(d) : u64(d);
+}
+
+// Bucket 0 is exact matches, 1 starts at one ulp
+FINLINE u32 haversine_ulp_bucket(u64 ulps)
+{
+    f64 const v = f64(min(ulps, c_haversine_ulp_max_exact));
+    u64 bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return ulps == 0 ? 0 : u32((bits >> (52 - c_haversine_ulp_sub_bits)) -
+        (u64(1023) << c_haversine_ulp_sub_bits) + 1);
+}
+
+// Largest ulp count in bucket
+inline u64 haversine_ulp_bucket_end(u32 bucket)
+{
+    if (bucket == 0)
+        return 0;
+    if (bucket + 1 >= c_haversine_ulp_bucket_cnt)
+        return u64(-1);
+    u64 const next_bits = (u64(bucket) +
+        (u64(1023) << c_haversine_ulp_sub_bits)) <<
+            (52 - c_haversine_ulp_sub_bits);
+    f64 next;
+    memcpy(&next, &next_bits, sizeof(next));
+    return u64(ceil(next)) - 1;
+}
+
+FINLINE void add_haversine_error_sample(
+    haversine_validation_partial_t &p, f64 ans, f64 ref)
+{
+    f64 const error = abs(ans - ref);
+    p.error_sum += error;
+    p.max_error = max(p.max_error, error);
+    if (error > FLT_EPSILON)
+        ++p.count_above_float_eps;
+    ++p.error_hist[haversine_error_bucket(error)];
+
+    u64 const ulps = haversine_ulp_distance(ans, ref);
+    p.max_ulp_error = max(p.max_ulp_error, ulps);
+    ++p.ulp_hist[haversine_ulp_bucket(ulps)];
+}
+
+inline void validate_haversine_range_scalar(
+    haversine_validation_partial_t &p,
+    f64 const *answers, f64 const *refs, u64 cnt)
+{
+    for (u64 i = 0; i < cnt; ++i)
+        add_haversine_error_sample(p, answers[i], refs[i]);
+}
+
+ISA_REGION_BEGIN_AVX2
+
+inline void validate_haversine_range_avx2(
+    haversine_validation_partial_t &p,
+    f64 const *answers, f64 const *refs, u64 cnt)
+{
+    __m256d const abs_mask =
+        _mm256_castsi256_pd(_mm256_set1_epi64x(INT64_MAX));
+    __m256d const flt_eps = _mm256_set1_pd(FLT_EPSILON);
+    __m256i const zero = _mm256_setzero_si256();
+    // Low dwords of the 4 qwords into the low half
+    __m256i const low_dwords = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    __m128i const bucket_base = _mm_set1_epi32(
+        i32(c_haversine_error_min_exp << c_haversine_error_sub_bits));
+    __m128i const bucket_last = _mm_set1_epi32(
+        i32(c_haversine_error_bucket_cnt - 1));
+
+    __m256i const ulp_max_exact =
+        _mm256_set1_epi64x(i64(c_haversine_ulp_max_exact));
+    __m256i const two52_bits = _mm256_set1_epi64x(0x4330000000000000ll);
+    // ulps of 0 come out as 2^52 - 2^52 = 0.0, which the max puts in bucket 0
+    __m128i const ulp_bucket_base =
+        _mm_set1_epi32(i32((1023 << c_haversine_ulp_sub_bits) - 1));
+
+    __m256d sum = _mm256_setzero_pd();
+    __m256d max_err = _mm256_setzero_pd();
+    __m256i above_eps = _mm256_setzero_si256();
+    __m256i max_ulps = _mm256_setzero_si256();
+
+    u64 i = 0;
+    for (; i + 4 <= cnt; i += 4) {
+        __m256d const ans = _mm256_loadu_pd(answers + i);
+        __m256d const ref = _mm256_loadu_pd(refs + i);
+        __m256d const error = _mm256_and_pd(_mm256_sub_pd(ans, ref), abs_mask);
+
+        sum = _mm256_add_pd(sum, error);
+        max_err = _mm256_max_pd(error, max_err);
+        above_eps = _mm256_sub_epi64(above_eps, _mm256_castpd_si256(
+            _mm256_cmp_pd(error, flt_eps, _CMP_GT_OQ)));
+
+        // Exponent and top mantissa bits fit in 16, clamp in 32 bit lanes
+        __m256i const key = _mm256_srli_epi64(
+            _mm256_castpd_si256(error), 52 - c_haversine_error_sub_bits);
+        __m128i bucket = _mm256_castsi256_si128(
+            _mm256_permutevar8x32_epi32(key, low_dwords));
+        bucket = _mm_min_epi32(
+            _mm_max_epi32(_mm_sub_epi32(bucket, bucket_base),
+                _mm_setzero_si128()),
+            bucket_last);
+
+        __m256i ans_bits = _mm256_castpd_si256(ans);
+        __m256i ref_bits = _mm256_castpd_si256(ref);
+        ans_bits = _mm256_xor_si256(ans_bits, _mm256_srli_epi64(
+            _mm256_cmpgt_epi64(zero, ans_bits), 1));
+        ref_bits = _mm256_xor_si256(ref_bits, _mm256_srli_epi64(
+            _mm256_cmpgt_epi64(zero, ref_bits), 1));
+        __m256i ulps = _mm256_sub_epi64(ans_bits, ref_bits);
+        __m256i const neg = _mm256_cmpgt_epi64(zero, ulps);
+        ulps = _mm256_sub_epi64(_mm256_xor_si256(ulps, neg), neg);
+        max_ulps = _mm256_blendv_epi8(
+            max_ulps, ulps, _mm256_cmpgt_epi64(ulps, max_ulps));
+
+        // No cvtepi64_pd in avx2, but below 2^52 or-ing in the exponent
+        // of 2^52 and subtracting it is exact
+        __m256i const exact = _mm256_blendv_epi8(
+            ulps, ulp_max_exact, _mm256_cmpgt_epi64(ulps, ulp_max_exact));
+        __m256d const ulps_f64 = _mm256_sub_pd(
+            _mm256_castsi256_pd(_mm256_or_si256(exact, two52_bits)),
+            _mm256_castsi256_pd(two52_bits));
+        __m256i const ulp_key = _mm256_srli_epi64(
+            _mm256_castpd_si256(ulps_f64), 52 - c_haversine_ulp_sub_bits);
+        __m128i ulp_bucket = _mm256_castsi256_si128(
+            _mm256_permutevar8x32_epi32(ulp_key, low_dwords));
+        ulp_bucket = _mm_max_epi32(
+            _mm_sub_epi32(ulp_bucket, ulp_bucket_base), _mm_setzero_si128());
+
+        // No scatter in avx2, and lanes may hit the same bucket anyway
+        alignas(16) u32 buckets[4], ulp_buckets[4];
+        _mm_store_si128((__m128i *)buckets, bucket);
+        _mm_store_si128((__m128i *)ulp_buckets, ulp_bucket);
+        for (u32 l = 0; l < 4; ++l) {
+            ++p.error_hist[buckets[l]];
+            ++p.ulp_hist[ulp_buckets[l]];
+        }
+    }
+
+    alignas(32) f64 sums[4], maxes[4];
+    alignas(32) u64 counts[4], lane_max_ulps[4];
+    _mm256_store_pd(sums, sum);
+    _mm256_store_pd(maxes, max_err);
+    _mm256_store_si256((__m256i *)counts, above_eps);
+    _mm256_store_si256((__m256i *)lane_max_ulps, max_ulps);
+    for (u32 l = 0; l < 4; ++l) {
+        p.error_sum += sums[l];
+        p.max_error = max(p.max_error, maxes[l]);
+        p.count_above_float_eps += counts[l];
+        p.max_ulp_error = max(p.max_ulp_error, lane_max_ulps[l]);
+    }
+
+    validate_haversine_range_scalar(p, answers + i, refs + i, cnt - i);
+}
+
+ISA_REGION_END
+
+// Smallest bucket end with at least q of the samples at or below it
+inline u64 haversine_ulp_percentile(
+    u64 const (&hist)[c_haversine_ulp_bucket_cnt], u64 total, u64 max_ulps,
+    f64 q)
+{
+    u64 const target = max(u64(ceil(q * f64(total))), u64(1));
+    u64 seen = 0;
+    for (u32 b = 0; b < c_haversine_ulp_bucket_cnt; ++b) {
+        seen += hist[b];
+        if (seen >= target)
+            return min(haversine_ulp_bucket_end(b), max_ulps);
+    }
+    return max_ulps;
+}
+
+// Counts are scaled up from sample_cnt checked answers to pair_cnt
+inline void finish_haversine_validation(
+    haversine_validation_result_t &results,
+    haversine_validation_partial_t const &total,
+    u64 sample_cnt, u64 pair_cnt)
+{
+    f64 const scale = f64(pair_cnt) / f64(sample_cnt);
+
+    results.avg_error = total.error_sum / f64(sample_cnt);
+    results.max_error = total.max_error;
+    results.answer_count_above_float_eps =
+        u64(f64(total.count_above_float_eps) * scale + 0.5);
+    results.max_ulp_error = total.max_ulp_error;
+
+    // Nothing is above a zero average, and bucket 0 holds the zeros
+    if (results.avg_error > 0.0) {
+        u32 const avg_bucket = haversine_error_bucket(results.avg_error);
+        f64 above = 0.0;
+        for (u32 b = avg_bucket + 1; b < c_haversine_error_bucket_cnt; ++b)
+            above += f64(total.error_hist[b]);
+        if (avg_bucket + 1 < c_haversine_error_bucket_cnt) {
+            f64 const lo = haversine_error_bucket_start(avg_bucket);
+            f64 const hi = haversine_error_bucket_start(avg_bucket + 1);
+            above += f64(total.error_hist[avg_bucket]) *
+                clamp((hi - results.avg_error) / (hi - lo), 0.0, 1.0);
+        }
+        results.answer_count_above_avg_error = u64(above * scale + 0.5);
+    }
+
+    results.ulp_error_p50 = haversine_ulp_percentile(
+        total.ulp_hist, sample_cnt, total.max_ulp_error, 0.5);
+    results.ulp_error_p90 = haversine_ulp_percentile(
+        total.ulp_hist, sample_cnt, total.max_ulp_error, 0.9);
+    results.ulp_error_p99 = haversine_ulp_percentile(
+        total.ulp_hist, sample_cnt, total.max_ulp_error, 0.99);
+    results.ulp_error_p999 = haversine_ulp_percentile(
+        total.ulp_hist, sample_cnt, total.max_ulp_error, 0.999);
+}
+
+// Partials are merged in range order, so the result only depends on the
+// thread count, not on scheduling
 inline haversine_validation_result_t
-validate_haversine_distances(haversine_state_t const &s)
+validate_haversine_distances(
+    haversine_state_t const &s, isa_level_t isa = e_isa_scalar,
+    u32 thread_cnt = 1)
 {
+    PROFILED_BANDWIDTH_FUNCTION_PF(2 * s.pair_cnt * sizeof(f64));
+
     assert(s.validation_answers);
     haversine_validation_result_t results = {};
-    for (u32 i = 0; i < s.pair_cnt; ++i) {
-        f64 const ans = s.answers[i];
-        f64 const ref = s.validation_answers[i];
-        f64 const error = abs(ans - ref);
-        results.avg_error += error;
-        results.max_error = max(results.max_error, error);
-        if (error > FLT_EPSILON)
-            ++results.answer_count_above_float_eps;
+    results.sum_error = abs(s.sum_answer - s.validation_sum);
+    if (s.pair_cnt == 0)
+        return results;
+
+    u64 const range_cnt = max(min(
+        s.pair_cnt / c_haversine_validation_min_range,
+        u64(min(thread_cnt, c_haversine_max_threads))), u64(1));
+    u64 const range_len = round_up(
+        (s.pair_cnt + range_cnt - 1) / range_cnt, u64(4));
+
+    buffer_t partials_buf = allocate(
+        range_cnt * sizeof(haversine_validation_partial_t));
+    if (!is_valid(partials_buf)) {
+        LOGERR("Failed to allocate validation histograms");
+        return results;
+    }
+    DEFER([&] { deallocate(partials_buf); });
+    // Fresh os pages are zeroed
+    haversine_validation_partial_t *partials =
+        (haversine_validation_partial_t *)partials_buf.data;
+
+    auto validate_range = [&](u64 r) {
+        u64 const begin = min(r * range_len, s.pair_cnt);
+        u64 const cnt = min(begin + range_len, s.pair_cnt) - begin;
+        PROFILED_BANDWIDTH_BLOCK("Validation range", 2 * cnt * sizeof(f64));
+        if (isa >= e_isa_avx2) {
+            validate_haversine_range_avx2(partials[r],
+                s.answers + begin, s.validation_answers + begin, cnt);
+        } else {
+            validate_haversine_range_scalar(partials[r],
+                s.answers + begin, s.validation_answers + begin, cnt);
+        }
+    };
+    run_haversine_parallel(range_cnt, u32(range_cnt), validate_range);
+
+    haversine_validation_partial_t &total = partials[0];
+    for (u64 r = 1; r < range_cnt; ++r) {
+        haversine_validation_partial_t const &p = partials[r];
+        total.error_sum += p.error_sum;
+        total.max_error = max(total.max_error, p.max_error);
+        total.count_above_float_eps += p.count_above_float_eps;
+        total.max_ulp_error = max(total.max_ulp_error, p.max_ulp_error);
+        for (u32 b = 0; b < c_haversine_error_bucket_cnt; ++b)
+            total.error_hist[b] += p.error_hist[b];
+        for (u32 b = 0; b < c_haversine_ulp_bucket_cnt; ++b)
+            total.ulp_hist[b] += p.ulp_hist[b];
     }
-    results.avg_error /= f64(s.pair_cnt);
+
+    finish_haversine_validation(results, total, s.pair_cnt, s.pair_cnt);
+    return results;
+}
+
+// Production runs don't need every answer checked: one answer per stratum
+// of pair_cnt / sample_cnt, at a seeded random offset, so the same run
+// always checks the same answers and they are visited in order. With the
+// checksum file mapped (see load_haversine_checksum), only the sampled pages
+// of it are ever read. The sum is still checked exactly.
+//
+// The max error is only the max over the sample. What the sample does bound
+// is how many answers can be worse: if a fraction p of all answers were
+// above it, a sample of m would miss all of them with probability (1-p)^m,
+// so at confidence 1-a, p <= 1 - a^(1/m) (~3/m at 95%).
+
+inline constexpr u64 c_haversine_validation_sample_seed = 0x5A3D1E5Cull;
+inline constexpr f64 c_haversine_validation_confidence = 0.95;
+
+inline haversine_validation_result_t
+validate_haversine_distances_sampled(
+    haversine_state_t const &s, f64 sample_rate,
+    u64 seed = c_haversine_validation_sample_seed)
+{
+    assert(s.validation_answers);
+    assert(sample_rate > 0.0 && sample_rate <= 1.0);
+
+    haversine_validation_result_t results = {};
     results.sum_error = abs(s.sum_answer - s.validation_sum);
-    for (u32 i = 0; i < s.pair_cnt; ++i) {
-        f64 const ans = s.answers[i];
-        f64 const ref = s.validation_answers[i];
-        f64 const error = abs(ans - ref);
-        if (error > results.avg_error)
-            ++results.answer_count_above_avg_error;
+    if (s.pair_cnt == 0)
+        return results;
+
+    u64 const sample_cnt = max(
+        min(u64(ceil(sample_rate * f64(s.pair_cnt))), s.pair_cnt), u64(1));
+
+    PROFILED_BANDWIDTH_FUNCTION_PF(2 * sample_cnt * sizeof(f64));
+
+    buffer_t partial_buf = allocate(sizeof(haversine_validation_partial_t));
+    if (!is_valid(partial_buf)) {
+        LOGERR("Failed to allocate validation histograms");
+        return results;
     }
+    DEFER([&] { deallocate(partial_buf); });
+    haversine_validation_partial_t &total =
+        *(haversine_validation_partial_t *)partial_buf.data;
+
+    // Strata sizes differ by at most one, the first pair_cnt % sample_cnt
+    // get the extra pair
+    u64 const stratum_len = s.pair_cnt / sample_cnt;
+    u64 const longer_cnt = s.pair_cnt % sample_cnt;
+    rng_state_t rng = make_rng_state(seed);
+    for (u64 k = 0; k < sample_cnt; ++k) {
+        u64 const begin = k * stratum_len + min(k, longer_cnt);
+        u64 const len = stratum_len + (k < longer_cnt ? 1 : 0);
+        u64 offset;
+        i_mul_wide(rng_next(rng), len, offset);
+        u64 const i = begin + offset;
+        add_haversine_error_sample(total, s.answers[i], s.validation_answers[i]);
+    }
+
+    finish_haversine_validation(results, total, sample_cnt, s.pair_cnt);
+
+    results.sample_cnt = sample_cnt;
+    results.exceed_max_error_fraction = -expm1(
+        log(1.0 - c_haversine_validation_confidence) / f64(sample_cnt));
+    results.exceed_max_error_cnt = u64(
+        ceil(results.exceed_max_error_fraction * f64(s.pair_cnt - sample_cnt)));
+
     return results;
 }
 
@@ -48,6 +444,64 @@ inline void print_haversine_validation_results(
         results.sum_error, results.avg_error, results.max_error,
         results.answer_count_above_avg_error,
         results.answer_count_above_float_eps);
+    fprintf(stderr,
+        "UlpError: p50<=%llu p90<=%llu p99<=%llu p99.9<=%llu max=%llu\n",
+        (unsigned long long)results.ulp_error_p50,
+        (unsigned long long)results.ulp_error_p90,
+        (unsigned long long)results.ulp_error_p99,
+        (unsigned long long)results.ulp_error_p999,
+        (unsigned long long)results.max_ulp_error);
+    if (results.sample_cnt) {
+        fprintf(stderr,
+            "Sampled %llu answers, counts scaled: at %.0lf%% confidence "
+            "at most %.3g of answers (%llu unchecked) are above MaxError\n",
+            (unsigned long long)results.sample_cnt,
+            100.0 * c_haversine_validation_confidence,
+            results.exceed_max_error_fraction,
+            (unsigned long long)results.exceed_max_error_cnt);
+    }
+}
+
+// Puts the accuracy cost of compact storage next to its bandwidth win
+inline void print_haversine_storage_info(haversine_state_t const &s)
+{
+    if (s.f32_pairs) {
+        f64 max_coord_error = 0.0;
+        for (u64 i = 0; i < s.pair_cnt; ++i) {
+            f64 const *ref = &s.pairs[i].x0;
+            f32 const *narrow = &s.f32_pairs[i].x0;
+            for (u32 j = 0; j < 4; ++j)
+                max_coord_error = max(max_coord_error, abs(narrow[j] - ref[j]));
+        }
+
+        fprintf(stderr,
+            "Storage: f32 degrees, %llu bytes/pair, MaxCoordError=%.3g deg\n",
+            (unsigned long long)sizeof(point_pair_f32_t), max_coord_error);
+        return;
+    }
+
+    if (!s.quantized_pairs) {
+        fprintf(stderr, "Storage: f64 degrees, %llu bytes/pair\n",
+            (unsigned long long)sizeof(point_pair_t));
+        return;
+    }
+
+    f64 max_coord_error = 0.0;
+    for (u64 i = 0; i < s.pair_cnt; ++i) {
+        f64 const *ref = &s.pairs[i].x0;
+        i32 const *q = &s.quantized_pairs[i].x0;
+        for (u32 j = 0; j < 4; ++j) {
+            f64 const deq = f64(q[j]) / c_quantized_units_per_deg;
+            max_coord_error = max(max_coord_error, abs(deq - ref[j]));
+        }
+    }
+
+    fprintf(stderr,
+        "Storage: i32 microdegrees, %llu bytes/pair "
+        "(%.1lfx less input traffic than f64), MaxCoordError=%.3g deg\n",
+        (unsigned long long)sizeof(quantized_point_pair_t),
+        f64(sizeof(point_pair_t)) / f64(sizeof(quantized_point_pair_t)),
+        max_coord_error);
 }
 
 inline void merge_worst_haversine_validation_result(
@@ -63,4 +517,15 @@ inline void merge_worst_haversine_validation_result(
     accum.answer_count_above_float_eps = max(
         accum.answer_count_above_float_eps,
         new_result.answer_count_above_float_eps);
+    accum.ulp_error_p50 = max(accum.ulp_error_p50, new_result.ulp_error_p50);
+    accum.ulp_error_p90 = max(accum.ulp_error_p90, new_result.ulp_error_p90);
+    accum.ulp_error_p99 = max(accum.ulp_error_p99, new_result.ulp_error_p99);
+    accum.ulp_error_p999 =
+        max(accum.ulp_error_p999, new_result.ulp_error_p999);
+    accum.max_ulp_error = max(accum.max_ulp_error, new_result.max_ulp_error);
+    accum.sample_cnt = max(accum.sample_cnt, new_result.sample_cnt);
+    accum.exceed_max_error_fraction = max(
+        accum.exceed_max_error_fraction, new_result.exceed_max_error_fraction);
+    accum.exceed_max_error_cnt =
+        max(accum.exceed_max_error_cnt, new_result.exceed_max_error_cnt);
 }
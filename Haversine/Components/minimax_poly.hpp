@@ -0,0 +1,90 @@
+#pragma once
+
+#include <defs.hpp>
+#include <intrinsics.hpp>
+
+// Odd polynomial approximations f(x) ~= x * P(x^2). Tables of these, one
+// per coefficient count, are generated by HaversineMathTests/minimax_remez
+// into minimax_tables.hpp. max_error* are the relative approximation errors
+// on the table's interval with coeffs rounded to f64/f32, evaluation
+// rounding not included.
+
+inline constexpr u32 c_minimax_max_coeffs = 20;
+
+struct minimax_poly_t {
+    u32 coeff_cnt;
+    f64 max_error64;
+    f64 max_error32;
+    f64 coeffs[c_minimax_max_coeffs]; // Lowest power first
+};
+
+// Cheapest polynomial within the error budget, fails to compile if the
+// table has none
+template <usize t_n>
+consteval minimax_poly_t select_minimax_poly64(
+    minimax_poly_t const (&polys)[t_n], f64 max_error)
+{
+    for (minimax_poly_t const &p : polys) {
+        if (p.max_error64 <= max_error)
+            return p;
+    }
+    throw "No polynomial in the table meets the error budget";
+}
+
+template <usize t_n>
+consteval minimax_poly_t select_minimax_poly32(
+    minimax_poly_t const (&polys)[t_n], f64 max_error)
+{
+    for (minimax_poly_t const &p : polys) {
+        if (p.max_error32 <= max_error)
+            return p;
+    }
+    throw "No polynomial in the table meets the error budget";
+}
+
+// Horner evaluators, coeff_cnt - 1 fmas + 1 mul. x2 = x * x is taken
+// separately since callers often have it already.
+
+ISA_REGION_BEGIN_AVX2
+
+template <minimax_poly_t t_poly>
+FINLINE __m128d odd_poly_sd(__m128d x2, __m128d x)
+{
+    __m128d r = _mm_set_sd(t_poly.coeffs[t_poly.coeff_cnt - 1]);
+    for (u32 i = t_poly.coeff_cnt - 1; i-- > 0;)
+        r = _mm_fmadd_sd(r, x2, _mm_set_sd(t_poly.coeffs[i]));
+    return _mm_mul_sd(r, x);
+}
+
+template <minimax_poly_t t_poly>
+FINLINE __m256d odd_poly_pd(__m256d x2, __m256d x)
+{
+    __m256d r = _mm256_set1_pd(t_poly.coeffs[t_poly.coeff_cnt - 1]);
+    for (u32 i = t_poly.coeff_cnt - 1; i-- > 0;)
+        r = _mm256_fmadd_pd(r, x2, _mm256_set1_pd(t_poly.coeffs[i]));
+    return _mm256_mul_pd(r, x);
+}
+
+template <minimax_poly_t t_poly>
+FINLINE __m256 odd_poly_ps(__m256 x2, __m256 x)
+{
+    __m256 r = _mm256_set1_ps(f32(t_poly.coeffs[t_poly.coeff_cnt - 1]));
+    for (u32 i = t_poly.coeff_cnt - 1; i-- > 0;)
+        r = _mm256_fmadd_ps(r, x2, _mm256_set1_ps(f32(t_poly.coeffs[i])));
+    return _mm256_mul_ps(r, x);
+}
+
+ISA_REGION_END
+
+ISA_REGION_BEGIN_AVX512
+
+template <minimax_poly_t t_poly>
+FINLINE __m512d odd_poly_pd512(__m512d x2, __m512d x)
+{
+    __m512d r = _mm512_set1_pd(t_poly.coeffs[t_poly.coeff_cnt - 1]);
+    for (u32 i = t_poly.coeff_cnt - 1; i-- > 0;)
+        r = _mm512_fmadd_pd(r, x2, _mm512_set1_pd(t_poly.coeffs[i]));
+    return _mm512_mul_pd(r, x);
+}
+
+ISA_REGION_END
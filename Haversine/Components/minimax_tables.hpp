@@ -0,0 +1,42 @@
+#pragma once
+
+// Generated by HaversineMathTests/minimax_remez.cpp, do not edit
+
+#include "minimax_poly.hpp"
+
+// sin(x) ~= x * P(x^2) on [0, 1.5707963267948966]
+inline constexpr minimax_poly_t c_sin_minimax_polys[] =
+{
+    {2, 0x1.5416067b6cfdep-7, 0x1.541616b775848p-7, {0x1p+0, -0x1.33191ebac7744p-3}},
+    {3, 0x1.1cc66104ec0c1p-13, 0x1.1cc9ad8307e44p-13, {0x1p+0, -0x1.543b8a52fbe3fp-3, 0x1.f5c77e76a1e78p-8}},
+    {4, 0x1.2980e1b8a0cc7p-20, 0x1.2dd0d63232fp-20, {0x1p+0, -0x1.55511193f23e4p-3, 0x1.107130e389943p-7, -0x1.84dbc9fa0918bp-13}},
+    {5, 0x1.a00d87bc3f81cp-28, 0x1.4c5d75c3e08ccp-27, {0x1p+0, -0x1.55554bc830e42p-3, 0x1.110ed37ef0505p-7, -0x1.9f6ffeacff2cdp-13, 0x1.5dbdedc62f61dp-19}},
+    {6, 0x1.9e65cccfe79cfp-36, 0x1.7d57f8c528p-26, {0x1p+0, -0x1.555555476963dp-3, 0x1.11110c49fc651p-7, -0x1.a017d99eafb8ap-13, 0x1.71707ff58b5b1p-19, -0x1.9a68841bae375p-26}},
+    {7, 0x1.344b34d09db82p-44, 0x1.03609dad84p-26, {0x1p+0, -0x1.5555555547141p-3, 0x1.1111110a55907p-7, -0x1.a019fd594e8e1p-13, 0x1.71dcf84b704f8p-19, -0x1.ae03f83306232p-26, 0x1.52dbebc25e1efp-33}},
+    {8, 0x1.9a0c743926b69p-53, 0x1.047eefdf6p-26, {0x1p+0, -0x1.55555555554a8p-3, 0x1.111111110a57p-7, -0x1.a01a019a65861p-13, 0x1.71de3806a7d59p-19, -0x1.ae6355a91af2dp-26, 0x1.60e6beadb46ddp-33, -0x1.9f1512caf552cp-41}},
+    {9, 0x1.e0000002502d2p-59, 0x1.04791cc2ecp-26, {0x1p+0, -0x1.5555555555555p-3, 0x1.11111111110d7p-7, -0x1.a01a01a015c5bp-13, 0x1.71de3a530a06fp-19, -0x1.ae64550522c5ap-26, 0x1.6123d94163416p-33, -0x1.ae46adf1c9e57p-41, 0x1.888717254f11fp-49}},
+};
+
+// asin(x) ~= x * P(x^2) on [0, 0.70710678118654757]
+inline constexpr minimax_poly_t c_asin_minimax_polys[] =
+{
+    {2, 0x1.50e5861cdb32dp-8, 0x1.50e58027f1844p-8, {0x1p+0, 0x1.ae1ff4dca6e1dp-3}},
+    {3, 0x1.e7ded61ea2953p-12, 0x1.e7df0009c8629p-12, {0x1p+0, 0x1.422c04bf2ecc5p-3, 0x1.02726a4adab42p-3}},
+    {4, 0x1.ad7d253ad4571p-15, 0x1.ad83f68bc3cf2p-15, {0x1p+0, 0x1.5931290928da8p-3, 0x1.bfaae53925fp-5, 0x1.a107a76acae95p-4}},
+    {5, 0x1.a3111b6d561e2p-18, 0x1.a34b79ad8824fp-18, {0x1p+0, 0x1.5495ad046660dp-3, 0x1.4dc1cf7b44059p-4, 0x1.51efa14f9bebep-7, 0x1.82df5fa38edc6p-4}},
+    {6, 0x1.b3e158fc6a776p-21, 0x1.b56c3d042653ap-21, {0x1p+0, 0x1.5579a8f991fbdp-3, 0x1.2bbdc9c330894p-4, 0x1.ea2f8e4238e8bp-5, -0x1.6d304f8b8913ap-6, 0x1.855aba60b1a72p-4}},
+    {7, 0x1.d990fc0c6ba5ep-24, 0x1.e592d62268e0bp-24, {0x1p+0, 0x1.554e8eadb0db3p-3, 0x1.35210ab25299dp-4, 0x1.3f900bf271963p-5, 0x1.efdfbbf7982fcp-5, -0x1.c04b9b94fe8p-5, 0x1.9d561dc629d2ap-4}},
+    {8, 0x1.0988ae13fccp-26, 0x1.3aa5498c2037cp-26, {0x1p+0, 0x1.555695270ddf3p-3, 0x1.32bab9d59f9a9p-4, 0x1.7cea85f060bb6p-5, 0x1.0ce90ef247277p-6, 0x1.3af70f83251bp-4, -0x1.7adf832339a98p-4, 0x1.c7a5cdcc31be3p-4}},
+    {9, 0x1.31085c9e11p-29, 0x1.38c1eeb2c2826p-28, {0x1p+0, 0x1.55551ae31fbd6p-3, 0x1.334f551db8969p-4, 0x1.691e287b77479p-5, 0x1.26d755aede342p-5, -0x1.080e05296c1b5p-7, 0x1.c3eaa6d0c5d8ep-4, -0x1.1ea8503b68052p-3, 0x1.0248bf993cc25p-3}},
+    {10, 0x1.651c09c619432p-32, 0x1.657e71e890cfep-31, {0x1p+0, 0x1.55555ff0c6f24p-3, 0x1.332cd9a32de9cp-4, 0x1.6f0436b973b62p-5, 0x1.d08a966e058b4p-6, 0x1.2dad5ea22d782p-5, -0x1.64a7c6d16de0ep-5, 0x1.548781f15906ep-3, -0x1.9d543e40e72b2p-3, 0x1.2b3b2d9232382p-3}},
+    {11, 0x1.a8831498d1878p-35, 0x1.e466c8efbcd08p-30, {0x1p+0, 0x1.5555536b40b5ep-3, 0x1.33349843b8fa2p-4, 0x1.6d5d25d62f464p-5, 0x1.fcdded92e9d1cp-6, 0x1.0ab07de26fdb1p-6, 0x1.a03bca587c286p-5, -0x1.9ccd445671dcdp-4, 0x1.040248e25d059p-2, -0x1.22a4d98af9394p-2, 0x1.60b3a3352b68bp-3}},
+    {12, 0x1.ff0be9e41ff1p-38, 0x1.a0c4e8341154ap-31, {0x1p+0, 0x1.555555ad60cf4p-3, 0x1.3332e67f0d4dap-4, 0x1.6dce0390f5837p-5, 0x1.ee4edcce30bd4p-6, 0x1.94f0641676ea7p-6, 0x1.3e38c309fd0f5p-10, 0x1.5eea381bc0cfdp-4, -0x1.8ff0eae9f2058p-3, 0x1.8c664f86b5ba4p-2, -0x1.92faeae2c82cfp-2, 0x1.a59d01f435d6ap-3}},
+    {13, 0x1.36df612fe9b18p-40, 0x1.b30eb9db45c78p-29, {0x1p+0, 0x1.55555545937edp-3, 0x1.3333435fbef31p-4, 0x1.6db1150e72e4p-5, 0x1.f2ced1ebf9b75p-6, 0x1.60d67f27d232p-6, 0x1.8f8969bb9fa94p-6, -0x1.99f20e7c0d136p-6, 0x1.40b395f6f3ba8p-3, -0x1.66f2552157867p-2, 0x1.2c120811b2972p-1, -0x1.14f8f1774f127p-1, 0x1.fde93073baf61p-3}},
+    {14, 0x1.7da68f2d6f7ap-43, 0x1.5246055efa25bp-29, {0x1p+0, 0x1.5555555824eb1p-3, 0x1.33332fd7bdadp-4, 0x1.6db8418e26045p-5, 0x1.f17c2d4d48273p-6, 0x1.732656824775ap-6, 0x1.dc17892500179p-7, 0x1.0e164956a5c53p-5, -0x1.386a12be9b20dp-4, 0x1.2926acce396c3p-2, -0x1.3476a29a0b823p-1, 0x1.c288a1e8576c9p-1, -0x1.7aab2b3fe754cp-1, 0x1.3767c29f25809p-2}},
+    {15, 0x1.d8298173d1a16p-46, 0x1.25eed536bae2p-29, {0x1p+0, 0x1.55555554d5539p-3, 0x1.333333e334f6dp-4, 0x1.6db686cce90efp-5, 0x1.f1dba074ad412p-6, 0x1.6d137e3f281a6p-6, 0x1.2da97655f5f4ap-6, 0x1.6772fb0210a95p-8, 0x1.e2ceabce8fc6fp-5, -0x1.6b8ed2f0a92b6p-3, 0x1.100bfeae0a5a9p-1, -0x1.018429c2649b4p+0, 0x1.4f7a15778c31ep+0, -0x1.01f14aedd812bp+0, 0x1.7f9321b7755bcp-2}},
+    {16, 0x1.2637c22d9a7b2p-48, 0x1.b9cf555506fe5p-29, {0x1p+0, 0x1.555555556c0dbp-3, 0x1.3333330f92e48p-4, 0x1.6db6ef00a2e95p-5, 0x1.f1c1abce77f54p-6, 0x1.6efe887c2bef5p-6, 0x1.1628f83882853p-6, 0x1.1e665972a993cp-6, -0x1.8025c36166a9p-7, 0x1.ee0ba69daa132p-4, -0x1.7ea67a7e73719p-2, 0x1.e8891a5db688ep-1, -0x1.a4e6f54c04ba7p+0, 0x1.efe868c204c01p+0, -0x1.5e99fabf99158p+0, 0x1.dbee7799152f6p-2}},
+    {17, 0x1.72b3dbb6a51dp-51, 0x1.78c3152ed575p-29, {0x1p+0, 0x1.55555555514f5p-3, 0x1.3333333a566afp-4, 0x1.6db6d6fc339d4p-5, 0x1.f1c8839b7a222p-6, 0x1.6e69d70c274f9p-6, 0x1.1e6197cec7c27p-6, 0x1.9cb968809dd57p-7, 0x1.6a79e93b4283cp-6, -0x1.972d3cbcf26f6p-5, 0x1.04cae73538cb7p-2, -0x1.7d1296260b3cdp-1, 0x1.ade3122b699efp+0, -0x1.52477e3b40e0ep+1, 0x1.6c1f0031fa5cap+1, -0x1.dbd13eaa38181p+0, 0x1.29265c1ec812fp-1}},
+    {18, 0x1.e23d4e66e4967p-54, 0x1.85243238b7aedp-29, {0x1p+0, 0x1.55555555560b6p-3, 0x1.33333331c8738p-4, 0x1.6db6dc6bb176fp-5, 0x1.f1c6c20e21193p-6, 0x1.6e95410cc4eebp-6, 0x1.1ba333df9f39p-6, 0x1.da2b2eb449d49p-7, 0x1.ce9ed9a8f7735p-8, 0x1.409f9034df2acp-5, -0x1.144dbf78a8759p-3, 0x1.102d06faf2bd4p-1, -0x1.6d77f6dd63d3p+0, 0x1.733d44a04cc96p+1, -0x1.0c307fef9052bp+2, 0x1.09cf43a6fa367p+2, -0x1.428c4d814c478p+1, 0x1.752308f482943p-1}},
+    {19, 0x1.1fc08c0ec2303p-55, 0x1.a80021aa34253p-29, {0x1p+0, 0x1.5555555555472p-3, 0x1.33333333572fap-4, 0x1.6db6db4edcf85p-5, 0x1.f1c729a4655b7p-6, 0x1.6e89f728eafbfp-6, 0x1.1c720c30e4c7dp-6, 0x1.c5932ee369509p-7, 0x1.a4d3eaa277c07p-7, -0x1.1037d7466e07ap-12, 0x1.11c0bafefd00bp-4, -0x1.011750033bc9p-2, 0x1.bf822845f8db1p-1, -0x1.18e7dcb1953dcp+1, 0x1.0a0cb40321171p+2, -0x1.6a2d2f209a338p+2, 0x1.5360a18a8579dp+2, -0x1.87726b7b1a151p+1, 0x1.ae2de36f762c5p-1}},
+    {20, 0x1.4d96b905c8336p-57, 0x1.9f0dba0f2ee3fp-29, {0x1p+0, 0x1.555555555557fp-3, 0x1.333333332bf6cp-4, 0x1.6db6db7488bc4p-5, 0x1.f1c71938686e4p-6, 0x1.6e8c16df07ecap-6, 0x1.1c441c7f55a55p-6, 0x1.caf624d3c8626p-7, 0x1.6a6b9e7841549p-7, 0x1.cda184a88b4bap-7, -0x1.4f15f1906b7e7p-6, 0x1.3cb21d07e7284p-3, -0x1.256665ad6aa78p-1, 0x1.c2604e2e8e107p+0, -0x1.02dd7ba114548p+2, 0x1.c190c78ff2f5cp+2, -0x1.1b5a59642516fp+3, 0x1.edc476fcb7a75p+2, -0x1.0a3cd76b1593p+2, 0x1.1153229dc6cdep+0}},
+};
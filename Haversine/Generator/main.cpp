@@ -1,5 +1,12 @@
 #include <haversine_calculation.hpp>
-
+#include <haversine_parallel.hpp>
+
+#include <random.hpp>
+#include <format.hpp>
+#include <files.hpp>
+#include <buffer.hpp>
+#include <os.hpp>
+#include <defer.hpp>
 #include <defs.hpp>
 #include <logging.hpp>
 
@@ -11,13 +18,26 @@ static char const *argpref(char const *arg, char const (&val)[t_n])
     return arg + (t_n - 1);
 }
 
-static f64 randflt(f64 min, f64 max)
-{
-    return clamp((f64(rand()) / RAND_MAX) * (max - min) + min, min, max);
-}
-
-static FILE *g_outf = stdout;
-#define OUTPUT(fmt_, ...) fprintf(g_outf, fmt_, ##__VA_ARGS__)
+// Pairs are generated and formatted in blocks, each with its own rng
+// stream: block i uses the seeded state long-jumped i + 1 times (the
+// unjumped one is for the clusters), split into 4 lanes for the vector
+// generator. So the output only depends on the seed, and blocks can be
+// generated in any order by any number of threads, with or without avx2.
+//
+// Blocks are done in waves of one per thread. Text lengths vary, so the file
+// offset of a block is only known once all blocks before it are formatted:
+// after a wave the main thread assigns offsets and accumulates the sum in
+// pair order, and the blocks get pwritten during the next wave while the
+// threads format the one after.
+
+static constexpr u64 c_block_pairs = 1 << 14;
+// Pairs are generated in chunks of SoA coords, formatted right after
+static constexpr u64 c_chunk_pairs = 256;
+// Pair line + dist comment, the widest coords are -1xx.<18 digits>
+static constexpr u64 c_max_pair_text = 256;
+// Same with padding, extra fields and exponents
+static constexpr u64 c_max_adversarial_pair_text = 1024;
+static constexpr u32 c_coord_prec = 18;
 
 enum random_technique_t {
     e_rt_uniform,
@@ -32,61 +52,509 @@ struct cluster_t {
 static constexpr uint c_max_clusters = 1024;
 
 static random_technique_t g_rand_technique = e_rt_clusters;
+static isa_level_t g_isa = e_isa_scalar;
 
 static uint g_cluster_count = 6;
 static cluster_t clusters[c_max_clusters] = {};
 
-static void init_random(uint seed)
+static rng_state_t init_random(u64 seed)
 {
-    srand(seed);
+    rng_state_t rng = make_rng_state(seed);
 
     if (g_rand_technique == e_rt_clusters) {
         for (uint i = 0; i < g_cluster_count; ++i) {
             clusters[i] = cluster_t{
-                randflt(-180.0, 180.0), randflt(-90.0, 90.0), // center
-                randflt(5.0, 10.0)                            // max coord delta from center
+                rng_next_f64(rng, -180.0, 180.0), rng_next_f64(rng, -90.0, 90.0), // center
+                rng_next_f64(rng, 5.0, 10.0) // max coord delta from center
             };
         }
     }
+
+    return rng;
+}
+
+struct point_chunk_t {
+    alignas(32) f64 x0[c_chunk_pairs];
+    alignas(32) f64 y0[c_chunk_pairs];
+    alignas(32) f64 x1[c_chunk_pairs];
+    alignas(32) f64 y1[c_chunk_pairs];
+    // Cluster choice draws
+    alignas(32) f64 c0[c_chunk_pairs];
+    alignas(32) f64 c1[c_chunk_pairs];
+};
+
+// Not "fair", but IDGAF. First cluster is chosen uniformly, the next one
+// uniformly from those remaining. Points are center + delta * [-1, 1] draws.
+FINLINE void pick_clusters(f64 c0, f64 c1, u32 &cid1, u32 &cid2)
+{
+    f64 const n = f64(g_cluster_count);
+    f64 const f1 = floor(c0);
+    f64 const id1 = f1 >= n ? f1 - n : f1;
+    f64 const f2 = id1 + floor(c1);
+    cid1 = u32(id1);
+    cid2 = u32(f2 >= n ? f2 - n : f2);
+}
+
+static void place_in_clusters(point_chunk_t &ch, u64 cnt)
+{
+    for (u64 i = 0; i < cnt; ++i) {
+        u32 cid1, cid2;
+        pick_clusters(ch.c0[i], ch.c1[i], cid1, cid2);
+        cluster_t const &cl1 = clusters[cid1];
+        cluster_t const &cl2 = clusters[cid2];
+        // Fused explicitly, as on the avx2 path
+        ch.x0[i] = fma(cl1.max_delta, ch.x0[i], cl1.cx);
+        ch.y0[i] = fma(cl1.max_delta, ch.y0[i], cl1.cy);
+        ch.x1[i] = fma(cl2.max_delta, ch.x1[i], cl2.cx);
+        ch.y1[i] = fma(cl2.max_delta, ch.y1[i], cl2.cy);
+    }
 }
 
-static point_pair_t generate_random_point_pair()
+ISA_REGION_BEGIN_AVX2
+
+// Same math as pick_clusters, with the cluster fields gathered
+static void place_in_clusters_avx2(point_chunk_t &ch, u64 cnt)
 {
+    f64 const *const cl = &clusters[0].cx;
+    __m256d const n = _mm256_set1_pd(f64(g_cluster_count));
+    __m128i const stride = _mm_set1_epi32(sizeof(cluster_t) / sizeof(f64));
+
+    auto wrap = [n](__m256d f) {
+        return _mm256_blendv_pd(
+            f, _mm256_sub_pd(f, n), _mm256_cmp_pd(f, n, _CMP_GE_OQ));
+    };
+
+    for (u64 i = 0; i < cnt; i += 4) {
+        __m256d const id1 = wrap(_mm256_floor_pd(_mm256_load_pd(ch.c0 + i)));
+        __m256d const id2 = wrap(
+            _mm256_add_pd(id1, _mm256_floor_pd(_mm256_load_pd(ch.c1 + i))));
+        __m128i const i1 = _mm_mullo_epi32(_mm256_cvttpd_epi32(id1), stride);
+        __m128i const i2 = _mm_mullo_epi32(_mm256_cvttpd_epi32(id2), stride);
+
+        __m256d const cx1 = _mm256_i32gather_pd(cl, i1, 8);
+        __m256d const cy1 = _mm256_i32gather_pd(cl + 1, i1, 8);
+        __m256d const d1 = _mm256_i32gather_pd(cl + 2, i1, 8);
+        __m256d const cx2 = _mm256_i32gather_pd(cl, i2, 8);
+        __m256d const cy2 = _mm256_i32gather_pd(cl + 1, i2, 8);
+        __m256d const d2 = _mm256_i32gather_pd(cl + 2, i2, 8);
+
+        _mm256_store_pd(ch.x0 + i,
+            _mm256_fmadd_pd(d1, _mm256_load_pd(ch.x0 + i), cx1));
+        _mm256_store_pd(ch.y0 + i,
+            _mm256_fmadd_pd(d1, _mm256_load_pd(ch.y0 + i), cy1));
+        _mm256_store_pd(ch.x1 + i,
+            _mm256_fmadd_pd(d2, _mm256_load_pd(ch.x1 + i), cx2));
+        _mm256_store_pd(ch.y1 + i,
+            _mm256_fmadd_pd(d2, _mm256_load_pd(ch.y1 + i), cy2));
+    }
+}
+
+ISA_REGION_END
+
+// cnt is rounded up to 4, the extra pairs are dropped by the caller
+static void generate_random_points(rng_state_4x_t &rng, point_chunk_t &ch, u64 cnt)
+{
+    cnt = round_up(cnt, u64(4));
+
     switch (g_rand_technique) {
     case e_rt_uniform:
-        return point_pair_t{
-            randflt(-180.0, 180.0), randflt(-90.0, 90.0),
-            randflt(-180.0, 180.0), randflt(-90.0, 90.0)
-        };
+        rng_fill_f64_4x(rng, ch.x0, cnt, -180.0, 180.0, g_isa);
+        rng_fill_f64_4x(rng, ch.y0, cnt, -90.0, 90.0, g_isa);
+        rng_fill_f64_4x(rng, ch.x1, cnt, -180.0, 180.0, g_isa);
+        rng_fill_f64_4x(rng, ch.y1, cnt, -90.0, 90.0, g_isa);
+        break;
+
+    case e_rt_clusters:
+        rng_fill_f64_4x(rng, ch.c0, cnt, 0.0, g_cluster_count + 0.999, g_isa);
+        rng_fill_f64_4x(rng, ch.c1, cnt, 0.0, g_cluster_count - 0.001, g_isa);
+        rng_fill_f64_4x(rng, ch.x0, cnt, -1.0, 1.0, g_isa);
+        rng_fill_f64_4x(rng, ch.y0, cnt, -1.0, 1.0, g_isa);
+        rng_fill_f64_4x(rng, ch.x1, cnt, -1.0, 1.0, g_isa);
+        rng_fill_f64_4x(rng, ch.y1, cnt, -1.0, 1.0, g_isa);
+        if (g_isa >= e_isa_avx2)
+            place_in_clusters_avx2(ch, cnt);
+        else
+            place_in_clusters(ch, cnt);
+        break;
+    }
+}
 
-    case e_rt_clusters: {
-        // Not "fair", but IDGAF
-        // Choose first uniformly
-        int cid1 = int(floor(randflt(0.0, g_cluster_count + 0.999))) % g_cluster_count;
-        // Choose next uniformly from those remaining
-        int cid2 = (cid1 + int(floor(randflt(0.0, g_cluster_count - 0.001)))) % g_cluster_count;
+struct output_block_t {
+    rng_state_t rng;
+    u64 first_pair;
+    u64 pair_cnt;
+    char *text;
+    f64 *dists;
+    u64 text_len;
+    u64 text_off; // In the output, assigned after formatting
+    bool ok;
+};
 
-        cluster_t const &cl1 = clusters[cid1];
-        cluster_t const &cl2 = clusters[cid2];
+// All formats take the same draws, so a seed gives the same pairs and
+// checksum file in each
+enum output_format_t {
+    e_of_json,   // { "points": [ pairs ] }
+    e_of_ndjson, // A pair object per line
+    e_of_bin     // haversine_bin_header_t + point_pair_t array
+};
 
-        return point_pair_t{
-            cl1.cx + randflt(-cl1.max_delta, cl1.max_delta),
-            cl1.cy + randflt(-cl1.max_delta, cl1.max_delta),
-            cl2.cx + randflt(-cl2.max_delta, cl2.max_delta),
-            cl2.cy + randflt(-cl2.max_delta, cl2.max_delta),
-        };
-    } break;
+struct output_t {
+    os_file_t data;     // Invalid for stdout
+    os_file_t checksum; // Invalid for stdout
+    output_format_t format;
+    u64 total_pairs;
+};
+
+static bool write_output(output_t const &out, char const *text, u64 len, u64 off)
+{
+    if (is_valid(out.data))
+        return os_file_write_at(out.data, text, len, off);
+    return fwrite(text, 1, len, stdout) == len;
+}
+
+static char *format_point_pair(char *p, point_pair_t const &pair)
+{
+    p = format_str(p, "{\"x0\": ");
+    p = format_f64_fixed(p, pair.x0, c_coord_prec);
+    p = format_str(p, ", \"y0\": ");
+    p = format_f64_fixed(p, pair.y0, c_coord_prec);
+    p = format_str(p, ", \"x1\": ");
+    p = format_f64_fixed(p, pair.x1, c_coord_prec);
+    p = format_str(p, ", \"y1\": ");
+    p = format_f64_fixed(p, pair.y1, c_coord_prec);
+    return format_str(p, "}");
+}
+
+static char *emit_pair(
+    char *p, point_pair_t const &pair, output_format_t format, bool last)
+{
+    switch (format) {
+    case e_of_json:
+        p = format_str(p, "    ");
+        p = format_point_pair(p, pair);
+        p = last ? format_str(p, "\n") : format_str(p, ",\n");
+        break;
+    case e_of_ndjson:
+        p = format_point_pair(p, pair);
+        *p++ = '\n';
+        break;
+    case e_of_bin:
+        memcpy(p, &pair, sizeof(pair));
+        p += sizeof(pair);
+        break;
+    }
+    return p;
+}
+
+// Text layouts for parser stress corpora. The default is the pretty json
+// above, anything else goes through the writers below. Layout choices come
+// from their own stream (lane 4 of the block), so the coords are the same as
+// with the default layout, except where the number style changes the value
+// (fewer digits, -0): the dists are of the value the text spells.
+
+enum whitespace_style_t {
+    e_ws_pretty,
+    e_ws_minified,
+    e_ws_padded // Random runs between all tokens
+};
+
+enum number_style_t {
+    e_ns_fixed,    // 18 fractional digits
+    e_ns_varied,   // 0 to 18 fractional digits
+    e_ns_exponent, // d.ddde+xx with 0 to 16 digits, e or E
+    e_ns_mixed     // Any of the above per number
+};
+
+struct corpus_layout_t {
+    bool shuffle_keys;
+    whitespace_style_t whitespace;
+    number_style_t numbers;
+    bool extra_fields; // 0-2 per pair, escaped strings and nested values
+    u32 nesting;       // Depth of a "meta" root field before "points"
+    bool tail_field;   // A root field after "points", no appending then
+};
+
+static constexpr u32 c_max_nesting = 1024;
+static constexpr u32 c_max_ws_run = 8;
+// Out of 256, non-fixed number styles only
+static constexpr u32 c_neg_zero_chance = 4;
+
+static corpus_layout_t g_layout = {};
+
+static bool is_default_layout()
+{
+    return
+        !g_layout.shuffle_keys && g_layout.whitespace == e_ws_pretty &&
+        g_layout.numbers == e_ns_fixed && !g_layout.extra_fields &&
+        g_layout.nesting == 0 && !g_layout.tail_field;
+}
+
+enum ws_slot_t {
+    e_wss_tight,       // Nothing when pretty
+    e_wss_after_colon, // One space when pretty
+    e_wss_after_comma  // One space when pretty
+};
+
+// ndjson records must stay on one line
+static char *emit_ws(char *p, rng_state_t &rng, ws_slot_t slot, bool newlines)
+{
+    switch (g_layout.whitespace) {
+    case e_ws_pretty:
+        return slot == e_wss_tight ? p : format_str(p, " ");
+    case e_ws_minified:
+        return p;
+    case e_ws_padded: {
+        static constexpr char c_ws[] = " \t\n\r";
+        u64 r = rng_next(rng);
+        u32 const cnt = u32(r % (c_max_ws_run + 1));
+        r >>= 8;
+        for (u32 i = 0; i < cnt; ++i, r >>= 2)
+            *p++ = c_ws[newlines ? (r & 3) : (r & 1)];
+        return p;
+    }
+    }
+    return p;
+}
+
+// Writes v in the number style, and sets it to the value the text spells
+static char *emit_number(char *p, f64 &v, rng_state_t &rng)
+{
+    number_style_t style = g_layout.numbers;
+    if (style == e_ns_fixed)
+        return format_f64_fixed(p, v, c_coord_prec);
+
+    u64 r = rng_next(rng);
+    if (style == e_ns_mixed) {
+        style = number_style_t(r % 3);
+        r >>= 2;
+    }
+
+    if ((r & 0xFF) < c_neg_zero_chance) {
+        static constexpr char const *c_neg_zeros[] = {
+            "-0", "-0.0", "-0e0", "-0.000E+00"};
+        v = -0.0;
+        char const *z = c_neg_zeros[(r >> 8) & 3];
+        return format_str(p, z, strlen(z));
+    }
+    r >>= 10;
+
+    char *const start = p;
+    switch (style) {
+    case e_ns_fixed:
+    case e_ns_mixed:
+        p = format_f64_fixed(p, v, c_coord_prec);
+        break;
+    case e_ns_varied:
+        p = format_f64_fixed(p, v, u32(r % (c_format_max_fixed_prec + 1)));
+        break;
+    case e_ns_exponent:
+        p += snprintf(p, c_format_max_f64_fixed_len,
+            (r & 0x100) ? "%.*E" : "%.*e", int(r % 17), v);
+        break;
+    }
+
+    // Correctly rounded, the buffer always has room for the terminator
+    *p = '\0';
+    v = strtod(start, nullptr);
+    return p;
+}
+
+static constexpr char const *c_extra_keys[] = {
+    "\"id\"", "\"tag\"", "\"x0_\"", "\"note\\u0021\"", "\"\""};
+
+static constexpr char const *c_extra_values[] = {
+    "\"plain\"",
+    "\"quote \\\" inside\"",
+    "\"back\\\\slash\\\\\"",
+    "\"tab\\tnew\\nline\\r\"",
+    "\"\\u00e9\\u4e2d\\ud83d\\ude00\"",
+    "\"solidus \\/ and {}[],: in a string\"",
+    "\"\"",
+    "true", "false", "null", "[]", "{}",
+    "[1, -0.5e-3, \"x\", {\"k\": [null]}]",
+    "{\"nested\": {\"deeper\": [true, {\"deepest\": \"\\\"\"}]}}"};
+
+static char *emit_key(char *p, char const *key, rng_state_t &rng, bool newlines)
+{
+    p = format_str(p, key, strlen(key));
+    p = emit_ws(p, rng, e_wss_tight, newlines);
+    *p++ = ':';
+    return emit_ws(p, rng, e_wss_after_colon, newlines);
+}
+
+static char *emit_pair_in_layout(
+    char *p, point_pair_t &pair, rng_state_t &rng, bool json, bool last)
+{
+    static constexpr char const *c_coord_keys[4] = {
+        "\"x0\"", "\"y0\"", "\"x1\"", "\"y1\""};
+    f64 *const coords = &pair.x0;
+
+    // 0-3 are coords, the rest extra fields
+    u32 fields[6] = {0, 1, 2, 3};
+    u32 field_cnt = 4;
+    if (g_layout.shuffle_keys) {
+        for (u32 i = 3; i > 0; --i) {
+            u32 const j = u32(rng_next(rng) % (i + 1));
+            u32 const tmp = fields[i];
+            fields[i] = fields[j];
+            fields[j] = tmp;
+        }
+    }
+    if (g_layout.extra_fields) {
+        u32 const extra_cnt = u32(rng_next(rng) % 3);
+        for (u32 e = 0; e < extra_cnt; ++e) {
+            u32 const at = u32(rng_next(rng) % (field_cnt + 1));
+            memmove(fields + at + 1, fields + at, (field_cnt - at) * sizeof(u32));
+            fields[at] = 4 + e;
+            ++field_cnt;
+        }
+    }
+
+    bool const pretty = g_layout.whitespace == e_ws_pretty;
+    if (json)
+        p = pretty ? format_str(p, "    ") : emit_ws(p, rng, e_wss_tight, json);
+
+    *p++ = '{';
+    p = emit_ws(p, rng, e_wss_tight, json);
+    for (u32 f = 0; f < field_cnt; ++f) {
+        if (f > 0) {
+            p = emit_ws(p, rng, e_wss_tight, json);
+            *p++ = ',';
+            p = emit_ws(p, rng, e_wss_after_comma, json);
+        }
+        if (fields[f] < 4) {
+            p = emit_key(p, c_coord_keys[fields[f]], rng, json);
+            p = emit_number(p, coords[fields[f]], rng);
+        } else {
+            u64 const r = rng_next(rng);
+            char const *const val = c_extra_values[(r >> 8) % ARR_CNT(c_extra_values)];
+            p = emit_key(p, c_extra_keys[r % ARR_CNT(c_extra_keys)], rng, json);
+            p = format_str(p, val, strlen(val));
+        }
+    }
+    p = emit_ws(p, rng, e_wss_tight, json);
+    *p++ = '}';
+
+    if (!json) {
+        *p++ = '\n';
+    } else {
+        if (!last) {
+            p = emit_ws(p, rng, e_wss_tight, json);
+            *p++ = ',';
+        }
+        p = pretty ? format_str(p, "\n") : emit_ws(p, rng, e_wss_tight, json);
     }
+    return p;
+}
 
-    return point_pair_t{};
+// { "meta": <nesting>, "points": [
+static char *emit_json_header(char *p, rng_state_t &rng)
+{
+    bool const pretty = g_layout.whitespace == e_ws_pretty;
+
+    *p++ = '{';
+    p = pretty ? format_str(p, "\n  ") : emit_ws(p, rng, e_wss_tight, true);
+    if (g_layout.nesting > 0) {
+        p = emit_key(p, "\"meta\"", rng, true);
+        for (u32 i = 0; i < g_layout.nesting; ++i) {
+            if (i % 2 == 0) {
+                *p++ = '{';
+                p = emit_ws(p, rng, e_wss_tight, true);
+                p = emit_key(p, "\"d\"", rng, true);
+            } else {
+                *p++ = '[';
+                p = emit_ws(p, rng, e_wss_tight, true);
+            }
+        }
+        p = format_str(p, "\"bottom \\\"of\\\" the well\"");
+        for (u32 i = g_layout.nesting; i-- > 0;) {
+            p = emit_ws(p, rng, e_wss_tight, true);
+            *p++ = i % 2 == 0 ? '}' : ']';
+        }
+        p = emit_ws(p, rng, e_wss_tight, true);
+        *p++ = ',';
+        p = pretty ? format_str(p, "\n  ") : emit_ws(p, rng, e_wss_after_comma, true);
+    }
+    p = emit_key(p, "\"points\"", rng, true);
+    *p++ = '[';
+    return pretty ? format_str(p, "\n") : emit_ws(p, rng, e_wss_tight, true);
 }
 
-static void output_point_pair(point_pair_t const &pair, bool last)
+// ], "tail": {...} }
+static char *emit_json_footer(char *p, rng_state_t &rng)
 {
-    OUTPUT(
-        "    "
-        "{\"x0\": %.18lf, \"y0\": %.18lf, \"x1\": %.18lf, \"y1\": %.18lf}%s\n",
-        pair.x0, pair.y0, pair.x1, pair.y1, last ? "" : ",");
+    bool const pretty = g_layout.whitespace == e_ws_pretty;
+
+    if (pretty) {
+        p = format_str(p, "  ]");
+    } else {
+        p = emit_ws(p, rng, e_wss_tight, true);
+        *p++ = ']';
+    }
+    if (g_layout.tail_field) {
+        if (!pretty)
+            p = emit_ws(p, rng, e_wss_tight, true);
+        *p++ = ',';
+        p = pretty ? format_str(p, "\n  ") : emit_ws(p, rng, e_wss_after_comma, true);
+        p = emit_key(p, "\"tail\"", rng, true);
+        p = format_str(p, "{\"points\": [], \"end\": \"}]\"}");
+    }
+    if (pretty)
+        return format_str(p, "\n}\n");
+    p = emit_ws(p, rng, e_wss_tight, true);
+    *p++ = '}';
+    return emit_ws(p, rng, e_wss_tight, true);
+}
+
+static void generate_block(output_t const &out, output_block_t &block)
+{
+    u64 const max_pair_text = is_default_layout() ?
+        c_max_pair_text : c_max_adversarial_pair_text;
+    char *p = block.text;
+    char *const end = block.text + block.pair_cnt * max_pair_text;
+
+    rng_state_4x_t rng = make_rng_state_4x(block.rng);
+    point_chunk_t chunk;
+
+    rng_state_t layout_rng = block.rng;
+    for (u32 l = 0; l < 4; ++l)
+        rng_jump(layout_rng);
+
+    for (u64 c = 0; c < block.pair_cnt; c += c_chunk_pairs) {
+        u64 const cnt = min(c_chunk_pairs, block.pair_cnt - c);
+        generate_random_points(rng, chunk, cnt);
+
+        for (u64 j = 0; j < cnt; ++j) {
+            point_pair_t pair{
+                chunk.x0[j], chunk.y0[j], chunk.x1[j], chunk.y1[j]};
+            u64 const i = c + j;
+            bool const last = block.first_pair + i == out.total_pairs - 1;
+
+            p = is_default_layout() ?
+                emit_pair(p, pair, out.format, last) :
+                emit_pair_in_layout(
+                    p, pair, layout_rng, out.format == e_of_json, last);
+
+            f64 const dist = haversine_dist_reference(pair);
+            block.dists[i] = dist;
+
+            // Text only, bin requires -o
+            if (!is_valid(out.checksum)) {
+                if (out.format == e_of_json)
+                    p = format_str(p, "    ");
+                p = format_str(p, "// dist=");
+                p = format_f64_fixed(p, dist, c_coord_prec);
+                *p++ = '\n';
+            }
+        }
+    }
+
+    assert(p < end);
+    block.text_len = u64(p - block.text);
+
+    block.ok = !is_valid(out.checksum) || os_file_write_at(
+        out.checksum, block.dists, block.pair_cnt * sizeof(f64),
+        block.first_pair * sizeof(f64));
 }
 
 int main(int argc, char **argv)
@@ -102,9 +570,20 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    uint rand_seed = time(nullptr);
+    u64 rand_seed = time(nullptr);
+    u32 thread_cnt = 1;
 
-    FILE *checksum_f = nullptr;
+    // Only picks the speed, the output is the same for every isa
+    cpu_features_t const cpu = detect_cpu_features();
+    isa_level_t const best_isa = best_isa_level(cpu);
+    g_isa = min(best_isa, e_isa_avx2);
+
+    output_t out = {};
+    out.total_pairs = u64(point_count);
+    DEFER([&] {
+        os_close_file(out.data);
+        os_close_file(out.checksum);
+    });
 
     bool specified_cluster_count = false;
     for (int i = 2; i < argc; ++i) {
@@ -115,9 +594,9 @@ int main(int argc, char **argv)
                 return 1;
             }
 
-            auto open_file_or_err = [](char const *fname, char const *mode) -> FILE * {
-                FILE *f = fopen(fname, mode);
-                if (!f) {
+            auto open_file_or_err = [](char const *fname) -> os_file_t {
+                os_file_t f = os_write_open_file(fname);
+                if (!is_valid(f)) {
                     LOGERR("Failed to open %s for write, error: %s",
                            fname, strerror(errno));
                     exit(1);
@@ -129,14 +608,49 @@ int main(int argc, char **argv)
             char checksum_fname[256];
             snprintf(checksum_fname, sizeof(checksum_fname), "%s.check.bin", argv[i]);
 
-            g_outf     = open_file_or_err(argv[i], "w+");
-            checksum_f = open_file_or_err(checksum_fname, "wb+");
+            os_close_file(out.data);
+            os_close_file(out.checksum);
+            out.data     = open_file_or_err(argv[i]);
+            out.checksum = open_file_or_err(checksum_fname);
         } else if (char const *p = argpref(argv[i], "-seed=")) {
-            rand_seed = atoi(p);
-            if (rand_seed <= 0) {
+            rand_seed = strtoull(p, nullptr, 10);
+            if (rand_seed == 0) {
                 LOGERR("Invalid arg, specify positive seed in -seed=[val]");
                 return 1;
             }
+        } else if (char const *p = argpref(argv[i], "-format=")) {
+            if (streq(p, "json"))
+                out.format = e_of_json;
+            else if (streq(p, "ndjson"))
+                out.format = e_of_ndjson;
+            else if (streq(p, "bin"))
+                out.format = e_of_bin;
+            else {
+                LOGERR("Invalid arg, specify one of [json|ndjson|bin] in -format=[val]");
+                return 1;
+            }
+        } else if (char const *p = argpref(argv[i], "-threads=")) {
+            int const val = atoi(p);
+            if (val <= 0 || u32(val) > c_haversine_max_threads) {
+                LOGERR("Invalid arg, -threads must be in [1, %u]",
+                       c_haversine_max_threads);
+                return 1;
+            }
+            thread_cnt = u32(val);
+        } else if (char const *p = argpref(argv[i], "-isa=")) {
+            u32 id = 0;
+            while (id < e_isa_count && !streq(p, c_isa_names[id]))
+                ++id;
+            if (id == e_isa_count) {
+                LOGERR("Invalid arg, specify -isa=scalar|avx2|avx512");
+                return 1;
+            }
+            if (id > best_isa) {
+                LOGERR("%s is not supported on this cpu (%s), best is %s",
+                    p, cpu.brand, c_isa_names[best_isa]);
+                return 1;
+            }
+            g_isa = min(isa_level_t(id), e_isa_avx2);
         } else if (char const *technique = argpref(argv[i], "-random-technique=")) {
             if (streq(technique, "uniform"))
                 g_rand_technique = e_rt_uniform;
@@ -157,6 +671,53 @@ int main(int argc, char **argv)
             }
 
             specified_cluster_count = true;
+        } else if (char const *p = argpref(argv[i], "-keys=")) {
+            if (streq(p, "fixed"))
+                g_layout.shuffle_keys = false;
+            else if (streq(p, "shuffled"))
+                g_layout.shuffle_keys = true;
+            else {
+                LOGERR("Invalid arg, specify one of [fixed|shuffled] in -keys=[val]");
+                return 1;
+            }
+        } else if (char const *p = argpref(argv[i], "-whitespace=")) {
+            if (streq(p, "pretty"))
+                g_layout.whitespace = e_ws_pretty;
+            else if (streq(p, "minified"))
+                g_layout.whitespace = e_ws_minified;
+            else if (streq(p, "padded"))
+                g_layout.whitespace = e_ws_padded;
+            else {
+                LOGERR("Invalid arg, specify one of [pretty|minified|padded] in -whitespace=[val]");
+                return 1;
+            }
+        } else if (char const *p = argpref(argv[i], "-numbers=")) {
+            if (streq(p, "fixed"))
+                g_layout.numbers = e_ns_fixed;
+            else if (streq(p, "varied"))
+                g_layout.numbers = e_ns_varied;
+            else if (streq(p, "exponent"))
+                g_layout.numbers = e_ns_exponent;
+            else if (streq(p, "mixed"))
+                g_layout.numbers = e_ns_mixed;
+            else {
+                LOGERR("Invalid arg, specify one of [fixed|varied|exponent|mixed] in -numbers=[val]");
+                return 1;
+            }
+        } else if (streq(argv[i], "-extra-fields")) {
+            g_layout.extra_fields = true;
+        } else if (char const *p = argpref(argv[i], "-nesting=")) {
+            int const val = atoi(p);
+            if (val < 0 || u32(val) > c_max_nesting) {
+                LOGERR("Invalid arg, -nesting must be in [0, %u]", c_max_nesting);
+                return 1;
+            }
+            g_layout.nesting = u32(val);
+        } else if (streq(argv[i], "-tail-field")) {
+            g_layout.tail_field = true;
+        } else if (streq(argv[i], "-adversarial")) {
+            g_layout = corpus_layout_t{
+                true, e_ws_padded, e_ns_mixed, true, 64, true};
         } else {
             LOGERR("Invalid arg: %s", argv[i]);
             return 1;
@@ -168,39 +729,151 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    init_random(rand_seed);
+    if (out.format == e_of_bin && !is_valid(out.data)) {
+        LOGERR("Invalid arg, -format=bin requires -o [file]");
+        return 1;
+    }
 
-    OUTPUT("{\n");
-    OUTPUT("  \"points\": [\n");
+    if (out.format == e_of_bin && !is_default_layout()) {
+        LOGERR("Invalid arg, layout options are for text formats");
+        return 1;
+    }
 
-    f64 sum = 0.0;
+    if (out.format == e_of_ndjson && g_layout.nesting > 0) {
+        LOGERR("Invalid arg, -nesting requires -format=json");
+        return 1;
+    }
 
-    for (i64 i = 0; i < point_count; ++i) {
-        point_pair_t pair = generate_random_point_pair();
-        output_point_pair(pair, i == point_count - 1);
+    if (out.format == e_of_ndjson && g_layout.tail_field) {
+        LOGERR("Invalid arg, -tail-field requires -format=json");
+        return 1;
+    }
 
-        f64 dist = haversine_dist_reference(pair);
-        sum += dist;
+    init_os_process_state(g_os_proc_state);
+
+    rng_state_t stream = init_random(rand_seed);
+    // Blocks are long jumps of stream, so this one is free
+    rng_state_t header_rng = stream;
+    rng_jump(header_rng);
+
+    // Two waves of blocks in flight, the one being formatted and the one
+    // being written
+    u64 const wave_blocks = thread_cnt;
+    u64 const slot_text_bytes = c_block_pairs *
+        (is_default_layout() ? c_max_pair_text : c_max_adversarial_pair_text);
+    u64 const slot_bytes = slot_text_bytes + c_block_pairs * sizeof(f64);
+    buffer_t slots_buf = allocate_best(2 * wave_blocks * slot_bytes);
+    DEFER([&] { deallocate(slots_buf); });
+    if (!is_valid(slots_buf)) {
+        LOGERR("Failed to allocate output blocks");
+        return 1;
+    }
 
-        if (checksum_f)
-            fwrite(&dist, sizeof(dist), 1, checksum_f);
-        else
-            OUTPUT("    // dist=%.18lf\n", dist);
+    output_block_t blocks[2 * c_haversine_max_threads] = {};
+    for (u64 i = 0; i < 2 * wave_blocks; ++i) {
+        blocks[i].text = (char *)slots_buf.data + i * slot_bytes;
+        blocks[i].dists = (f64 *)(blocks[i].text + slot_text_bytes);
     }
 
-    f64 avg = sum / point_count;
-    if (checksum_f)
-        fwrite(&sum, sizeof(sum), 1, checksum_f);
-    else
-        OUTPUT("  // avg=%.18lf\n", avg);
+    haversine_bin_header_t const bin_header =
+        make_haversine_bin_header(out.total_pairs);
+
+    u64 text_off = 0;
+    switch (out.format) {
+    case e_of_json: {
+        // Every nesting level is at most 4 tokens and whitespace runs
+        buffer_t header_buf = allocate(64 * (u64(g_layout.nesting) + 4));
+        DEFER([&] { deallocate(header_buf); });
+        if (!is_valid(header_buf)) {
+            LOGERR("Failed to allocate json header");
+            return 1;
+        }
+        char *const header = (char *)header_buf.data;
+        text_off = u64(emit_json_header(header, header_rng) - header);
+        if (!write_output(out, header, text_off, 0)) {
+            LOGERR("Failed to write output");
+            return 1;
+        }
+    } break;
+    case e_of_ndjson:
+        break;
+    case e_of_bin:
+        text_off = bin_header.pairs_offset;
+        if (!write_output(out, (char const *)&bin_header, sizeof(bin_header), 0)) {
+            LOGERR("Failed to write output");
+            return 1;
+        }
+        break;
+    }
 
-    OUTPUT("  ]\n");
-    OUTPUT("}\n");
+    u64 const block_cnt = (out.total_pairs + c_block_pairs - 1) / c_block_pairs;
+    f64 sum = 0.0;
+    bool ok = true;
+
+    output_block_t *cur = blocks, *prev = blocks + wave_blocks;
+    u64 prev_cnt = 0;
+    for (u64 first = 0; ok; first += wave_blocks) {
+        u64 const cnt = first < block_cnt ? min(wave_blocks, block_cnt - first) : 0;
+        for (u64 i = 0; i < cnt; ++i) {
+            rng_long_jump(stream);
+            cur[i].rng = stream;
+            cur[i].first_pair = (first + i) * c_block_pairs;
+            cur[i].pair_cnt =
+                min(c_block_pairs, out.total_pairs - cur[i].first_pair);
+        }
 
-    if (checksum_f)
-        fclose(checksum_f);
-    if (g_outf)
-        fclose(g_outf);
+        auto process_block = [&](u64 i) {
+            if (i < prev_cnt && is_valid(out.data)) {
+                prev[i].ok &= os_file_write_at(
+                    out.data, prev[i].text, prev[i].text_len, prev[i].text_off);
+            }
+            if (i < cnt)
+                generate_block(out, cur[i]);
+        };
+        ok &= run_haversine_parallel(max(cnt, prev_cnt), thread_cnt, process_block);
+
+        for (u64 i = 0; i < prev_cnt; ++i)
+            ok &= prev[i].ok;
+        if (cnt == 0)
+            break;
+
+        // In pair order, so the sum is the same for any thread count
+        for (u64 i = 0; i < cnt; ++i) {
+            cur[i].text_off = text_off;
+            text_off += cur[i].text_len;
+            for (u64 j = 0; j < cur[i].pair_cnt; ++j)
+                sum += cur[i].dists[j];
+            if (!is_valid(out.data))
+                ok &= write_output(out, cur[i].text, cur[i].text_len, 0);
+        }
+
+        prev_cnt = cnt;
+        output_block_t *const tmp = prev;
+        prev = cur;
+        cur = tmp;
+    }
+
+    // avg line, then up to 7 whitespace runs around the tail field
+    char footer[256];
+    char *footer_end = footer;
+    if (is_valid(out.checksum)) {
+        ok &= os_file_write_at(out.checksum, &sum, sizeof(sum),
+            out.total_pairs * sizeof(f64));
+    } else {
+        if (out.format == e_of_json)
+            footer_end = format_str(footer_end, "  ");
+        footer_end = format_str(footer_end, "// avg=");
+        footer_end = format_f64_fixed(footer_end, sum / f64(point_count), c_coord_prec);
+        *footer_end++ = '\n';
+    }
+    if (out.format == e_of_json)
+        footer_end = emit_json_footer(footer_end, header_rng);
+    ok &= write_output(out, footer, u64(footer_end - footer), text_off);
+
+    if (!ok) {
+        LOGERR("Failed to write output");
+        return 1;
+    }
 
     return 0;
 }
@@ -0,0 +1,186 @@
+#include <haversine_state.hpp>
+#include <haversine_calculation.hpp>
+#include <haversine_service.hpp>
+
+#include <buffer.hpp>
+#include <memory.hpp>
+#include <profiling.hpp>
+#include <logging.hpp>
+#include <defer.hpp>
+#include <os.hpp>
+#include <cpuid.hpp>
+#include <defs.hpp>
+
+#include <csignal>
+
+template <usize t_n>
+static char const *argpref(char const *arg, char const (&val)[t_n])
+{
+    if (strncmp(arg, val, t_n - 1) != 0)
+        return nullptr;
+    return arg + (t_n - 1);
+}
+
+static haversine_latency_tracker_t g_latencies = {};
+
+enum connection_result_t {
+    e_cr_closed,
+    e_cr_shutdown,
+    e_cr_error
+};
+
+// Serves requests until the peer disconnects or asks for shutdown
+static connection_result_t serve_connection(
+    int in_fd, int out_fd, haversine_state_t &s,
+    haversine_kernel_t const &kernel, u64 max_batch, u64 cpu_timer_freq)
+{
+    for (;;) {
+        haversine_service_header_t header;
+        if (!read_full(in_fd, &header, sizeof(header)))
+            return e_cr_closed;
+
+        haversine_service_reply_t reply = {};
+        reply.magic = c_haversine_service_magic;
+
+        if (header.magic != c_haversine_service_magic) {
+            LOGERR("Invalid request magic, dropping connection");
+            reply.status = e_hss_invalid_request;
+            write_full(out_fd, &reply, sizeof(reply));
+            return e_cr_error;
+        }
+
+        switch (header.type) {
+        case e_hsmt_batch: {
+            if (header.pair_cnt > max_batch) {
+                // Can't resync the stream after an unread payload
+                reply.status = e_hss_batch_too_large;
+                write_full(out_fd, &reply, sizeof(reply));
+                return e_cr_error;
+            }
+
+            if (!read_full(
+                    in_fd, s.pairs, header.pair_cnt * sizeof(point_pair_t)))
+            {
+                return e_cr_error;
+            }
+
+            u64 const start = READ_TIMER();
+            s.pair_cnt = header.pair_cnt;
+            kernel.calculate(s);
+            record_batch(g_latencies, READ_TIMER() - start, s.pair_cnt);
+
+            reply.status = e_hss_ok;
+            reply.pair_cnt = s.pair_cnt;
+            reply.sum = s.sum_answer;
+            if (!write_full(out_fd, &reply, sizeof(reply)) ||
+                !write_full(out_fd, s.answers, s.pair_cnt * sizeof(f64)))
+            {
+                return e_cr_error;
+            }
+        } break;
+
+        case e_hsmt_stats: {
+            haversine_service_stats_t const stats =
+                calculate_service_stats(g_latencies, cpu_timer_freq);
+            reply.status = e_hss_ok;
+            if (!write_full(out_fd, &reply, sizeof(reply)) ||
+                !write_full(out_fd, &stats, sizeof(stats)))
+            {
+                return e_cr_error;
+            }
+        } break;
+
+        case e_hsmt_shutdown:
+            reply.status = e_hss_ok;
+            write_full(out_fd, &reply, sizeof(reply));
+            return e_cr_shutdown;
+
+        default:
+            reply.status = e_hss_invalid_request;
+            write_full(out_fd, &reply, sizeof(reply));
+            return e_cr_error;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    init_os_process_state(g_os_proc_state);
+    try_enable_large_pages(g_os_proc_state);
+
+    char const *socket_path = c_haversine_service_default_socket;
+    bool use_stdio = false;
+    u64 max_batch = 1 << 20;
+
+    for (int i = 1; i < argc; ++i) {
+        if (char const *p = argpref(argv[i], "-socket=")) {
+            socket_path = p;
+        } else if (streq(argv[i], "-stdin")) {
+            use_stdio = true;
+        } else if (char const *p = argpref(argv[i], "-max-batch=")) {
+            i64 const val = atoll(p);
+            if (val <= 0) {
+                LOGERR("Invalid arg, specify positive pair count in -max-batch=[val]");
+                return 1;
+            }
+            max_batch = u64(val);
+        } else {
+            LOGERR("Invalid arg: %s", argv[i]);
+            return 1;
+        }
+    }
+
+    // One-time costs the per-request Solver pays on every run
+    u64 const cpu_timer_freq = measure_cpu_timer_freq(0.1l);
+    haversine_kernel_t const &kernel =
+        select_haversine_kernel(best_isa_level(detect_cpu_features()));
+
+    haversine_state_t s = {};
+    DEFER([&] { cleanup_haversine_state(s); });
+
+    s.parsed_pairs_buffer = allocate_best(max_batch * sizeof(point_pair_t));
+    s.answers_buffer = allocate_best(max_batch * sizeof(f64));
+    if (!is_valid(s.parsed_pairs_buffer) || !is_valid(s.answers_buffer)) {
+        LOGERR("Failed to allocate buffers for %llu pairs",
+            (unsigned long long)max_batch);
+        return 2;
+    }
+    page_memory_in(s.parsed_pairs_buffer.data, s.parsed_pairs_buffer.len);
+    page_memory_in(s.answers_buffer.data, s.answers_buffer.len);
+    s.pairs = (point_pair_t *)s.parsed_pairs_buffer.data;
+    s.answers = (f64 *)s.answers_buffer.data;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if (use_stdio) {
+        serve_connection(
+            STDIN_FILENO, STDOUT_FILENO, s, kernel, max_batch, cpu_timer_freq);
+    } else {
+        int listen_fd = open_service_listen_socket(socket_path);
+        if (listen_fd < 0)
+            return 2;
+        DEFER([&] { close(listen_fd); unlink(socket_path); });
+
+        LOGDBG("Listening on '%s', max batch %llu pairs, %s",
+            socket_path, (unsigned long long)max_batch, kernel.name);
+
+        for (;;) {
+            int conn_fd = accept(listen_fd, nullptr, nullptr);
+            if (conn_fd < 0) {
+                if (errno == EINTR)
+                    continue;
+                LOGERR("Accept failed, error: %s", strerror(errno));
+                break;
+            }
+
+            connection_result_t res = serve_connection(
+                conn_fd, conn_fd, s, kernel, max_batch, cpu_timer_freq);
+            close(conn_fd);
+            if (res == e_cr_shutdown)
+                break;
+        }
+    }
+
+    print_service_stats(calculate_service_stats(g_latencies, cpu_timer_freq));
+    return 0;
+}
@@ -3,6 +3,11 @@
 #include <haversine_json_parser.hpp>
 #include <haversine_file_io.hpp>
 #include <haversine_validation.hpp>
+#include <haversine_checkpoint.hpp>
+#include <haversine_summation.hpp>
+#include <haversine_tuning.hpp>
+
+#include <cpuid.hpp>
 
 #include <string.hpp>
 #include <defer.hpp>
@@ -23,7 +28,20 @@ int main(int argc, char **argv)
 
     bool only_tokenize = false;
     bool only_reprint_json = false;
+    bool quantize = false;
+    bool use_f32 = false;
+    bool incremental = false;
+    haversine_sum_mode_t sum_mode = e_hsm_naive;
+    bool tune = true;
+    bool retune = false;
+    char const *tuning_cache_fn = nullptr; // Default in the user's cache dir
     char const *json_fname = nullptr;
+    u32 validation_thread_cnt = 1;
+    f64 validation_sample_rate = 0.0; // 0 for full validation
+
+    cpu_features_t const cpu = detect_cpu_features();
+    isa_level_t const best_isa = best_isa_level(cpu);
+    isa_level_t isa = best_isa;
 
     {
         PROFILED_BLOCK_PF("Argument parsing");
@@ -53,6 +71,67 @@ int main(int argc, char **argv)
                     return 1;
                 }
                 only_reprint_json = true;
+            } else if (streq(argv[i], "-quantize")) {
+                quantize = true;
+            } else if (streq(argv[i], "-f32")) {
+                use_f32 = true;
+            } else if (streq(argv[i], "-incremental")) {
+                incremental = true;
+            } else if (strncmp(argv[i], "-isa=", 5) == 0) {
+                u32 id = 0;
+                while (id < e_isa_count && !streq(argv[i] + 5, c_isa_names[id]))
+                    ++id;
+                if (id == e_isa_count) {
+                    LOGERR(
+                        "Invalid arg, specify -isa=scalar|avx2|avx512");
+                    return 1;
+                }
+                if (id > best_isa) {
+                    LOGERR("%s is not supported on this cpu (%s), best is %s",
+                        argv[i] + 5, cpu.brand, c_isa_names[best_isa]);
+                    return 1;
+                }
+                isa = isa_level_t(id);
+            } else if (streq(argv[i], "-no-tune")) {
+                tune = false;
+            } else if (streq(argv[i], "-retune")) {
+                retune = true;
+            } else if (strncmp(argv[i], "-tune-cache=", 12) == 0) {
+                tuning_cache_fn = argv[i] + 12;
+            } else if (strncmp(argv[i], "-validation-threads=", 20) == 0) {
+                validation_thread_cnt = u32(atoi(argv[i] + 20));
+            } else if (strncmp(argv[i], "-validate-sample=", 17) == 0) {
+                validation_sample_rate = atof(argv[i] + 17);
+                if (!(validation_sample_rate > 0.0 &&
+                      validation_sample_rate <= 1.0))
+                {
+                    LOGERR(
+                        "Invalid arg, specify -validate-sample=<rate> "
+                        "with 0 < rate <= 1");
+                    return 1;
+                }
+            } else if (strncmp(argv[i], "-trace=", 7) == 0) {
+                if (!enable_profiler_trace(argv[i] + 7)) {
+                    LOGERR(
+                        "Invalid arg, -trace requires a build with "
+                        "PROFILER and PROFILER_TRACE");
+                    return 1;
+                }
+            } else if (strncmp(argv[i], "-sum=", 5) == 0) {
+                u32 id = 0;
+                while (
+                    id < e_hsm_count &&
+                    !streq(argv[i] + 5, c_haversine_sum_mode_names[id]))
+                {
+                    ++id;
+                }
+                if (id == e_hsm_count) {
+                    LOGERR(
+                        "Invalid arg, specify "
+                        "-sum=naive|kahan|neumaier|pairwise|reproducible");
+                    return 1;
+                }
+                sum_mode = haversine_sum_mode_t(id);
             } else {
                 LOGERR("Invalid arg: %s", argv[i]);
                 return 1;
@@ -65,10 +144,55 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    haversine_state_t state = {};
+    if (incremental && (only_tokenize || only_reprint_json)) {
+        LOGERR(
+            "Invalid usage: "
+            "-incremental is incompatible with -tokenize and -reprint");
+        return 1;
+    }
+
+    if (quantize && use_f32) {
+        LOGERR("Invalid usage: -quantize and -f32 are incompatible");
+        return 1;
+    }
+
+    if ((quantize || use_f32) && isa < e_isa_avx2) {
+        LOGERR("Invalid usage: -quantize and -f32 require avx2");
+        return 1;
+    }
 
-    if (!setup_haversine_state(state, json_fname, only_tokenize))
+    // Generator -format=bin output, mapped instead of parsed
+    bool const bin_input = is_haversine_bin_file(json_fname);
+    if (bin_input && (incremental || only_tokenize || only_reprint_json)) {
+        LOGERR(
+            "Invalid usage: "
+            "-incremental, -tokenize and -reprint need json input");
+        return 1;
+    }
+
+    LOGDBG("Cpu: %s, using %s kernels", cpu.brand, c_isa_names[isa]);
+
+    haversine_state_t state = {};
+    // Sampling reads a few pages of the checksum, don't load all of it
+    bool const map_checksum = validation_sample_rate > 0.0;
+
+    haversine_checkpoint_t checkpoint;
+    bool const resumed =
+        incremental &&
+        load_haversine_checkpoint(json_fname, checkpoint) &&
+        setup_haversine_state_incremental(state, json_fname, checkpoint);
+
+    if (resumed) {
+        LOGDBG("Resumed from checkpoint: %llu old pairs, %llu new",
+            (unsigned long long)state.base_pair_cnt,
+            (unsigned long long)state.pair_cnt);
+    } else if (bin_input ?
+        !setup_haversine_state_bin(state, json_fname, map_checksum) :
+        !setup_haversine_state(
+            state, json_fname, only_tokenize, map_checksum))
+    {
         return 2;
+    }
 
     DEFER([&] { cleanup_haversine_state(state); });
 
@@ -77,12 +201,53 @@ int main(int argc, char **argv)
     if (only_reprint_json)
         return reprint_json(state.parsed_json_root);
 
-    calculate_haversine_distances_inline(state);
+    if (quantize) {
+        if (!quantize_haversine_pairs(state))
+            return 2;
+        calculate_haversine_distances_quantized(state);
+    } else if (use_f32) {
+        if (!narrow_haversine_pairs_f32(state))
+            return 2;
+        calculate_haversine_distances_f32(state);
+    } else {
+        char default_cache_fn[256];
+        if (tune && !tuning_cache_fn) {
+            if (get_haversine_tuning_default_fn(default_cache_fn))
+                tuning_cache_fn = default_cache_fn;
+            else
+                LOGDBG("No cache dir, the tuning will not be saved");
+        }
+        haversine_kernel_t const &kernel = tune ?
+            select_tuned_haversine_kernel(
+                state, cpu, isa, tuning_cache_fn, retune) :
+            select_haversine_kernel(isa);
+        PROFILED_BANDWIDTH_BLOCK_PF(
+            kernel.name, state.pair_cnt * sizeof(point_pair_t));
+        kernel.calculate(state);
+    }
+
+    // Kernels have summed naively in pair order, redo it if asked
+    if (sum_mode != e_hsm_naive) {
+        PROFILED_BANDWIDTH_BLOCK_PF(
+            "Summation", state.pair_cnt * sizeof(f64));
+        state.sum_answer = state.base_sum + sum_haversine_answers(
+            state.answers, state.pair_cnt, sum_mode, isa);
+    }
+
+    if (state.validation_answers) {
+        print_haversine_storage_info(state);
+        print_haversine_validation_results(
+            map_checksum ?
+                validate_haversine_distances_sampled(
+                    state, validation_sample_rate) :
+                validate_haversine_distances(
+                    state, isa, validation_thread_cnt));
+    }
 
-    if (!validate_haversine_distances(state, true))
+    haversine_checkpoint_t ckpt;
+    if (incremental && make_haversine_checkpoint(state, ckpt) &&
+        !save_haversine_checkpoint(json_fname, ckpt))
+    {
         return 1;
+    }
 }
-
-static_assert(
-    __COUNTER__ < c_profiler_slots_count,
-    "Too many profiler slots declared");
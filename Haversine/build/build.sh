@@ -1,6 +1,8 @@
 #!/bin/bash
 
 pushd build
-clang++ -g -std=c++20 -mfma -mavx2 -I ../../Common/ -I ../Components/ ../Generator/*.cpp $@ -o generate
-clang++ -g -std=c++20 -mfma -mavx2 -I ../../Common/ -I ../Components/ -Wno-return-local-addr ../Solver/*.cpp $@ -o solve
+clang++ -g -std=c++20 -I ../../Common/ -I ../Components/ ../Generator/*.cpp $@ -o generate
+clang++ -g -std=c++20 -I ../../Common/ -I ../Components/ -Wno-return-local-addr ../Solver/*.cpp $@ -o solve
+clang++ -g -std=c++20 -I ../../Common/ -I ../Components/ ../Server/*.cpp $@ -o serve
+clang++ -g -std=c++20 -I ../../Common/ -I ../Components/ ../Client/*.cpp $@ -o client
 popd
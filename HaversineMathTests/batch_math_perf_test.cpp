@@ -0,0 +1,111 @@
+#include <haversine_math.hpp>
+
+#include <os.hpp>
+#include <memory.hpp>
+#include <profiling.hpp>
+#include <logging.hpp>
+#include <defer.hpp>
+#include <repetition.hpp>
+
+#ifndef RT_STOP_TIME
+#define RT_STOP_TIME 10.0f
+#endif
+
+struct tested_batch_func_t {
+    void (*f)(f64 const *, f64 *, usize);
+    char const *name;
+    f64 range_min, range_max;
+    isa_level_t isa;
+};
+
+#define TEST_FUNC(f_, rmin_, rmax_, isa_) \
+    tested_batch_func_t{&f_, #f_, (rmin_), (rmax_), (isa_)}
+
+// What the batch versions replace
+#define LIBM_BATCH_FUNC(name_)                                         \
+    static void name_##_batch_libm(f64 const *in, f64 *out, usize cnt) \
+    {                                                                  \
+        for (usize i = 0; i < cnt; ++i)                                \
+            out[i] = name_(in[i]);                                     \
+    }
+
+LIBM_BATCH_FUNC(sin)
+LIBM_BATCH_FUNC(cos)
+LIBM_BATCH_FUNC(asin)
+LIBM_BATCH_FUNC(sqrt)
+
+#undef LIBM_BATCH_FUNC
+
+int main(int argc, char **argv)
+{
+    // Default fits in/out in L2, pass a larger count for the memory bound case
+    usize const cnt = argc > 1 ? usize(atoll(argv[1])) : usize(1) << 14;
+    if (cnt == 0) {
+        LOGERR("Usage: <program> [element count]");
+        return 1;
+    }
+
+    init_os_process_state(g_os_proc_state);
+    u64 cpu_timer_freq = measure_cpu_timer_freq(0.1l);
+    isa_level_t const best_isa = best_isa_level(detect_cpu_features());
+
+    buffer_t in_buf = allocate_best(cnt * sizeof(f64));
+    buffer_t out_buf = allocate_best(cnt * sizeof(f64));
+    DEFER([&] { deallocate(in_buf); deallocate(out_buf); });
+    if (!is_valid(in_buf) || !is_valid(out_buf))
+        return 2;
+    page_memory_in(out_buf.data, out_buf.len);
+
+    f64 *in = (f64 *)in_buf.data;
+    f64 *out = (f64 *)out_buf.data;
+
+    constexpr tested_batch_func_t c_test_funcs[] =
+    {
+        TEST_FUNC(sin_batch_libm, -c_pi64, c_pi64, e_isa_scalar),
+        TEST_FUNC(sin_batch_avx2, -c_pi64, c_pi64, e_isa_avx2),
+        TEST_FUNC(sin_batch_avx512, -c_pi64, c_pi64, e_isa_avx512),
+        TEST_FUNC(cos_batch_libm, -c_pi64, c_pi_half64, e_isa_scalar),
+        TEST_FUNC(cos_batch_avx2, -c_pi64, c_pi_half64, e_isa_avx2),
+        TEST_FUNC(cos_batch_avx512, -c_pi64, c_pi_half64, e_isa_avx512),
+        TEST_FUNC(asin_batch_libm, -1.0, 1.0, e_isa_scalar),
+        TEST_FUNC(asin_batch_avx2, -1.0, 1.0, e_isa_avx2),
+        TEST_FUNC(asin_batch_avx512, -1.0, 1.0, e_isa_avx512),
+        TEST_FUNC(sqrt_batch_libm, 0.0, 1.0, e_isa_scalar),
+        TEST_FUNC(sqrt_batch_avx2, 0.0, 1.0, e_isa_avx2),
+        TEST_FUNC(sqrt_batch_avx512, 0.0, 1.0, e_isa_avx512),
+    };
+
+    RepetitionTester rt{cpu_timer_freq, RT_STOP_TIME, true};
+
+    repetition_test_results_t results{};
+    set_rtr_target_ops(results, cnt);
+    // Read + write
+    u64 const byte_count = 2 * cnt * sizeof(f64);
+    set_rtr_target_bytes(results, byte_count);
+
+    for (auto [f, name, rmin, rmax, isa] : c_test_funcs) {
+        if (isa > best_isa)
+            continue;
+
+        srand(1);
+        for (usize i = 0; i < cnt; ++i)
+            in[i] = rmin + (rmax - rmin) * (f64(rand()) / RAND_MAX);
+
+        rt.ReStart(results);
+        do {
+            rt.BeginTimeBlock();
+            (*f)(in, out, cnt);
+            rt.EndTimeBlock();
+
+            rt.ReportProcessedOps(cnt);
+            rt.ReportProcessedBytes(byte_count);
+        } while (rt.Tick());
+
+        char namebuf[256];
+        snprintf(
+            namebuf, sizeof(namebuf), "%s (%llu elements)",
+            name, (unsigned long long)cnt);
+        print_reptest_results(results, cpu_timer_freq, namebuf, true);
+        fprintf(stderr, "\n");
+    }
+}
@@ -6,6 +6,11 @@ mv ../dependency_chains_funcs.o ./
 clang++-21 $@ -g -std=c++20 -mfma -mavx2 -masm=intel -Wno-format -I ../../Common/ -I ../../Haversine/Components/ ../haversine_perf_test.cpp -o haversine_perf_test
 clang++-21 $@ -g -std=c++20 -mfma -mavx2 -masm=intel -Wno-format -I ../../Common/ -I ../../Haversine/Components/ ../haversine_input_ranges.cpp -o haversine_input_ranges
 clang++-21 $@ -g -std=c++20 -mfma -mavx2 -masm=intel -Wno-format -I ../../Common/ -I ../../Haversine/Components/ ../haversine_func_precision_test.cpp -o haversine_func_precision_test
+clang++-21 $@ -g -std=c++20 -mfma -mavx2 -masm=intel -Wno-format -I ../../Common/ -I ../../Haversine/Components/ ../batch_math_perf_test.cpp -o batch_math_perf_test
+clang++-21 $@ -g -std=c++20 -mfma -mavx2 -masm=intel -Wno-format -I ../../Common/ -I ../../Haversine/Components/ ../summation_perf_test.cpp -o summation_perf_test
+clang++-21 $@ -g -std=c++20 -mfma -mavx2 -masm=intel -Wno-format -I ../../Common/ -I ../../Haversine/Components/ ../haversine_matrix_test.cpp -o haversine_matrix_test
+clang++-21 $@ -g -std=c++20 -mfma -mavx2 -masm=intel -Wno-format -I ../../Common/ -I ../../Haversine/Components/ ../haversine_spatial_index_test.cpp -o haversine_spatial_index_test
+clang++-21 $@ -g -std=c++20 -mfma -mavx2 -masm=intel -Wno-format -I ../../Common/ -I ../../Haversine/Components/ ../minimax_remez.cpp -o minimax_remez
 clang++-21 $@ -g -std=c++20 -mfma -mavx2 -masm=intel -Wno-format -I ../../Common/ -I ../../Haversine/Components/ ../benchmark_method_eval.cpp -o benchmark_method_eval
 clang++-21 $@ -g -std=c++20 -mfma -mavx2 -masm=intel -Wno-format -I ../../Common/ -I ../../Haversine/Components/ ../dependency_chains.cpp dependency_chains_funcs.o -o dependency_chains
 popd
@@ -16,6 +16,17 @@ FINLINE f64 sqrt_dc(f64 in)
     return f64(_mm_cvtss_f32(sqrt_xmm));
 }
 
+FINLINE f64 sin_poly_f32(f64 in)
+{
+    return f64(_mm256_cvtss_f32(sin_poly_ps(_mm256_set1_ps(f32(in)))));
+}
+
+FINLINE f64 asin_poly_f32(f64 in)
+{
+    __m256 x = _mm256_set1_ps(f32(in));
+    return f64(_mm256_cvtss_f32(asin_poly_ps(_mm256_mul_ps(x, x), x)));
+}
+
 FINLINE f64 sqrt_approx(f64 in)
 {
     __m128 xmm = _mm_set_ss(f32(in));
@@ -1,8 +1,11 @@
 #include "common_tested_funcs.hpp"
 #include <haversine_math.hpp>
+#include <haversine_state.hpp>
+#include <haversine_calculation.hpp>
 
 #include <os.hpp>
 #include <logging.hpp>
+#include <defer.hpp>
 
 struct func_test_t {
     f64 in;
@@ -67,9 +70,20 @@ struct reference_test_t {
     f64 allowed_error;
 };
 
+struct batch_test_t {
+    void (*f)(f64 const *, f64 *, usize);
+    f64 (*reference)(f64);
+    f64 test_range_min, test_range_max;
+    isa_level_t isa;
+    char const *name, *rname;
+    f64 allowed_error;
+};
+
 #define GTEST(f_, ts_, aerr_) golden_test_t{&f_, ts_, ARR_CNT(ts_), #f_, aerr_}  
 #define RTEST(f_, rf_, trmin_, trmax_, tcnt_, aerr_) \
     reference_test_t{&f_, &rf_, (trmin_), (trmax_), (tcnt_), #f_, #rf_, aerr_}  
+#define BTEST(f_, rf_, trmin_, trmax_, isa_, aerr_) \
+    batch_test_t{&f_, &rf_, (trmin_), (trmax_), (isa_), #f_, #rf_, aerr_}
 
 #if VERBOSE
 #define LOGVERBOSE(...) LOGNORMAL(__VA_ARGS__)
@@ -216,6 +230,8 @@ int main(int argc, char **argv)
             RTEST(sin_a, sin, -c_pi64, c_pi64, 1024, f64(FLT_EPSILON)),
             RTEST(cos_a, cos, -c_pi64, c_pi64, 1024, f64(FLT_EPSILON)),
             RTEST(asin_a, asin, 0.0, 1.0, 1024, f64(FLT_EPSILON)),
+            RTEST(sin_poly_f32, sin, -c_pi_half64, c_pi_half64, 1024, 2.0 * f64(FLT_EPSILON)),
+            RTEST(asin_poly_f32, asin, 0.0, c_1oversqrt2_64, 1024, 2.0 * f64(FLT_EPSILON)),
         })
     {
         LOGVERBOSE(
@@ -248,5 +264,190 @@ int main(int argc, char **argv)
         LOGNORMAL("    max error %.18lf (at %.18lf)", max_error, max_error_arg);
         LOGNORMAL("    %d/%d under allowed error level of %.18lf", tcnt - errcnt, tcnt, allowed_err);
     }
+
+    // Batch versions, odd counts and misaligned in/out to hit the masked
+    // heads and tails
+    isa_level_t const best_isa = best_isa_level(detect_cpu_features());
+    for (auto [f, rf, tr_min, tr_max, isa, nm, rnm, allowed_err] :
+        {
+            BTEST(sin_batch_avx2, sin, -c_pi64, c_pi64, e_isa_avx2, f64(FLT_EPSILON)),
+            BTEST(cos_batch_avx2, cos, -c_pi64, c_pi_half64, e_isa_avx2, f64(FLT_EPSILON)),
+            BTEST(sin_batch_avx2, sin, -1e6, 1e6, e_isa_avx2, f64(FLT_EPSILON)),
+            BTEST(cos_batch_avx2, cos, -1e6, 1e6, e_isa_avx2, f64(FLT_EPSILON)),
+            BTEST(sin_batch_avx2, sin, -1e12, 1e12, e_isa_avx2, f64(FLT_EPSILON)),
+            BTEST(asin_batch_avx2, asin, -1.0, 1.0, e_isa_avx2, f64(FLT_EPSILON)),
+            BTEST(sqrt_batch_avx2, sqrt, 0.0, 1.0, e_isa_avx2, f64(FLT_EPSILON)),
+            BTEST(sin_batch_avx512, sin, -c_pi64, c_pi64, e_isa_avx512, f64(FLT_EPSILON)),
+            BTEST(cos_batch_avx512, cos, -c_pi64, c_pi_half64, e_isa_avx512, f64(FLT_EPSILON)),
+            BTEST(sin_batch_avx512, sin, -1e6, 1e6, e_isa_avx512, f64(FLT_EPSILON)),
+            BTEST(cos_batch_avx512, cos, -1e6, 1e6, e_isa_avx512, f64(FLT_EPSILON)),
+            BTEST(sin_batch_avx512, sin, -1e12, 1e12, e_isa_avx512, f64(FLT_EPSILON)),
+            BTEST(asin_batch_avx512, asin, -1.0, 1.0, e_isa_avx512, f64(FLT_EPSILON)),
+            BTEST(sqrt_batch_avx512, sqrt, 0.0, 1.0, e_isa_avx512, f64(FLT_EPSILON)),
+        })
+    {
+        if (isa > best_isa) {
+            LOGNORMAL("%s: skipped, no %s on this cpu", nm, c_isa_names[isa]);
+            continue;
+        }
+
+        constexpr usize c_tcnt = 1027;
+        alignas(64) f64 in[c_tcnt + 8];
+        alignas(64) f64 out[c_tcnt + 8];
+
+        f64 max_error = 0.0;
+        f64 max_error_arg = 0.0;
+        int errcnt = 0;
+        int tcnt = 0;
+        for (usize in_off : {0, 1, 3}) {
+            for (usize out_off : {0, 2, 5}) {
+                usize const cnt = c_tcnt - in_off - out_off;
+                for (usize i = 0; i < cnt; ++i)
+                    in[in_off + i] = tr_min + (tr_max - tr_min) * f64(i) / (cnt - 1);
+                out[out_off + cnt] = -1.0; // Guard against tail overrun
+
+                (*f)(in + in_off, out + out_off, cnt);
+
+                if (out[out_off + cnt] != -1.0) {
+                    LOGNORMAL("[FAIL] %s wrote past the end of the output", nm);
+                    ++errcnt;
+                }
+                for (usize i = 0; i < cnt; ++i) {
+                    f64 const arg = in[in_off + i];
+                    f64 const err = abs(out[out_off + i] - (*rf)(arg));
+                    if (err > max_error) {
+                        max_error = err;
+                        max_error_arg = arg;
+                    }
+                    if (err > allowed_err)
+                        ++errcnt;
+                }
+                tcnt += int(cnt);
+            }
+        }
+        LOGNORMAL("%s (against %s) in [%.18lf, %.18lf]:", nm, rnm, tr_min, tr_max);
+        LOGNORMAL("    max error %.18lf (at %.18lf)", max_error, max_error_arg);
+        LOGNORMAL("    %d/%d under allowed error level of %.18lf", tcnt - errcnt, tcnt, allowed_err);
+    }
+
+    // Whole kernels against the reference, on uniform pairs plus short and
+    // near-antipodal ones, where precision is the weakest
+    bool kernels_ok = true;
+    {
+        constexpr u64 c_pair_cnt = 1 << 20;
+
+        haversine_state_t s = {};
+        DEFER([&] { cleanup_haversine_state(s); });
+
+        s.parsed_pairs_buffer = allocate_best(c_pair_cnt * sizeof(point_pair_t));
+        s.answers_buffer = allocate_best(c_pair_cnt * sizeof(f64));
+        if (!is_valid(s.parsed_pairs_buffer) || !is_valid(s.answers_buffer))
+            return 2;
+        s.pairs = (point_pair_t *)s.parsed_pairs_buffer.data;
+        s.answers = (f64 *)s.answers_buffer.data;
+        s.pair_cnt = c_pair_cnt;
+
+        auto randflt = [](f64 min, f64 max) {
+            return (f64(rand()) / RAND_MAX) * (max - min) + min;
+        };
+        auto wrap_x = [](f64 x) {
+            return x > 180.0 ? x - 360.0 : (x < -180.0 ? x + 360.0 : x);
+        };
+
+        srand(1);
+        for (u64 i = 0; i < c_pair_cnt; ++i) {
+            point_pair_t &p = s.pairs[i];
+            p.x0 = randflt(-180.0, 180.0);
+            p.y0 = randflt(-90.0, 90.0);
+            f64 const d = randflt(-1e-2, 1e-2);
+            switch (i % 3) {
+            case 0:
+                p.x1 = randflt(-180.0, 180.0);
+                p.y1 = randflt(-90.0, 90.0);
+                break;
+            case 1:
+                p.x1 = wrap_x(p.x0 + d);
+                p.y1 = clamp(p.y0 - d, -90.0, 90.0);
+                break;
+            case 2:
+                p.x1 = wrap_x(p.x0 + 180.0 + d);
+                p.y1 = clamp(p.y0 - d, -90.0, 90.0);
+                break;
+            }
+        }
+
+        // Per pair class: uniform, short, near-antipodal. What the f64
+        // kernels got with the hand-picked sin/asin polys they had before
+        // the Remez tables, max error goes up ~1.2-2x with one sin coeff less.
+        constexpr f64 c_f64_max_error_km[3] = {5e-10, 1.5e-4, 2e-4};
+        constexpr char const *c_pair_class_names[3] =
+            {"uniform", "short", "near-antipodal"};
+
+        struct f64_kernel_test_t {
+            void (*calculate)(haversine_state_t &);
+            isa_level_t isa;
+            char const *name;
+        };
+        for (auto [calculate, isa, nm] :
+            {
+                f64_kernel_test_t{&calculate_haversine_distances_inline, e_isa_avx2, "calculate_haversine_distances_inline"},
+                f64_kernel_test_t{&calculate_haversine_distances_4x, e_isa_avx2, "calculate_haversine_distances_4x"},
+                f64_kernel_test_t{&calculate_haversine_distances_8x, e_isa_avx512, "calculate_haversine_distances_8x"},
+            })
+        {
+            if (isa > best_isa) {
+                LOGNORMAL("%s: skipped, no %s on this cpu", nm, c_isa_names[isa]);
+                continue;
+            }
+
+            (*calculate)(s);
+
+            f64 max_error[3] = {};
+            for (u64 i = 0; i < c_pair_cnt; ++i) {
+                f64 const err = abs(s.answers[i] - haversine_dist_reference(s.pairs[i]));
+                max_error[i % 3] = max(max_error[i % 3], err);
+            }
+
+            LOGNORMAL(
+                "%s (against haversine_dist_reference) on %llu pairs:",
+                nm, (unsigned long long)c_pair_cnt);
+            for (u32 c = 0; c < 3; ++c) {
+                bool const ok = max_error[c] <= c_f64_max_error_km[c];
+                kernels_ok &= ok;
+                LOGNORMAL(
+                    "    %s %s: max error %.3ekm, bound %.3ekm",
+                    ok ? "[OK]  " : "[FAIL]", c_pair_class_names[c],
+                    max_error[c], c_f64_max_error_km[c]);
+            }
+        }
+
+        if (!narrow_haversine_pairs_f32(s))
+            return 2;
+        calculate_haversine_distances_f32(s);
+
+        f64 max_error = 0.0;
+        u64 max_error_id = 0;
+        for (u64 i = 0; i < c_pair_cnt; ++i) {
+            f64 const err = abs(s.answers[i] - haversine_dist_reference(s.pairs[i]));
+            if (err > max_error) {
+                max_error = err;
+                max_error_id = i;
+            }
+        }
+
+        point_pair_t const &worst = s.pairs[max_error_id];
+        kernels_ok &= max_error <= c_haversine_f32_max_error_km;
+        LOGNORMAL(
+            "%s [%s] (against haversine_dist_reference) on %llu pairs:",
+            max_error <= c_haversine_f32_max_error_km ? "[OK]  " : "[FAIL]",
+            "calculate_haversine_distances_f32",
+            (unsigned long long)c_pair_cnt);
+        LOGNORMAL(
+            "    max error %.6lfkm (at %.6lf %.6lf %.6lf %.6lf), bound %.3lfkm",
+            max_error, worst.x0, worst.y0, worst.x1, worst.y1,
+            c_haversine_f32_max_error_km);
+    }
+
+    return kernels_ok ? 0 : 1;
 }
 
@@ -0,0 +1,166 @@
+#include <haversine_matrix.hpp>
+#include <haversine_calculation.hpp>
+
+#include <os.hpp>
+#include <profiling.hpp>
+#include <logging.hpp>
+#include <defer.hpp>
+
+// Checks the tiled matrix engine against the reference formula and brute
+// force top-k, then times the streaming and top-k sinks per thread count
+
+static f64 randflt(f64 min, f64 max)
+{
+    return (f64(rand()) / RAND_MAX) * (max - min) + min;
+}
+
+struct random_points_t {
+    buffer_t buffer;
+    point_pair_t *pairs; // x0, y0 are the row point, x1, y1 the col point
+    u64 cnt;
+};
+
+static bool make_random_points(random_points_t &pts, u64 cnt)
+{
+    pts.buffer = allocate_best(cnt * sizeof(point_pair_t));
+    if (!is_valid(pts.buffer))
+        return false;
+    pts.pairs = (point_pair_t *)pts.buffer.data;
+    pts.cnt = cnt;
+    for (u64 i = 0; i < cnt; ++i) {
+        pts.pairs[i] = point_pair_t{
+            randflt(-180.0, 180.0), randflt(-90.0, 90.0),
+            randflt(-180.0, 180.0), randflt(-90.0, 90.0)};
+    }
+    return true;
+}
+
+static point_pair_t matrix_pair(random_points_t const &pts, u64 r, u64 c)
+{
+    return point_pair_t{
+        pts.pairs[r].x0, pts.pairs[r].y0, pts.pairs[c].x1, pts.pairs[c].y1};
+}
+
+int main(int argc, char **argv)
+{
+    u64 const row_cnt = argc > 1 ? u64(atoll(argv[1])) : 4096;
+    u64 const col_cnt = argc > 2 ? u64(atoll(argv[2])) : 65536;
+    u32 const max_threads = argc > 3 ? u32(atoi(argv[3])) : 4;
+    u32 const k = argc > 4 ? u32(atoi(argv[4])) : 8;
+    if (row_cnt == 0 || col_cnt == 0 || max_threads == 0 || k == 0) {
+        LOGERR("Usage: <program> [rows] [cols] [max threads] [k]");
+        return 1;
+    }
+
+    init_os_process_state(g_os_proc_state);
+    u64 const cpu_timer_freq = measure_cpu_timer_freq(0.1l);
+    isa_level_t const best_isa = best_isa_level(detect_cpu_features());
+
+    srand(1);
+    random_points_t pts = {};
+    haversine_point_set_t rows = {}, cols = {};
+    DEFER([&] {
+        deallocate(pts.buffer);
+        cleanup_haversine_point_set(rows);
+        cleanup_haversine_point_set(cols);
+    });
+    if (!make_random_points(pts, max(row_cnt, col_cnt)) ||
+        !make_haversine_point_set(
+            rows, &pts.pairs[0].x0, &pts.pairs[0].y0, row_cnt, 4) ||
+        !make_haversine_point_set(
+            cols, &pts.pairs[0].x1, &pts.pairs[0].y1, col_cnt, 4))
+    {
+        return 2;
+    }
+
+    int ret = 0;
+
+    for (u32 isa = 0; isa <= min(u32(best_isa), u32(e_isa_avx2)); ++isa) {
+        // Entries of a strided subset of rows against the reference
+        f64 max_error = 0.0;
+        auto check_sink = [&](u64 r, u64 c, f64 const *dists, u64 cnt) {
+            if (r % 61 != 0)
+                return;
+            for (u64 j = 0; j < cnt; ++j) {
+                f64 const ref =
+                    haversine_dist_reference(matrix_pair(pts, r, c + j));
+                max_error = max(max_error, abs(dists[j] - ref));
+            }
+        };
+        calculate_haversine_matrix(rows, cols, isa_level_t(isa), 1, check_sink);
+
+        // Top-k of a few rows against a brute force over the whole row
+        haversine_top_k_t tk = {};
+        if (!init_haversine_top_k(tk, row_cnt, k))
+            return 2;
+        DEFER([&] { cleanup_haversine_top_k(tk); });
+        haversine_top_k_sink_t tk_sink{&tk};
+        calculate_haversine_matrix(rows, cols, isa_level_t(isa), 2, tk_sink);
+
+        u64 top_k_mismatches = 0;
+        for (u64 r = 0; r < row_cnt; r += 127) {
+            haversine_neighbour_t best[256];
+            u32 const kk = min(k, u32(256));
+            for (u32 i = 0; i < kk; ++i)
+                best[i] = {DBL_MAX, ~u64(0)};
+            for (u64 c = 0; c < col_cnt; ++c) {
+                insert_haversine_neighbour(
+                    best, kk, haversine_dist_reference(matrix_pair(pts, r, c)), c);
+            }
+            for (u32 i = 0; i < kk; ++i) {
+                if (tk.neighbours[r * k + i].idx != best[i].idx)
+                    ++top_k_mismatches;
+            }
+        }
+
+        fprintf(stderr, "%s: MaxError=%.16g TopKMismatches=%llu\n",
+            c_isa_names[isa], max_error,
+            (unsigned long long)top_k_mismatches);
+        if (max_error > 1e-8 || top_k_mismatches > 0)
+            ret = 3;
+    }
+
+    // Per-row sums keep the streaming sink from being optimized out while
+    // staying thread-safe, a row only ever goes to one thread
+    buffer_t row_sums_buf = allocate_best(row_cnt * sizeof(f64));
+    DEFER([&] { deallocate(row_sums_buf); });
+    if (!is_valid(row_sums_buf))
+        return 2;
+    f64 *row_sums = (f64 *)row_sums_buf.data;
+
+    haversine_top_k_t tk = {};
+    if (!init_haversine_top_k(tk, row_cnt, k))
+        return 2;
+    DEFER([&] { cleanup_haversine_top_k(tk); });
+
+    f64 const entries = f64(row_cnt) * f64(col_cnt);
+    isa_level_t const isa = min(best_isa, e_isa_avx2);
+
+    for (u32 threads = 1; threads <= max_threads; threads *= 2) {
+        memset(row_sums, 0, row_cnt * sizeof(f64));
+        auto stream_sink = [&](u64 r, u64, f64 const *dists, u64 cnt) {
+            f64 s = 0.0;
+            for (u64 j = 0; j < cnt; ++j)
+                s += dists[j];
+            row_sums[r] += s;
+        };
+
+        u64 start = READ_TIMER();
+        calculate_haversine_matrix(rows, cols, isa, threads, stream_sink);
+        f64 const stream_sec = ticks_to_sec(READ_TIMER() - start, cpu_timer_freq);
+
+        // The previous run's rows would reject most candidates early
+        reset_haversine_top_k(tk);
+        haversine_top_k_sink_t tk_sink{&tk};
+        start = READ_TIMER();
+        calculate_haversine_matrix(rows, cols, isa, threads, tk_sink);
+        f64 const top_k_sec = ticks_to_sec(READ_TIMER() - start, cpu_timer_freq);
+
+        fprintf(stderr,
+            "%llux%llu, %u threads: stream %.3lfGdist/s, top-%u %.3lfGdist/s\n",
+            (unsigned long long)row_cnt, (unsigned long long)col_cnt, threads,
+            entries * 1e-9 / stream_sec, k, entries * 1e-9 / top_k_sec);
+    }
+
+    return ret;
+}
@@ -14,9 +14,12 @@
 struct tested_calc_func_t {
     void (*f)(haversine_state_t &);
     char const *name;
+    u64 bytes_per_pair;
+    isa_level_t isa;
 };
 
-#define TEST_FUNC(f_) tested_calc_func_t{&f_, #f_}
+#define TEST_FUNC(f_, pair_t_, isa_) \
+    tested_calc_func_t{&f_, #f_, sizeof(pair_t_), isa_}
 
 int main(int argc, char **argv)
 {
@@ -30,12 +33,17 @@ int main(int argc, char **argv)
 
     init_os_process_state(g_os_proc_state);
     u64 cpu_timer_freq = measure_cpu_timer_freq(0.1l);
+    isa_level_t const best_isa = best_isa_level(detect_cpu_features());
 
     constexpr tested_calc_func_t c_test_funcs[] =
     {
-        TEST_FUNC(calculate_haversine_distances_inline),
-        TEST_FUNC(calculate_haversine_distances_our_funcs),
-        TEST_FUNC(calculate_haversine_distances_naive),
+        TEST_FUNC(calculate_haversine_distances_quantized, quantized_point_pair_t, e_isa_avx2),
+        TEST_FUNC(calculate_haversine_distances_f32, point_pair_f32_t, e_isa_avx2),
+        TEST_FUNC(calculate_haversine_distances_8x, point_pair_t, e_isa_avx512),
+        TEST_FUNC(calculate_haversine_distances_4x, point_pair_t, e_isa_avx2),
+        TEST_FUNC(calculate_haversine_distances_inline, point_pair_t, e_isa_avx2),
+        TEST_FUNC(calculate_haversine_distances_our_funcs, point_pair_t, e_isa_avx2),
+        TEST_FUNC(calculate_haversine_distances_naive, point_pair_t, e_isa_scalar),
     };
 
     for (int json_id = 0; json_id < json_fn_cnt; ++json_id) {
@@ -46,17 +54,27 @@ int main(int argc, char **argv)
             return 2;
         DEFER([&] { cleanup_haversine_state(state); });
 
-        u64 const byte_count = state.pair_cnt * sizeof(point_pair_t);
+        if (best_isa >= e_isa_avx2 &&
+            (!quantize_haversine_pairs(state) ||
+             !narrow_haversine_pairs_f32(state)))
+        {
+            return 2;
+        }
 
         RepetitionTester rt{cpu_timer_freq, RT_STOP_TIME, true};
 
         repetition_test_results_t results{};
         set_rtr_target_ops(results, state.pair_cnt);
-        set_rtr_target_bytes(results, byte_count);
 
-        for (auto [f, name] : c_test_funcs) {
+        for (auto [f, name, bytes_per_pair, isa] : c_test_funcs) {
+            if (isa > best_isa)
+                continue;
+
             haversine_validation_result_t validation = {};
 
+            u64 const byte_count = state.pair_cnt * bytes_per_pair;
+            set_rtr_target_bytes(results, byte_count);
+
             rt.ReStart(results);
             do {
                 rt.BeginTimeBlock();
@@ -67,7 +85,7 @@ int main(int argc, char **argv)
                 rt.ReportProcessedBytes(byte_count);
 
                 merge_worst_haversine_validation_result(
-                    validation, validate_haversine_distances(state));
+                    validation, validate_haversine_distances(state, best_isa));
             } while (rt.Tick());
 
             char namebuf[256];
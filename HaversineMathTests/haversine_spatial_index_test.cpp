@@ -0,0 +1,177 @@
+#include <haversine_state.hpp>
+#include <haversine_spatial_index.hpp>
+
+#include <os.hpp>
+#include <profiling.hpp>
+#include <logging.hpp>
+#include <defer.hpp>
+
+// Spatial index against brute force over the tiled matrix, on Generator
+// output: the index is built over the first points of all pairs, queries are
+// the second points of the first pairs
+
+template <usize t_n>
+static char const *argpref(char const *arg, char const (&val)[t_n])
+{
+    if (strncmp(arg, val, t_n - 1) != 0)
+        return nullptr;
+    return arg + (t_n - 1);
+}
+
+int main(int argc, char **argv)
+{
+    char const *json_fname = nullptr;
+    u64 query_cnt = 1024;
+    u32 k = 8;
+    f64 radius = 50.0;
+    u32 thread_cnt = 1;
+
+    for (int i = 1; i < argc; ++i) {
+        if (streq(argv[i], "-f") && i + 1 < argc) {
+            json_fname = argv[++i];
+        } else if (char const *p = argpref(argv[i], "-queries=")) {
+            query_cnt = u64(atoll(p));
+        } else if (char const *p = argpref(argv[i], "-k=")) {
+            k = u32(atoi(p));
+        } else if (char const *p = argpref(argv[i], "-radius=")) {
+            radius = atof(p);
+        } else if (char const *p = argpref(argv[i], "-threads=")) {
+            thread_cnt = u32(atoi(p));
+        } else {
+            LOGERR("Invalid arg: %s", argv[i]);
+            return 1;
+        }
+    }
+
+    if (!json_fname || query_cnt == 0 || k == 0 || radius <= 0.0) {
+        LOGERR(
+            "Usage: <program> -f <generated json> [-queries=1024] [-k=8] "
+            "[-radius=50] [-threads=1]");
+        return 1;
+    }
+
+    init_os_process_state(g_os_proc_state);
+    try_enable_large_pages(g_os_proc_state);
+    u64 const cpu_timer_freq = measure_cpu_timer_freq(0.1l);
+    isa_level_t const isa =
+        min(best_isa_level(detect_cpu_features()), e_isa_avx2);
+
+    haversine_state_t state = {};
+    DEFER([&] { cleanup_haversine_state(state); });
+    if (!setup_haversine_state(state, json_fname))
+        return 2;
+
+    query_cnt = min(query_cnt, state.pair_cnt);
+
+    haversine_point_set_t points = {}, queries = {};
+    haversine_spatial_index_t index = {};
+    haversine_top_k_t tk_brute = {}, tk_index = {};
+    DEFER([&] {
+        cleanup_haversine_point_set(points);
+        cleanup_haversine_point_set(queries);
+        cleanup_haversine_spatial_index(index);
+        cleanup_haversine_top_k(tk_brute);
+        cleanup_haversine_top_k(tk_index);
+    });
+
+    if (!make_haversine_point_set(
+            points, &state.pairs[0].x0, &state.pairs[0].y0,
+            state.pair_cnt, 4) ||
+        !make_haversine_point_set(
+            queries, &state.pairs[0].x1, &state.pairs[0].y1, query_cnt, 4) ||
+        !init_haversine_top_k(tk_brute, query_cnt, k) ||
+        !init_haversine_top_k(tk_index, query_cnt, k))
+    {
+        return 2;
+    }
+
+    u64 start = READ_TIMER();
+    if (!build_haversine_spatial_index(index, points))
+        return 2;
+    f64 const build_sec = ticks_to_sec(READ_TIMER() - start, cpu_timer_freq);
+
+    fprintf(stderr, "Points: %llu, queries: %llu, index: %u nodes, %.3lfs build\n",
+        (unsigned long long)points.cnt, (unsigned long long)query_cnt,
+        index.node_cnt, build_sec);
+
+    // k-NN
+    haversine_top_k_sink_t tk_sink{&tk_brute};
+    start = READ_TIMER();
+    calculate_haversine_matrix(queries, points, isa, thread_cnt, tk_sink);
+    f64 const brute_knn_sec =
+        ticks_to_sec(READ_TIMER() - start, cpu_timer_freq);
+
+    start = READ_TIMER();
+    query_haversine_knn(index, queries, isa, thread_cnt, tk_index);
+    f64 const index_knn_sec =
+        ticks_to_sec(READ_TIMER() - start, cpu_timer_freq);
+
+    // Ties can legitimately swap indices, so compare distances
+    u64 knn_mismatches = 0;
+    for (u64 i = 0; i < query_cnt * k; ++i) {
+        if (tk_brute.neighbours[i].dist != tk_index.neighbours[i].dist)
+            ++knn_mismatches;
+    }
+
+    fprintf(stderr,
+        "k-NN (k=%u): brute %.3lfs (%.0lf queries/s), index %.3lfs "
+        "(%.0lf queries/s), x%.1lf, mismatches: %llu\n",
+        k, brute_knn_sec, f64(query_cnt) / brute_knn_sec,
+        index_knn_sec, f64(query_cnt) / index_knn_sec,
+        brute_knn_sec / index_knn_sec, (unsigned long long)knn_mismatches);
+
+    // Radius, compared by per-query count and distance sum
+    buffer_t radius_buf = allocate_best(4 * query_cnt * sizeof(f64));
+    DEFER([&] { deallocate(radius_buf); });
+    if (!is_valid(radius_buf))
+        return 2;
+    f64 *brute_cnts = (f64 *)radius_buf.data;
+    f64 *brute_sums = brute_cnts + query_cnt;
+    f64 *index_cnts = brute_sums + query_cnt;
+    f64 *index_sums = index_cnts + query_cnt;
+
+    auto brute_radius_sink = [&](u64 r, u64, f64 const *dists, u64 cnt) {
+        for (u64 j = 0; j < cnt; ++j) {
+            if (dists[j] <= radius) {
+                brute_cnts[r] += 1.0;
+                brute_sums[r] += dists[j];
+            }
+        }
+    };
+    start = READ_TIMER();
+    calculate_haversine_matrix(
+        queries, points, isa, thread_cnt, brute_radius_sink);
+    f64 const brute_radius_sec =
+        ticks_to_sec(READ_TIMER() - start, cpu_timer_freq);
+
+    auto index_radius_sink = [&](u64 r, u64, f64 dist) {
+        index_cnts[r] += 1.0;
+        index_sums[r] += dist;
+    };
+    start = READ_TIMER();
+    query_haversine_radius(
+        index, queries, radius, isa, thread_cnt, index_radius_sink);
+    f64 const index_radius_sec =
+        ticks_to_sec(READ_TIMER() - start, cpu_timer_freq);
+
+    u64 radius_mismatches = 0;
+    f64 total_found = 0.0;
+    for (u64 r = 0; r < query_cnt; ++r) {
+        total_found += index_cnts[r];
+        if (brute_cnts[r] != index_cnts[r] ||
+            abs(brute_sums[r] - index_sums[r]) > 1e-6 * brute_sums[r])
+        {
+            ++radius_mismatches;
+        }
+    }
+
+    fprintf(stderr,
+        "Radius (%.1lfkm, %.1lf found per query): brute %.3lfs, index %.3lfs "
+        "(%.0lf queries/s), x%.1lf, mismatches: %llu\n",
+        radius, total_found / f64(query_cnt), brute_radius_sec,
+        index_radius_sec, f64(query_cnt) / index_radius_sec,
+        brute_radius_sec / index_radius_sec,
+        (unsigned long long)radius_mismatches);
+
+    return knn_mismatches || radius_mismatches ? 3 : 0;
+}
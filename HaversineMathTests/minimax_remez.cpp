@@ -0,0 +1,239 @@
+#include <defs.hpp>
+#include <logging.hpp>
+
+// Generates Haversine/Components/minimax_tables.hpp:
+//   minimax_remez > ../../Haversine/Components/minimax_tables.hpp
+//
+// For f(x) ~= x * P(x^2) on [0, b] (sin, asin), substitutes t = x^2 and
+// runs Remez exchange on g(t) = f(sqrt(t)) / sqrt(t) with weight 1 / g(t),
+// which is the same as minimizing the relative error of x * P(x^2). P(0)
+// is pinned to 1 (both functions have f'(0) = 1), so the leading coeff is
+// exact in any precision and small inputs keep their relative accuracy.
+// Everything is in long double, the recorded errors are measured after
+// rounding the coefficients to f64/f32, on a dense grid.
+
+using ld = long double;
+
+inline constexpr u32 c_max_coeffs = 20;
+inline constexpr u32 c_search_grid = 1 << 16;
+inline constexpr u32 c_check_grid = 1 << 18;
+inline constexpr u32 c_max_iterations = 64;
+
+struct approximated_func_t {
+    char const *name;
+    ld (*f)(ld);
+    ld b;
+    u32 max_coeffs;
+};
+
+static ld g(approximated_func_t const &func, ld t)
+{
+    ld const x = sqrtl(t);
+    return func.f(x) / x;
+}
+
+// Coeffs are in the scaled variable s = t / tmax until the very end
+static ld eval_poly(ld const *c, u32 cnt, ld s)
+{
+    ld r = c[cnt - 1];
+    for (u32 i = cnt - 1; i-- > 0;)
+        r = r * s + c[i];
+    return r;
+}
+
+static bool solve_linear(ld (*m)[c_max_coeffs + 2], ld *rhs, u32 n)
+{
+    for (u32 col = 0; col < n; ++col) {
+        u32 pivot = col;
+        for (u32 row = col + 1; row < n; ++row) {
+            if (fabsl(m[row][col]) > fabsl(m[pivot][col]))
+                pivot = row;
+        }
+        if (m[pivot][col] == 0.0l)
+            return false;
+        if (pivot != col) {
+            ld tmp[c_max_coeffs + 2];
+            memcpy(tmp, m[pivot], sizeof(tmp));
+            memcpy(m[pivot], m[col], sizeof(tmp));
+            memcpy(m[col], tmp, sizeof(tmp));
+            ld const tmp_rhs = rhs[pivot];
+            rhs[pivot] = rhs[col];
+            rhs[col] = tmp_rhs;
+        }
+        for (u32 row = col + 1; row < n; ++row) {
+            ld const factor = m[row][col] / m[col][col];
+            for (u32 k = col; k < n; ++k)
+                m[row][k] -= factor * m[col][k];
+            rhs[row] -= factor * rhs[col];
+        }
+    }
+    for (u32 row = n; row-- > 0;) {
+        for (u32 k = row + 1; k < n; ++k)
+            rhs[row] -= m[row][k] * rhs[k];
+        rhs[row] /= m[row][row];
+    }
+    return true;
+}
+
+// Returns scaled coefficients, coeffs[0] = 1
+static bool remez(approximated_func_t const &func, u32 cnt, ld *coeffs)
+{
+    ld const tmax = func.b * func.b;
+    u32 const ref_cnt = cnt;
+
+    auto werr = [&](ld const *c, ld s) {
+        ld const t = s * tmax;
+        ld const gt = g(func, t);
+        return (gt - eval_poly(c, cnt, s)) / gt;
+    };
+
+    // Chebyshev nodes, all interior. With P(0) fixed there are cnt - 1
+    // free coeffs plus the error level, so cnt references.
+    ld ref[c_max_coeffs + 2];
+    for (u32 i = 0; i < ref_cnt; ++i)
+        ref[i] = 0.5l * (1.0l - cosl(M_PIl * (i + 0.5l) / ref_cnt));
+
+    static ld grid_err[c_search_grid + 1];
+    ld best_err = LDBL_MAX;
+    ld best_coeffs[c_max_coeffs];
+
+    for (u32 iter = 0; iter < c_max_iterations; ++iter) {
+        ld m[c_max_coeffs + 2][c_max_coeffs + 2];
+        ld rhs[c_max_coeffs + 2];
+        for (u32 i = 0; i < ref_cnt; ++i) {
+            ld const t = ref[i] * tmax;
+            ld const gt = g(func, t);
+            ld p = ref[i];
+            for (u32 j = 1; j < cnt; ++j, p *= ref[i])
+                m[i][j - 1] = p;
+            m[i][cnt - 1] = (i & 1 ? -1.0l : 1.0l) * gt;
+            rhs[i] = gt - 1.0l;
+        }
+        if (!solve_linear(m, rhs, ref_cnt))
+            return false;
+        coeffs[0] = 1.0l;
+        for (u32 j = 1; j < cnt; ++j)
+            coeffs[j] = rhs[j - 1];
+
+        // Local extrema of the error, merged to alternate in sign
+        struct extremum_t { ld s, e; };
+        static extremum_t extrema[c_search_grid + 1];
+        u32 ext_cnt = 0;
+
+        ld max_grid_err = 0.0l;
+        for (u32 i = 1; i <= c_search_grid; ++i) {
+            grid_err[i] = werr(coeffs, ld(i) / c_search_grid);
+            max_grid_err = max(max_grid_err, fabsl(grid_err[i]));
+        }
+        if (max_grid_err < best_err) {
+            best_err = max_grid_err;
+            memcpy(best_coeffs, coeffs, cnt * sizeof(ld));
+        }
+        for (u32 i = 1; i <= c_search_grid; ++i) {
+            ld const e = grid_err[i];
+            bool const left_ok = i == 1 || fabsl(e) >= fabsl(grid_err[i - 1]);
+            bool const right_ok =
+                i == c_search_grid || fabsl(e) >= fabsl(grid_err[i + 1]);
+            if (!left_ok || !right_ok)
+                continue;
+            extremum_t const ext = {ld(i) / c_search_grid, e};
+            if (ext_cnt > 0 && (extrema[ext_cnt - 1].e < 0.0l) == (e < 0.0l)) {
+                if (fabsl(e) > fabsl(extrema[ext_cnt - 1].e))
+                    extrema[ext_cnt - 1] = ext;
+            } else {
+                extrema[ext_cnt++] = ext;
+            }
+        }
+
+        while (ext_cnt > ref_cnt) {
+            if (fabsl(extrema[0].e) < fabsl(extrema[ext_cnt - 1].e))
+                memmove(extrema, extrema + 1, --ext_cnt * sizeof(extremum_t));
+            else
+                --ext_cnt;
+        }
+        if (ext_cnt < ref_cnt)
+            break; // Already at the precision floor
+
+        ld max_e = 0.0l, min_e = LDBL_MAX;
+        for (u32 i = 0; i < ref_cnt; ++i) {
+            ref[i] = extrema[i].s;
+            max_e = max(max_e, fabsl(extrema[i].e));
+            min_e = min(min_e, fabsl(extrema[i].e));
+        }
+        if (max_e - min_e <= 1e-3l * max_e)
+            break;
+    }
+
+    // Near the precision floor the exchange can wander off, keep the best
+    memcpy(coeffs, best_coeffs, cnt * sizeof(ld));
+    return true;
+}
+
+template <class TFloat>
+static f64 measure_error(approximated_func_t const &func, TFloat const *c, u32 cnt)
+{
+    f64 max_err = 0.0;
+    for (u32 i = 1; i <= c_check_grid; ++i) {
+        ld const x = func.b * ld(i) / c_check_grid;
+        ld const x2 = x * x;
+        ld r = c[cnt - 1];
+        for (u32 j = cnt - 1; j-- > 0;)
+            r = r * x2 + c[j];
+        ld const fx = func.f(x);
+        max_err = max(max_err, f64(fabsl((x * r - fx) / fx)));
+    }
+    return max_err;
+}
+
+int main()
+{
+    approximated_func_t const funcs[] =
+    {
+        {"sin", &sinl, M_PI_2l, c_max_coeffs},
+        {"asin", &asinl, sqrtl(0.5l), c_max_coeffs},
+    };
+
+    printf("#pragma once\n\n");
+    printf("// Generated by HaversineMathTests/minimax_remez.cpp, do not edit\n\n");
+    printf("#include \"minimax_poly.hpp\"\n");
+
+    for (approximated_func_t const &func : funcs) {
+        printf(
+            "\n// %s(x) ~= x * P(x^2) on [0, %.17g]\n"
+            "inline constexpr minimax_poly_t c_%s_minimax_polys[] =\n{\n",
+            func.name, f64(func.b), func.name);
+
+        ld const tmax = func.b * func.b;
+        f64 prev_err = DBL_MAX;
+        for (u32 cnt = 2; cnt <= func.max_coeffs; ++cnt) {
+            ld coeffs[c_max_coeffs];
+            if (!remez(func, cnt, coeffs)) {
+                LOGERR("Remez failed for %s, %u coeffs", func.name, cnt);
+                return 1;
+            }
+
+            f64 c64[c_max_coeffs];
+            f32 c32[c_max_coeffs];
+            ld scale = 1.0l;
+            for (u32 j = 0; j < cnt; ++j, scale *= tmax) {
+                c64[j] = f64(coeffs[j] / scale);
+                c32[j] = f32(c64[j]);
+            }
+
+            // Past the f64 floor the solve is too ill-conditioned to help
+            f64 const err = measure_error(func, c64, cnt);
+            if (err >= prev_err)
+                break;
+            prev_err = err;
+
+            printf("    {%u, %a, %a, {", cnt, err, measure_error(func, c32, cnt));
+            for (u32 j = 0; j < cnt; ++j)
+                printf("%s%a", j ? ", " : "", c64[j]);
+            printf("}},\n");
+        }
+
+        printf("};\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include <haversine_summation.hpp>
+#include <haversine_calculation.hpp>
+
+#include <os.hpp>
+#include <memory.hpp>
+#include <profiling.hpp>
+#include <logging.hpp>
+#include <defer.hpp>
+#include <repetition.hpp>
+
+#ifndef RT_STOP_TIME
+#define RT_STOP_TIME 10.0f
+#endif
+
+// Error and speed of each sum_answer reduction over real haversine answers
+
+static f64 randflt(f64 min, f64 max)
+{
+    return (f64(rand()) / RAND_MAX) * (max - min) + min;
+}
+
+// Reference, Neumaier in long double is ~2^11 times below any f64 mode
+static long double sum_exact(f64 const *a, u64 cnt)
+{
+    long double sum = 0.0l, c = 0.0l;
+    for (u64 i = 0; i < cnt; ++i) {
+        long double const t = sum + a[i];
+        long double const bp = t - sum;
+        c += (sum - (t - bp)) + (a[i] - bp);
+        sum = t;
+    }
+    return sum + c;
+}
+
+int main(int argc, char **argv)
+{
+    u64 const cnt = argc > 1 ? u64(atoll(argv[1])) : u64(1) << 20;
+    if (cnt == 0) {
+        LOGERR("Usage: <program> [answer count]");
+        return 1;
+    }
+
+    init_os_process_state(g_os_proc_state);
+    u64 cpu_timer_freq = measure_cpu_timer_freq(0.1l);
+    isa_level_t const best_isa = best_isa_level(detect_cpu_features());
+
+    buffer_t answers_buf = allocate_best(cnt * sizeof(f64));
+    DEFER([&] { deallocate(answers_buf); });
+    if (!is_valid(answers_buf))
+        return 2;
+
+    f64 *answers = (f64 *)answers_buf.data;
+
+    srand(1);
+    for (u64 i = 0; i < cnt; ++i) {
+        answers[i] = haversine_dist_reference(point_pair_t{
+            randflt(-180.0, 180.0), randflt(-90.0, 90.0),
+            randflt(-180.0, 180.0), randflt(-90.0, 90.0)});
+    }
+
+    long double const exact = sum_exact(answers, cnt);
+    fprintf(stderr, "Answers: %llu, sum: %.20Lg\n\n",
+        (unsigned long long)cnt, exact);
+
+    RepetitionTester rt{cpu_timer_freq, RT_STOP_TIME, true};
+
+    repetition_test_results_t results{};
+    set_rtr_target_ops(results, cnt);
+    u64 const byte_count = cnt * sizeof(f64);
+    set_rtr_target_bytes(results, byte_count);
+
+    f64 reproducible_sums[e_isa_count] = {};
+
+    for (u32 mode = 0; mode < e_hsm_count; ++mode) {
+        for (u32 isa = 0; isa <= best_isa; ++isa) {
+            // Only the reproducible mode has an avx512 path
+            if (isa == e_isa_avx512 && mode != e_hsm_reproducible)
+                continue;
+
+            f64 sum = 0.0;
+
+            rt.ReStart(results);
+            do {
+                rt.BeginTimeBlock();
+                sum = sum_haversine_answers(
+                    answers, cnt, haversine_sum_mode_t(mode), isa_level_t(isa));
+                rt.EndTimeBlock();
+
+                rt.ReportProcessedOps(cnt);
+                rt.ReportProcessedBytes(byte_count);
+            } while (rt.Tick());
+
+            if (mode == e_hsm_reproducible)
+                reproducible_sums[isa] = sum;
+
+            char namebuf[256];
+            snprintf(
+                namebuf, sizeof(namebuf), "%s (%s)",
+                c_haversine_sum_mode_names[mode], c_isa_names[isa]);
+            print_reptest_results(results, cpu_timer_freq, namebuf, true);
+            fprintf(stderr, "Error: %.6Lg (%.3Lg relative)\n\n",
+                fabsl(sum - exact), fabsl(sum - exact) / exact);
+        }
+    }
+
+    for (u32 isa = 1; isa <= best_isa; ++isa) {
+        if (memcmp(&reproducible_sums[isa], &reproducible_sums[0], sizeof(f64))) {
+            LOGERR("Reproducible sum differs on %s: %.17g vs %.17g",
+                c_isa_names[isa], reproducible_sums[isa], reproducible_sums[0]);
+            return 3;
+        }
+    }
+    fprintf(stderr, "Reproducible sum is bit-identical on all isas\n");
+
+    return 0;
+}